@@ -0,0 +1,135 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+
+// --- stand-in child process for benchmarking para ---
+// (reads lines from stdin and echoes each line after spending a configurable amount of time on it)
+// (time per line is either burnt on the CPU or slept, drawn from a fixed, uniform, lognormal or heavy tailed distribution)
+// (a fraction of lines can be stragglers taking a multiple of the drawn time)
+
+#include "error.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/select.h>
+
+// how time is spent on a line
+enum workmode_t{WORK_ECHO=0,WORK_BURN,WORK_SLEEP};
+
+// distribution of time spent on a line
+enum workdist_t{DIST_FIXED=0,DIST_UNIFORM,DIST_LOGNORMAL,DIST_PARETO};
+
+// command line parameters
+static enum workmode_t mode=WORK_ECHO;             // how time is spent on a line
+static enum workdist_t dist=DIST_FIXED;            // distribution of time spent on a line
+static double meanusec=0;                          // mean time in micro seconds spent on a line
+static double straggleprob=0;                      // probability that a line is a straggler
+static double stragglefactor=10;                   // stragglers take this many times longer
+static long seed=0;                                // seed for random numbers (0: seed with pid)
+
+// usage strings
+static char*strusage[]={
+  "Usage:",
+  "  benchchild [options]",
+  "",
+  "options:",
+  "  -h          help and exit",
+  "  -w arg      how time is spent on a line: echo | burn | sleep (default: echo)",
+  "  -t arg      mean time in micro seconds spent on a line (default: 0)",
+  "  -d arg      distribution of time spent on a line: fixed | uniform | lognormal | pareto (default: fixed)",
+  "  -p arg      probability that a line is a straggler (default: 0)",
+  "  -x arg      stragglers take 'arg' times longer than drawn time (default: 10)",
+  "  -r arg      seed for random numbers (default: pid)",
+  NULL
+};
+// print usage and exit
+static void usage(char const*msg){
+  if(msg)fprintf(stderr,"%s\n",msg);
+  for(char**p=strusage;*p;++p)fprintf(stderr,"%s\n",*p);
+  exit(1);
+}
+// draw time in micro seconds to spend on a line
+// (lognormal has sigma 1 and pareto has shape 1.5, both scaled to have mean 'meanusec')
+static double drawusec(){
+  double u=drand48();
+  double ret=meanusec;
+  switch(dist){
+  case DIST_FIXED:
+    break;
+  case DIST_UNIFORM:
+    ret=2*meanusec*u;
+    break;
+  case DIST_LOGNORMAL:{
+    double z=sqrt(-2*log(1-u))*cos(2*M_PI*drand48());    // standard normal (Box-Muller)
+    ret=meanusec*exp(z-0.5);                              // E[exp(z-0.5)] == 1
+    break;
+  }
+  case DIST_PARETO:
+    ret=meanusec/3*pow(1-u,-1/1.5);                       // xm*alpha/(alpha-1) == mean with xm == mean/3
+    break;
+  }
+  if(straggleprob>0&&drand48()<straggleprob)ret*=stragglefactor;
+  return ret;
+}
+// spend time on a line
+static void work(double usec){
+  if(mode==WORK_SLEEP){
+    struct timeval tv;                                    // (select() with a timeout is the portable sleep under '-posix')
+    tv.tv_sec=usec/1e6;                                   // ...
+    tv.tv_usec=usec-tv.tv_sec*1e6;                        // ...
+    select(0,NULL,NULL,NULL,&tv);                         // ...
+  }else
+  if(mode==WORK_BURN){
+    double end=nowusec()+usec;
+    while(nowusec()<end);
+  }
+}
+// main
+int main(int argc,char**argv){
+  int opt;
+  while((opt=getopt(argc,argv,"hw:t:d:p:x:r:"))!=-1){
+    switch(opt){
+    case 'h':
+      usage(NULL);
+    case 'w':
+      if(!strcmp(optarg,"echo"))mode=WORK_ECHO;
+      else if(!strcmp(optarg,"burn"))mode=WORK_BURN;
+      else if(!strcmp(optarg,"sleep"))mode=WORK_SLEEP;
+      else usage("invalid parameter to '-w' option");
+      break;
+    case 't':
+      meanusec=atof(optarg);
+      break;
+    case 'd':
+      if(!strcmp(optarg,"fixed"))dist=DIST_FIXED;
+      else if(!strcmp(optarg,"uniform"))dist=DIST_UNIFORM;
+      else if(!strcmp(optarg,"lognormal"))dist=DIST_LOGNORMAL;
+      else if(!strcmp(optarg,"pareto"))dist=DIST_PARETO;
+      else usage("invalid parameter to '-d' option");
+      break;
+    case 'p':
+      straggleprob=atof(optarg);
+      break;
+    case 'x':
+      stragglefactor=atof(optarg);
+      break;
+    case 'r':
+      seed=atol(optarg);
+      break;
+    default:
+      usage(NULL);
+    }
+  }
+  srand48(seed?seed:getpid());
+  char*line=NULL;                                         // echo lines
+  size_t maxline=0;                                       // ...
+  ssize_t len;                                            // ...
+  while((len=getline(&line,&maxline,stdin))>0){          // ...
+    if(mode!=WORK_ECHO)work(drawusec());                  // ...
+    if(fwrite(line,1,len,stdout)!=(size_t)len)app_message(FATAL,"benchchild: failed writing to stdout");
+    fflush(stdout);                                       // para waits for the response
+  }
+  free(line);
+  return 0;
+}
@@ -0,0 +1,208 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+
+// --- end-to-end benchmark driver for para ---
+// (spawns para with the given command line, feeds it synthetic lines and reads its output)
+// (measures lines/s, para CPU per line, para read/write syscalls per line and line latency from input to output)
+// (latency of a line is the time from when it was completely written into para's input until it was read back from para's output)
+// (para CPU and syscalls are read from '/proc/<pid>' after para exits but before it is reaped - they do not include child processes)
+
+#include "error.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+// command line parameters
+static size_t nlines=100000;                       // #of lines to feed para
+static size_t linelen=64;                          // length of each line in bytes (including newline)
+static int header=0;                               // print header line before results
+
+// usage strings
+static char*strusage[]={
+  "Usage:",
+  "  parabench [options] -- para paraargs ...",
+  "",
+  "options:",
+  "  -h          help and exit",
+  "  -n arg      #of lines to feed para (default: 100000)",
+  "  -l arg      length of each line in bytes including newline, minimum 12 (default: 64)",
+  "  -H          print a header line before the results",
+  "",
+  "output (one comma separated line):",
+  "  lines,linelen,wall_s,lines_per_s,cpu_us_per_line,syscalls_per_line,ctxsw_per_line,p50_us,p99_us,max_us",
+  NULL
+};
+// print usage and exit
+static void usage(char const*msg){
+  if(msg)fprintf(stderr,"%s\n",msg);
+  for(char**p=strusage;*p;++p)fprintf(stderr,"%s\n",*p);
+  exit(1);
+}
+// compare doubles (for qsort)
+static int cmpdouble(void const*a,void const*b){
+  double x=*(double const*)a;
+  double y=*(double const*)b;
+  return x<y?-1:x>y?1:0;
+}
+// read values of fields from a '/proc/<pid>/<file>' having lines of type 'name: value'
+// (values not found are set to -1)
+static void readprocvals(int pid,char const*file,char const**names,long*vals,size_t nvals){
+  for(size_t i=0;i<nvals;++i)vals[i]=-1;
+  char path[64];
+  snprintf(path,sizeof path,"/proc/%d/%s",pid,file);
+  FILE*fp=fopen(path,"r");
+  if(!fp)return;
+  char line[256];
+  while(fgets(line,sizeof line,fp)){
+    for(size_t i=0;i<nvals;++i){
+      size_t n=strlen(names[i]);
+      if(!strncmp(line,names[i],n)&&line[n]==':')vals[i]=atol(line+n+1);
+    }
+  }
+  fclose(fp);
+}
+// read user + system CPU time in micro seconds of a process (not including waited for children) from '/proc/<pid>/stat'
+// (returns -1 if not available)
+static double readproccpu(int pid){
+  char path[64];
+  snprintf(path,sizeof path,"/proc/%d/stat",pid);
+  FILE*fp=fopen(path,"r");
+  if(!fp)return -1;
+  char line[1024];
+  char*p=fgets(line,sizeof line,fp);
+  fclose(fp);
+  if(!p||!(p=strrchr(line,')')))return -1;                // skip 'pid (comm)' - comm may contain blanks
+  unsigned long utime=0,stime=0;                          // fields 14 and 15 - 11 and 12 after state
+  if(sscanf(p+1," %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",&utime,&stime)!=2)return -1;
+  return (utime+stime)*1e6/sysconf(_SC_CLK_TCK);
+}
+// main
+int main(int argc,char**argv){
+  int opt;
+  while((opt=getopt(argc,argv,"hn:l:H"))!=-1){
+    switch(opt){
+    case 'h':
+      usage(NULL);
+    case 'n':
+      if(!isposnumber(optarg)||(nlines=atol(optarg))<1)usage("invalid parameter to '-n' option");
+      break;
+    case 'l':
+      if(!isposnumber(optarg)||(linelen=atol(optarg))<12)usage("invalid parameter to '-l' option");
+      break;
+    case 'H':
+      header=1;
+      break;
+    default:
+      usage(NULL);
+    }
+  }
+  if(optind>=argc)usage("missing para command line");
+
+  // spawn para with pipes for input and output
+  int pin[2],pout[2];
+  if(pipe(pin)<0||pipe(pout)<0)app_message(FATAL,"parabench: failed creating pipes: %s",strerror(errno));
+  signal(SIGPIPE,SIG_IGN);
+  double start=nowusec();
+  int pid=fork();
+  if(pid<0)app_message(FATAL,"parabench: failed in fork(): %s",strerror(errno));
+  if(pid==0){
+    dup2(pin[0],0);
+    dup2(pout[1],1);
+    close(pin[0]);close(pin[1]);close(pout[0]);close(pout[1]);
+    execvp(argv[optind],&argv[optind]);
+    app_message(FATAL,"parabench: failed executing '%s': %s",argv[optind],strerror(errno));
+  }
+  close(pin[0]);
+  close(pout[1]);
+  int fdin=pin[1];                                        // we write para's input
+  int fdout=pout[0];                                      // we read para's output
+  fcntl(fdin,F_SETFL,fcntl(fdin,F_GETFL)|O_NONBLOCK);     // ...
+  fcntl(fdout,F_SETFL,fcntl(fdout,F_GETFL)|O_NONBLOCK);   // ...
+
+  // feed lines and read output until para closes its output
+  double*sent=emalloc(nlines*sizeof(double));             // time each line was written
+  double*lat=emalloc(nlines*sizeof(double));              // latency of each line
+  char*line=emalloc(linelen);                             // line being written
+  size_t nsent=0,nwritten=0;                              // #of lines completely written, #of bytes of current line written
+  size_t nrecv=0;                                         // #of lines read back
+  char rdbuf[65536];                                      // ...
+  while(fdout>=0){
+    fd_set rdset,wrset;
+    FD_ZERO(&rdset);
+    FD_ZERO(&wrset);
+    FD_SET(fdout,&rdset);
+    if(fdin>=0)FD_SET(fdin,&wrset);
+    if(select((fdin>fdout?fdin:fdout)+1,&rdset,&wrset,NULL,NULL)<0){
+      if(errno==EINTR)continue;
+      app_message(FATAL,"parabench: select() failed: %s",strerror(errno));
+    }
+    while(fdin>=0&&FD_ISSET(fdin,&wrset)){                // write as many lines as possible
+      if(nwritten==0){                                    // next line: zero padded line number, padding and newline
+        snprintf(line,linelen,"%010lu ",nsent);           // ...
+        memset(line+11,'x',linelen-12);                   // ...
+        line[linelen-1]='\n';                             // ...
+      }
+      ssize_t n=write(fdin,line+nwritten,linelen-nwritten);
+      if(n<0&&errno==EAGAIN)break;
+      if(n<0)app_message(FATAL,"parabench: failed writing to para: %s",strerror(errno));
+      if((nwritten+=n)<linelen)continue;
+      sent[nsent++]=nowusec();
+      nwritten=0;
+      if(nsent<nlines)continue;
+      close(fdin);                                        // all lines written
+      fdin=-1;                                            // ...
+    }
+    if(FD_ISSET(fdout,&rdset)){                           // read output and count lines
+      ssize_t n=read(fdout,rdbuf,sizeof rdbuf);
+      if(n<0&&errno==EAGAIN)continue;
+      if(n<0)app_message(FATAL,"parabench: failed reading from para: %s",strerror(errno));
+      if(n==0){
+        close(fdout);
+        fdout=-1;
+        continue;
+      }
+      double now=nowusec();
+      for(char*p=rdbuf;(p=memchr(p,'\n',rdbuf+n-p));++p){
+        if(nrecv>=nsent)app_message(FATAL,"parabench: para wrote more lines than it was given");
+        lat[nrecv]=now-sent[nrecv];
+        ++nrecv;
+      }
+    }
+  }
+  double wall=nowusec()-start;
+
+  // collect resource usage of para before reaping it
+  siginfo_t info;
+  if(waitid(P_PID,pid,&info,WEXITED|WNOWAIT)<0)app_message(FATAL,"parabench: waitid() failed: %s",strerror(errno));
+  double cpu=readproccpu(pid);
+  char const*ionames[]={"syscr","syscw"};
+  long io[2];
+  readprocvals(pid,"io",ionames,io,2);
+  char const*csnames[]={"voluntary_ctxt_switches","nonvoluntary_ctxt_switches"};
+  long cs[2];
+  readprocvals(pid,"status",csnames,cs,2);
+  int status;
+  if(waitpid(pid,&status,0)<0)app_message(FATAL,"parabench: waitpid() failed: %s",strerror(errno));
+  if(!WIFEXITED(status)||WEXITSTATUS(status)!=0)app_message(FATAL,"parabench: para failed");
+  if(nrecv!=nlines)app_message(FATAL,"parabench: para wrote %lu lines, expected %lu",nrecv,nlines);
+
+  // print results
+  qsort(lat,nrecv,sizeof(double),cmpdouble);
+  if(header)printf("lines,linelen,wall_s,lines_per_s,cpu_us_per_line,syscalls_per_line,ctxsw_per_line,p50_us,p99_us,max_us\n");
+  printf("%lu,%lu,%.3f,%.0f,%.3f,%.3f,%.3f,%.0f,%.0f,%.0f\n",
+         nlines,linelen,wall/1e6,nlines/(wall/1e6),
+         cpu<0?-1:cpu/nlines,
+         io[0]<0||io[1]<0?-1:(double)(io[0]+io[1])/nlines,
+         cs[0]<0||cs[1]<0?-1:(double)(cs[0]+cs[1])/nlines,
+         lat[nrecv/2],lat[(size_t)(nrecv*0.99)],lat[nrecv-1]);
+  free(sent);
+  free(lat);
+  free(line);
+  return 0;
+}
@@ -0,0 +1,292 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+
+// --- micro benchmarks for para's internal data structures ---
+// (each benchmark keeps 'size' elements in the data structure and exercises it the way 'paraloop()' does)
+// (operations are run in rounds until a time budget is used up - setup is not timed)
+// (results are printed as comma separated lines: benchmark,size,ops,ns_per_op)
+// (the priority queue is checked before any benchmark is run - a benchmark of a broken data structure is meaningless)
+//
+//   tmoq      arm a timer for a line and cancel it when the response arrives (tmo_ctor + tmoq_push, tmoq_remove + tmo_dtor) with 'size' timers armed
+//   outq      responses complete in random order within blocks of 'size' lines, ready lines are moved to the write list and returned to the pool
+//   pool      combufpool get/putback churn with 'size' combufs handed out
+//   inq       push a line at the back and pop a line at the front of an input queue holding 'size' lines
+//   buf       read a line of 'size' bytes into a buffer, copy it and consume it in 4K chunks (buf_reset/buf_add/buf_copy/buf_rd2wr/buf_consume)
+
+#include "error.h"
+#include "util.h"
+#include "priq.h"
+#include "tmo.h"
+#include "buf.h"
+#include "combuf.h"
+#include "inq.h"
+#include "outq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// max size of a line in combufs (buffers are not used by the queue benchmarks)
+#define MICRO_MAXBUF 64
+
+// #of operations in a round (time is checked between rounds)
+#define MICRO_ROUND 64
+
+// max #of lines moved to the write list of the output queue at a time (same as in 'paraloop()')
+#define MICRO_MAXIOV 256
+
+// #of elements and range of keys used when checking the priority queue
+// (few distinct keys - removing an element must work also when it is moved past elements with the same key)
+#define MICRO_CHECKSIZE 1000
+#define MICRO_CHECKKEYS 50
+
+// command line parameters
+static char*bench=NULL;                            // run only this benchmark (NULL: all)
+static size_t minsize=10;                          // smallest size
+static size_t maxsize=1000000;                     // largest size
+static double budgetms=200;                        // time budget in milliseconds for each benchmark and size
+static int header=0;                               // print header line before results
+
+// usage strings
+static char*strusage[]={
+  "Usage:",
+  "  paramicro [options]",
+  "",
+  "options:",
+  "  -h          help and exit",
+  "  -b arg      run only benchmark 'arg': tmoq | outq | pool | inq | buf (default: all)",
+  "  -s arg      smallest size, sizes grow by a factor of 10 (default: 10)",
+  "  -S arg      largest size (default: 1000000)",
+  "  -t arg      time budget in milliseconds for each benchmark and size (default: 200)",
+  "  -H          print a header line before the results",
+  "",
+  "output (one comma separated line per benchmark and size):",
+  "  benchmark,size,ops,ns_per_op",
+  NULL
+};
+// print usage and exit
+static void usage(char const*msg){
+  if(msg)fprintf(stderr,"%s\n",msg);
+  for(char**p=strusage;*p;++p)fprintf(stderr,"%s\n",*p);
+  exit(1);
+}
+// print result of a benchmark
+static void report(char const*name,size_t size,size_t nops,double usec){
+  printf("%s,%lu,%lu,%.1f\n",name,size,nops,usec*1000/nops);
+  fflush(stdout);
+}
+
+// --- checks ---
+
+// compare two int keys
+static int intcmp(void*a,void*b){
+  return *(int*)a<*(int*)b;
+}
+// remove random elements from a priority queue holding mixed keys, then check that the rest pop in order
+// (priq_remove() must restore heap order both upwards and downwards from the hole it fills)
+static void check_priq(){
+  struct priq*q=priq_ctor(MICRO_CHECKSIZE,0,intcmp);
+  int keys[MICRO_CHECKSIZE];
+  int*els[MICRO_CHECKSIZE];                                   // elements still in queue
+  size_t nel=MICRO_CHECKSIZE;
+  for(size_t i=0;i<nel;++i){
+    keys[i]=lrand48()%MICRO_CHECKKEYS;
+    priq_push(q,els[i]=&keys[i]);
+  }
+  while(nel>MICRO_CHECKSIZE/2){                               // remove half of the elements
+    size_t i=lrand48()%nel;                                   // ...
+    priq_remove(q,els[i]);                                    // ...
+    els[i]=els[--nel];                                        // ...
+  }
+  if(priq_size(q)!=nel)app_message(FATAL,"priq check: expected %lu elements in queue after removes, found %lu",nel,priq_size(q));
+  int last=-1;
+  for(size_t i=0;i<nel;++i){
+    int key=*(int*)priq_top(q);
+    if(key<last)app_message(FATAL,"priq check: element %lu popped with key %d after key %d",i,key,last);
+    last=key;
+    priq_pop(q);
+  }
+  priq_dtor(q);
+}
+
+// --- benchmarks ---
+// (each benchmark returns the #of operations executed and sets 'usec' to the time they took)
+
+// timer armed when a line is written to a child process and cancelled when the response is read
+static size_t bench_tmoq(size_t size,double*usec){
+  struct priq*q=tmoq_ctor(size+1);
+  struct tmo_t**tmos=emalloc(size*sizeof(struct tmo_t*));
+  for(size_t i=0;i<size;++i)tmoq_push(q,tmos[i]=tmo_ctor(CLIENT,5+i%7,i));
+  size_t nops=0;
+  double start=nowusec(),end=start+budgetms*1000,now;
+  do{
+    for(size_t k=0;k<MICRO_ROUND;++k,++nops){
+      size_t i=lrand48()%size;                                // response for a random child process
+      tmoq_remove(q,tmos[i]);                                 // ...
+      tmo_dtor(tmos[i]);                                      // ...
+      tmoq_push(q,tmos[i]=tmo_ctor(CLIENT,5+nops%7,i));      // next line written to child process
+    }
+  }while((now=nowusec())<end);
+  *usec=now-start;
+  free(tmos);
+  tmoq_dtor(q);                                               // (destroys timers)
+  return nops;
+}
+// responses complete in random order within blocks of lines
+// (the output queue never holds more than 'size' lines)
+static size_t bench_outq(size_t size,double*usec){
+  struct combufpool*pool=combufpool_ctor(size+1,CBWRITE,MICRO_MAXBUF);
+  struct outq_t*q=outq_ctor(size+1,size+1,0);
+  int*order=emalloc(size*sizeof(int));                        // completion order within block (shuffled per block)
+  for(size_t i=0;i<size;++i)order[i]=i;                       // ...
+  int base=0;                                                 // first line number in block
+  size_t ind=size;                                            // next index in 'order'
+  size_t nops=0;
+  double start=nowusec(),end=start+budgetms*1000,now;
+  do{
+    for(size_t k=0;k<MICRO_ROUND;++k,++nops){
+      if(ind==size){                                          // next block - shuffle completion order (not timed separately)
+        if(nops>0)base+=size;                                 // ...
+        for(size_t i=size-1;i>0;--i){                         // ...
+          size_t j=lrand48()%(i+1);                           // ...
+          int tmp=order[i];order[i]=order[j];order[j]=tmp;    // ...
+        }                                                     // ...
+        ind=0;                                                // ...
+      }                                                       // ...
+      struct combuf*cb=combufpool_get(pool,NULL,CBWRITE);     // next line completes
+      combuf_setlineno(cb,base+order[ind++]);                 // ...
+      outq_push(q,cb);                                        // ...
+      while(outq_fillwr(q,MICRO_MAXIOV)>0){                   // write ready lines
+        while(outq_wrsize(q)>0){                              // ...
+          struct combuf*cbout=outq_wrfront(q);                // ...
+          outq_wrpop(q);                                      // ...
+          combufpool_putback(pool,cbout);                     // ...
+        }
+      }
+    }
+  }while((now=nowusec())<end);
+  *usec=now-start;
+  free(order);
+  outq_dtor(q);
+  combufpool_dtor(pool);
+  return nops;
+}
+// get/putback churn with combufs handed out
+static size_t bench_pool(size_t size,double*usec){
+  struct combufpool*pool=combufpool_ctor(size+1,CBWRITE,MICRO_MAXBUF);
+  struct combuf**cbs=emalloc(size*sizeof(struct combuf*));
+  for(size_t i=0;i<size;++i)cbs[i]=combufpool_get(pool,NULL,CBWRITE);
+  size_t nops=0;
+  double start=nowusec(),end=start+budgetms*1000,now;
+  do{
+    for(size_t k=0;k<MICRO_ROUND;++k,++nops){
+      size_t i=lrand48()%size;                                // a random combuf is returned and a new one handed out
+      combufpool_putback(pool,cbs[i]);                        // ...
+      cbs[i]=combufpool_get(pool,NULL,k%2?CBWRITE:CBREAD);    // ...
+    }
+  }while((now=nowusec())<end);
+  *usec=now-start;
+  for(size_t i=0;i<size;++i)combufpool_putback(pool,cbs[i]);
+  free(cbs);
+  combufpool_dtor(pool);
+  return nops;
+}
+// push at back and pop at front of an input queue
+static size_t bench_inq(size_t size,double*usec){
+  struct combufpool*pool=combufpool_ctor(size+1,CBREAD,MICRO_MAXBUF);
+  struct inq_t*q=inq_ctor(0);
+  for(size_t i=0;i<size;++i)inq_push(q,combufpool_get(pool,NULL,CBREAD));
+  size_t nops=0;
+  double start=nowusec(),end=start+budgetms*1000,now;
+  do{
+    for(size_t k=0;k<MICRO_ROUND;++k,++nops){
+      struct combuf*cb=inq_front(q);                          // line handed to child process
+      inq_pop(q);                                             // ...
+      combufpool_putback(pool,cb);                            // ...
+      inq_push(q,combufpool_get(pool,NULL,CBREAD));           // line read from input
+    }
+  }while((now=nowusec())<end);
+  *usec=now-start;
+  inq_dtor(q);
+  combufpool_dtor(pool);
+  return nops;
+}
+// read, copy and write a line of 'size' bytes
+static size_t bench_buf(size_t size,double*usec){
+  struct buf_t*rd=buf_ctor(RDBUF,size);
+  struct buf_t*wr=buf_ctor(WRBUF,size);
+  memset(buf_buf(rd),'x',size);
+  size_t nops=0;
+  double start=nowusec(),end=start+budgetms*1000,now;
+  do{
+    for(size_t k=0;k<MICRO_ROUND;++k,++nops){
+      buf_reset(rd,RDBUF);                                    // line read into buffer
+      buf_add(rd,size);                                       // ...
+      buf_copy(wr,rd);                                        // line moved to another buffer
+      buf_rd2wr(wr);                                          // ...
+      while(buf_nconsume(wr)>0){                              // line written in chunks
+        size_t n=buf_nconsume(wr)<4096?buf_nconsume(wr):4096; // ...
+        buf_consume(wr,n);                                    // ...
+      }
+    }
+  }while((now=nowusec())<end);
+  *usec=now-start;
+  buf_dtor(rd);
+  buf_dtor(wr);
+  return nops;
+}
+
+// benchmark table
+struct microbench_t{
+  char const*name_;
+  size_t(*run_)(size_t,double*);
+};
+static struct microbench_t benches[]={
+  {"tmoq",bench_tmoq},
+  {"outq",bench_outq},
+  {"pool",bench_pool},
+  {"inq",bench_inq},
+  {"buf",bench_buf},
+  {NULL,NULL}
+};
+// main
+int main(int argc,char**argv){
+  int opt;
+  while((opt=getopt(argc,argv,"hb:s:S:t:H"))!=-1){
+    switch(opt){
+    case 'h':
+      usage(NULL);
+    case 'b':
+      bench=optarg;
+      break;
+    case 's':
+      if(!isposnumber(optarg)||(minsize=atol(optarg))<1)usage("invalid parameter to '-s' option");
+      break;
+    case 'S':
+      if(!isposnumber(optarg)||(maxsize=atol(optarg))<1)usage("invalid parameter to '-S' option");
+      break;
+    case 't':
+      if(!isposnumber(optarg)||(budgetms=atol(optarg))<1)usage("invalid parameter to '-t' option");
+      break;
+    case 'H':
+      header=1;
+      break;
+    default:
+      usage(NULL);
+    }
+  }
+  int found=0;
+  srand48(1);
+  check_priq();
+  if(header)printf("benchmark,size,ops,ns_per_op\n");
+  for(struct microbench_t*b=benches;b->name_;++b){
+    if(bench&&strcmp(bench,b->name_))continue;
+    found=1;
+    for(size_t size=minsize;size<=maxsize;size*=10){
+      double usec;
+      size_t nops=b->run_(size,&usec);
+      report(b->name_,size,nops,usec);
+    }
+  }
+  if(!found)usage("unknown benchmark");
+  return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+# (C) Copyright Hans Ewetz 2019. All rights reserved.
+
+# --- sweep para parameters against the stand-in child process ---
+# (usage: parasweep.sh para parabench benchchild)
+# (prints one comma separated line per run: sweep parameters followed by the output of 'parabench')
+# (the sweep can be narrowed with environment variables: NLINES, MAXCLIENTS, MAXBUFS, MAXOUTQS, LINELENS, CHILDS)
+
+PARA=${1:?usage: parasweep.sh para parabench benchchild}
+PARABENCH=${2:?usage: parasweep.sh para parabench benchchild}
+BENCHCHILD=${3:?usage: parasweep.sh para parabench benchchild}
+
+NLINES=${NLINES:-20000}                                # #of lines per run
+MAXCLIENTS=${MAXCLIENTS:-"1 4 16"}                     # -m
+MAXBUFS=${MAXBUFS:-"4096 65536"}                       # -b
+MAXOUTQS=${MAXOUTQS:-"100 1000"}                       # -M
+LINELENS=${LINELENS:-"16 256 4000"}                    # line sizes (must be shorter than -b)
+CHILDS=${CHILDS:-"echo burn:20:fixed sleep:100:lognormal sleep:100:pareto:0.01"} # child work: mode[:usec[:dist[:straggler prob]]]
+
+echo "m,b,M,child,lines,linelen,wall_s,lines_per_s,cpu_us_per_line,syscalls_per_line,ctxsw_per_line,p50_us,p99_us,max_us"
+for child in $CHILDS; do
+  IFS=: read mode usec dist prob <<END
+$child
+END
+  for m in $MAXCLIENTS; do
+    for b in $MAXBUFS; do
+      for M in $MAXOUTQS; do
+        for l in $LINELENS; do
+          [ "$l" -ge "$b" ] && continue
+          res=$("$PARABENCH" -n "$NLINES" -l "$l" -- "$PARA" -b "$b" -M "$M" -x "$M" -- "$m" "$BENCHCHILD" -w "$mode" -t "${usec:-0}" -d "${dist:-fixed}" -p "${prob:-0}") || exit 1
+          echo "$m,$b,$M,$child,$res"
+        done
+      done
+    done
+  done
+done
@@ -0,0 +1,94 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "affinity.h"
+#include "error.h"
+#include "const.h"
+#include "util.h"
+
+// forward decl
+static void findkey(struct affinity_t*aff,char*line,size_t len,size_t*start,size_t*keylen);
+
+// constructor
+// (returns NULL if regular expression is invalid)
+struct affinity_t*affinity_ctor(size_t field,char delim,char const*re,size_t nslots,size_t maxqueue){
+  struct affinity_t*ret=emalloc(sizeof(struct affinity_t));
+  ret->field_=field;
+  ret->delim_=delim;
+  if(re){
+    if(regcomp(&ret->re_,re,REG_EXTENDED|REG_NEWLINE)){
+      free(ret);
+      return NULL;
+    }
+    ret->hasre_=1;
+  }
+  ret->nslots_=nslots;
+  ret->maxqueue_=maxqueue;
+  ret->queues_=emalloc(nslots*maxqueue*sizeof(struct combuf*));
+  ret->front_=emalloc(nslots*sizeof(size_t));
+  ret->nqueued_=emalloc(nslots*sizeof(size_t));
+  return ret;
+}
+// destructor
+void affinity_dtor(struct affinity_t*aff){
+  if(aff->hasre_)regfree(&aff->re_);
+  free(aff->queues_);
+  free(aff->front_);
+  free(aff->nqueued_);
+  free(aff);
+}
+// child process owning key of line
+size_t affinity_slot(struct affinity_t*aff,char*line,size_t len){
+  if(len>0&&line[len-1]==LF)--len;                       // key never includes the line terminator
+  size_t start=0,keylen=0;                               // ...
+  findkey(aff,line,len,&start,&keylen);                  // ...
+  return fnv1a(FNV1A_OFFSET,line+start,keylen)%aff->nslots_;
+}
+// queue line for child process
+int affinity_push(struct affinity_t*aff,size_t slot,struct combuf*cb){
+  if(aff->nqueued_[slot]==aff->maxqueue_){
+    ++aff->nblocked_;
+    return 0;
+  }
+  size_t ind=(aff->front_[slot]+aff->nqueued_[slot])%aff->maxqueue_;
+  aff->queues_[slot*aff->maxqueue_+ind]=cb;
+  ++aff->nqueued_[slot];
+  ++aff->size_;
+  return 1;
+}
+// next line queued for child process
+struct combuf*affinity_pop(struct affinity_t*aff,size_t slot){
+  if(aff->nqueued_[slot]==0)return NULL;
+  struct combuf*ret=aff->queues_[slot*aff->maxqueue_+aff->front_[slot]];
+  aff->front_[slot]=(aff->front_[slot]+1)%aff->maxqueue_;
+  --aff->nqueued_[slot];
+  --aff->size_;
+  return ret;
+}
+// total #of lines queued
+size_t affinity_size(struct affinity_t*aff){
+  return aff->size_;
+}
+// #of lines queued for child process
+size_t affinity_nqueued(struct affinity_t*aff,size_t slot){
+  return aff->nqueued_[slot];
+}
+
+// --- helpers ---
+
+// find key in line (line does not include line terminator)
+static void findkey(struct affinity_t*aff,char*line,size_t len,size_t*start,size_t*keylen){
+  if(aff->hasre_){                                       // regular expression match
+    regmatch_t m[2];                                     // ...
+    char c=line[len];                                    // ...
+    line[len]='\0';                                      // ...
+    int stat=regexec(&aff->re_,line,2,m,0);              // ...
+    line[len]=c;                                         // ...
+    if(stat)return;                                      // no match - empty key
+    int ind=m[1].rm_so>=0?1:0;                           // first subexpression if there is one
+    *start=m[ind].rm_so;                                 // ...
+    *keylen=m[ind].rm_eo-m[ind].rm_so;                   // ...
+    return;
+  }
+  size_t end;                                            // field (too few fields - empty key)
+  findfield(line,len,aff->field_,aff->delim_,start,&end);// ...
+  *keylen=end-*start;                                    // ...
+}
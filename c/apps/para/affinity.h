@@ -0,0 +1,32 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include <regex.h>
+
+// --- key affinity routing of lines to child processes ---
+// (a key is extracted from each line - a field or a regular expression match - and hashed to a fixed child process)
+// (each child process has a bounded queue of lines so a hot key only blocks the input queue once its queue is full)
+// (lines without a key - too few fields or no match - have an empty key)
+
+struct combuf;
+
+struct affinity_t{
+  size_t field_;                  // field holding key (1: first field, 0: key is a regular expression match)
+  char delim_;                    // field delimiter
+  int hasre_;                     // true if 're_' is set
+  regex_t re_;                    // key is the first subexpression - or the whole match if there is no subexpression
+  size_t nslots_;                 // #of child processes
+  size_t maxqueue_;               // max #of lines queued per child process
+  struct combuf**queues_;         // queued lines (ring buffer for each child process)
+  size_t*front_;                  // front of ring buffer for each child process
+  size_t*nqueued_;                // #of lines queued for each child process
+  size_t size_;                   // total #of lines queued
+  size_t nblocked_;               // #of times the input queue was blocked by a full queue
+};
+struct affinity_t*affinity_ctor(size_t field,char delim,char const*re,size_t nslots,size_t maxqueue); // constructor (returns NULL if regular expression is invalid)
+void affinity_dtor(struct affinity_t*aff);                                                 // destructor (queued lines are not destroyed)
+size_t affinity_slot(struct affinity_t*aff,char*line,size_t len);                          // child process owning key of line ('line' must have room for a terminating NUL)
+int affinity_push(struct affinity_t*aff,size_t slot,struct combuf*cb);                     // queue line for child process (returns false if queue is full)
+struct combuf*affinity_pop(struct affinity_t*aff,size_t slot);                             // next line queued for child process (NULL if none)
+size_t affinity_size(struct affinity_t*aff);                                               // total #of lines queued
+size_t affinity_nqueued(struct affinity_t*aff,size_t slot);                                // #of lines queued for child process
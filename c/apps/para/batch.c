@@ -0,0 +1,100 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "batch.h"
+#include "combuf.h"
+#include "error.h"
+#include "util.h"
+
+// weight of latest per line response time in EWMA
+#define BATCH_EWMA_ALPHA 0.3
+
+// forward decl
+static void adjustsize(struct batch_t*batch);
+
+// constructor
+struct batch_t*batch_ctor(size_t maxlines,double target){
+  struct batch_t*ret=emalloc(sizeof(struct batch_t));
+  ret->maxlines_=maxlines;
+  ret->target_=target;
+  ret->size_=target>0?1:maxlines;                   // adaptive batches start small
+  ret->ewma_=0;
+  ret->pendfront_=ret->pendback_=NULL;
+  ret->npend_=0;
+  ret->waitlinenos_=emalloc(maxlines*sizeof(int));
+  ret->waitfront_=0;
+  ret->nwait_=0;
+  ret->nlines_=0;
+  return ret;
+}
+// destructor
+void batch_dtor(struct batch_t*batch){
+  struct combuf*cb;
+  while((cb=batch_nextpend(batch))!=NULL)combuf_dtor(cb);
+  free(batch->waitlinenos_);
+  free(batch);
+}
+// current batch size
+size_t batch_size(struct batch_t*batch){
+  return batch->size_;
+}
+// start a new batch
+void batch_start(struct batch_t*batch){
+  if(batch->npend_||batch->nwait_)app_message(FATAL,"attempt to start a batch while previous batch is in progress in batch_start()");
+  batch->nlines_=0;
+  batch->start_=nowusec();
+}
+// queue a line to be written after the current one
+void batch_pend(struct batch_t*batch,struct combuf*cb){
+  cb->next_=NULL;
+  if(batch->pendback_)batch->pendback_->next_=cb;
+  else batch->pendfront_=cb;
+  batch->pendback_=cb;
+  ++batch->npend_;
+}
+// get next line to write
+struct combuf*batch_nextpend(struct batch_t*batch){
+  struct combuf*ret=batch->pendfront_;
+  if(!ret)return NULL;
+  batch->pendfront_=ret->next_;
+  if(!batch->pendfront_)batch->pendback_=NULL;
+  ret->next_=NULL;
+  --batch->npend_;
+  return ret;
+}
+// line was completely written to child process
+void batch_sent(struct batch_t*batch,int lineno){
+  if(batch->nwait_==batch->maxlines_)app_message(FATAL,"too many lines waiting for response in batch_sent()");
+  batch->waitlinenos_[(batch->waitfront_+batch->nwait_)%batch->maxlines_]=lineno;
+  ++batch->nwait_;
+  ++batch->nlines_;
+}
+// response for oldest line was read
+// (once the last response in a batch is read the batch size is adjusted)
+int batch_received(struct batch_t*batch){
+  if(batch->nwait_==0)app_message(FATAL,"response from child process without a line waiting for it in batch_received()");
+  int ret=batch->waitlinenos_[batch->waitfront_];
+  batch->waitfront_=(batch->waitfront_+1)%batch->maxlines_;
+  --batch->nwait_;
+  if(batch->nwait_==0&&batch->npend_==0)adjustsize(batch);
+  return ret;
+}
+// #of lines waiting for a response
+size_t batch_nwait(struct batch_t*batch){
+  return batch->nwait_;
+}
+
+// --- helpers ---
+
+// adjust batch size from response time of batch just completed
+// (size is chosen so a batch takes roughly 'target' seconds)
+static void adjustsize(struct batch_t*batch){
+  if(batch->target_<=0||batch->nlines_==0)return;
+  double t=(nowusec()-batch->start_)/1e6;
+  double perline=t/batch->nlines_;
+  if(batch->ewma_==0)batch->ewma_=perline;
+  else batch->ewma_=BATCH_EWMA_ALPHA*perline+(1-BATCH_EWMA_ALPHA)*batch->ewma_;
+  double size=batch->ewma_>0?batch->target_/batch->ewma_:batch->maxlines_;
+  if(size>2*batch->size_)size=2*batch->size_;       // grow gradually
+  if(size<1)size=1;
+  if(size>batch->maxlines_)size=batch->maxlines_;
+  batch->size_=size;
+}
@@ -0,0 +1,39 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+
+// --- batches of lines handed to a child process in one dispatch ---
+// (lines in a batch are written back to back to the child process and responses are read back in the same order)
+// (lines stay in their own combufs so input and output queues still see one combuf per line)
+// (the batch size adapts to the measured per line response time so a batch takes roughly 'target' seconds)
+
+// forward decl
+struct combuf;
+
+// max #of bytes written to a child process in one batch
+// (keeps a batch well below the pipe capacity so child process and para cannot block each other)
+#define BATCH_MAXBYTES 16384
+
+struct batch_t{
+  size_t maxlines_;            // max #of lines in a batch
+  double target_;              // target batch response time in seconds (0: fixed batch size 'maxlines_')
+  size_t size_;                // current batch size
+  double ewma_;                // EWMA of per line response time in seconds (0: no batch completed yet)
+  struct combuf*pendfront_;    // lines in batch not yet written to child process (front)
+  struct combuf*pendback_;     // ... (back)
+  size_t npend_;               // #of lines not yet written
+  int*waitlinenos_;            // line numbers of lines written and waiting for a response (ring buffer)
+  size_t waitfront_;           // index of oldest line waiting for a response
+  size_t nwait_;               // #of lines waiting for a response
+  size_t nlines_;              // #of lines in current batch
+  double start_;               // time in micro seconds when current batch was dispatched
+};
+struct batch_t*batch_ctor(size_t maxlines,double target);   // constructor
+void batch_dtor(struct batch_t*batch);                      // destructor (destroys lines not yet written)
+size_t batch_size(struct batch_t*batch);                    // current batch size (#of lines)
+void batch_start(struct batch_t*batch);                     // start a new batch
+void batch_pend(struct batch_t*batch,struct combuf*cb);     // queue a line to be written after the current one
+struct combuf*batch_nextpend(struct batch_t*batch);         // get next line to write (NULL if none)
+void batch_sent(struct batch_t*batch,int lineno);           // line was completely written to child process
+int batch_received(struct batch_t*batch);                   // response for oldest line was read - returns its line number
+size_t batch_nwait(struct batch_t*batch);                   // #of lines waiting for a response
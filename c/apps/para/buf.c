@@ -3,6 +3,7 @@
 #include "sys.h"
 #include "error.h"
 #include "util.h"
+#include <string.h>
 
 // constructor
 struct buf_t*buf_ctor(enum buftype type,size_t maxbuf){
@@ -94,9 +95,24 @@ void buf_add(struct buf_t*buf,size_t n){
   buf->nbuf_+=n;
   buf->ind_+=n;
 }
+// update state after removing characters from end of buffer
+void buf_drop(struct buf_t*buf,size_t n){
+  if(buf_type(buf)!=RDBUF)app_message(FATAL,"attempt to drop characters from buffer when buffer is not an RDBUF in buf_drop()");
+  if(n>buf_nbuf(buf))app_message(FATAL,"attempt to drop too many bytes in buf_drop()");
+  buf->nbuf_-=n;
+  buf->ind_-=n;
+}
 // update state after consuming characters from buffer
 void buf_consume(struct buf_t*buf,size_t n){
   if(buf_type(buf)!=WRBUF)app_message(FATAL,"attempt to update buffer for write when buffer is not a WRBUF in buf_consume()");
   if(n>buf_nconsume(buf))app_message(FATAL,"attempt to consume too many bytes in buf_consume()");
   buf->ind_+=n;
 }
+// copy content and state of 'src' into 'dst' (dst must be large enough)
+void buf_copy(struct buf_t*dst,struct buf_t*src){
+  if(buf_maxbuf(dst)<buf_nbuf(src))app_message(FATAL,"attempt to copy buffer into a buffer that is too small in buf_copy()");
+  memcpy(dst->buf_,src->buf_,src->nbuf_);
+  dst->type_=src->type_;
+  dst->nbuf_=src->nbuf_;
+  dst->ind_=src->ind_;
+}
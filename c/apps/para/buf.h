@@ -39,4 +39,6 @@ size_t buf_nconsume(struct buf_t*buf);                      // return #of bytes
 void buf_reset(struct buf_t*buf,enum buftype type);         // reset buffer
 void buf_rd2wr(struct buf_t*buf);                           // switch a RDBUF to a WRBUF (we have data in RDBUF and now wants to write it from an WRBUF)
 void buf_add(struct buf_t*buf,size_t n);                    // update state after adding (reading in) characters to buffer
+void buf_drop(struct buf_t*buf,size_t n);                   // update state after removing characters from end of buffer
 void buf_consume(struct buf_t*buf,size_t n);                // update state after consuming (writing out) characters from buffer
+void buf_copy(struct buf_t*dst,struct buf_t*src);           // copy content and state of 'src' into 'dst' (dst must be large enough)
@@ -0,0 +1,228 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "cache.h"
+#include "error.h"
+#include "util.h"
+#include "sys.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// first bytes of a cache file
+// (identifies the record layout - a cache file with a different layout is not loaded)
+#define CACHE_MAGIC "PARACC02"
+#define CACHE_MAGICLEN 8
+
+// extension of temporary file used when rewriting cache file
+#define CACHE_TMPEXT ".tmp"
+
+// forward decl
+static struct cacheent_t*find(struct cache_t*cache,struct linekey_t key);
+static void insert(struct cache_t*cache,struct linekey_t key,char const*out,size_t len);
+static void evict(struct cache_t*cache,size_t need);
+static void rehash(struct cache_t*cache);
+static void unlinkent(struct cache_t*cache,struct cacheent_t*ent);
+static void load(struct cache_t*cache,char const*cachefile);
+static size_t writerec(struct cache_t*cache,FILE*fp,struct linekey_t key,char const*out,size_t len);
+static void compact(struct cache_t*cache);
+
+// constructor
+struct cache_t*cache_ctor(size_t budget,char const*cachefile){
+  struct cache_t*ret=emalloc(sizeof(struct cache_t));
+  ret->budget_=budget;
+  ret->nbuckets_=1024;
+  ret->buckets_=emalloc(ret->nbuckets_*sizeof(struct cacheent_t*));
+  ret->maxents_=1024;
+  ret->ents_=emalloc(ret->maxents_*sizeof(struct cacheent_t*));
+  ret->maxfilesize_=2*budget;
+  if(cachefile)load(ret,cachefile);
+  return ret;
+}
+// destructor
+void cache_dtor(struct cache_t*cache){
+  if(cache->fp_)efpclose(cache->fp_);
+  for(size_t i=0;i<cache->nents_;++i){
+    free(cache->ents_[i]->out_);
+    free(cache->ents_[i]);
+  }
+  free(cache->ents_);
+  free(cache->buckets_);
+  free(cache);
+}
+// lookup response for an input line
+// (a line that was not found is not looked up again while it waits for a child process)
+struct cacheent_t*cache_lookup(struct cache_t*cache,int lineno,struct linekey_t key){
+  if(cache->hasmiss_&&cache->misslineno_==lineno)return NULL;
+  struct cacheent_t*ent=find(cache,key);
+  if(ent){
+    ent->ref_=1;
+    ++cache->nhits_;
+    return ent;
+  }
+  ++cache->nmisses_;
+  cache->hasmiss_=1;
+  cache->misslineno_=lineno;
+  return NULL;
+}
+// response for a line was read from child process
+// (the response is added to the cache and appended to the cache file)
+void cache_completed(struct cache_t*cache,struct linekey_t key,char const*out,size_t len){
+  if(find(cache,key))return;                          // same line was in flight more than once
+  insert(cache,key,out,len);
+  if(cache->fp_){
+    cache->filesize_+=writerec(cache,cache->fp_,key,out,len);
+    if(cache->filesize_>cache->maxfilesize_)compact(cache);
+  }
+}
+
+// --- helpers ---
+
+// find entry with key
+static struct cacheent_t*find(struct cache_t*cache,struct linekey_t key){
+  for(struct cacheent_t*ent=cache->buckets_[key.hash_&(cache->nbuckets_-1)];ent;ent=ent->next_){
+    if(linekey_eq(ent->key_,key))return ent;
+  }
+  return NULL;
+}
+// insert a new entry (evict entries if we are over budget)
+static void insert(struct cache_t*cache,struct linekey_t key,char const*out,size_t len){
+  size_t need=sizeof(struct cacheent_t)+len;
+  if(need>cache->budget_)return;
+  evict(cache,need);
+  struct cacheent_t*ent=emalloc(sizeof(struct cacheent_t));
+  ent->key_=key;
+  ent->out_=emalloc(len);
+  memcpy(ent->out_,out,len);
+  ent->outlen_=len;
+  if(cache->nents_==cache->maxents_){
+    cache->maxents_*=2;
+    struct cacheent_t**ents=emalloc(cache->maxents_*sizeof(struct cacheent_t*));
+    memcpy(ents,cache->ents_,cache->nents_*sizeof(struct cacheent_t*));
+    free(cache->ents_);
+    cache->ents_=ents;
+  }
+  ent->ind_=cache->nents_;
+  cache->ents_[cache->nents_++]=ent;
+  size_t b=key.hash_&(cache->nbuckets_-1);
+  ent->next_=cache->buckets_[b];
+  cache->buckets_[b]=ent;
+  cache->used_+=need;
+  if(cache->nents_>cache->nbuckets_)rehash(cache);
+}
+// evict entries until 'need' bytes fit within budget
+// (CLOCK: entries referenced since the hand passed get a second chance)
+static void evict(struct cache_t*cache,size_t need){
+  while(cache->used_+need>cache->budget_&&cache->nents_>0){
+    if(cache->hand_>=cache->nents_)cache->hand_=0;
+    struct cacheent_t*ent=cache->ents_[cache->hand_];
+    if(ent->ref_){
+      ent->ref_=0;
+      ++cache->hand_;
+      continue;
+    }
+    unlinkent(cache,ent);
+    struct cacheent_t*last=cache->ents_[--cache->nents_];   // move last entry into the freed position
+    cache->ents_[cache->hand_]=last;
+    last->ind_=cache->hand_;
+    cache->used_-=sizeof(struct cacheent_t)+ent->outlen_;
+    free(ent->out_);
+    free(ent);
+  }
+}
+// double #of buckets
+static void rehash(struct cache_t*cache){
+  free(cache->buckets_);
+  cache->nbuckets_*=2;
+  cache->buckets_=emalloc(cache->nbuckets_*sizeof(struct cacheent_t*));
+  for(size_t i=0;i<cache->nents_;++i){
+    struct cacheent_t*ent=cache->ents_[i];
+    size_t b=ent->key_.hash_&(cache->nbuckets_-1);
+    ent->next_=cache->buckets_[b];
+    cache->buckets_[b]=ent;
+  }
+}
+// remove entry from its hash bucket
+static void unlinkent(struct cache_t*cache,struct cacheent_t*ent){
+  struct cacheent_t**p=&cache->buckets_[ent->key_.hash_&(cache->nbuckets_-1)];
+  while(*p!=ent)p=&(*p)->next_;
+  *p=ent->next_;
+}
+// load cache file and open it for appending
+// (a truncated record at the end of the file - from a crash - is cut off)
+// (file layout: magic, then records: hash, check hash, line length, response length, response)
+static void load(struct cache_t*cache,char const*cachefile){
+  size_t maxfile=FILENAME_MAX-strlen(CACHE_TMPEXT);
+  if(strlen(cachefile)>=maxfile)app_message(FATAL,"cache filename too long, maximum length is: %lu",maxfile-1);
+  strcpy(cache->file_,cachefile);
+  sprintf(cache->tmpfile_,"%s%s",cachefile,CACHE_TMPEXT);
+  FILE*fp=fopen(cachefile,"a+b");
+  if(!fp)app_message(FATAL,"failed opening cache file: %s, errno: %d, errstr: %s",cachefile,errno,strerror(errno));
+  setfdcloexec(fileno(fp));
+  rewind(fp);
+  char magic[CACHE_MAGICLEN];
+  size_t nmagic=fread(magic,1,CACHE_MAGICLEN,fp);
+  if(nmagic>0&&(nmagic!=CACHE_MAGICLEN||memcmp(magic,CACHE_MAGIC,CACHE_MAGICLEN))){
+    app_message(FATAL,"cache file: %s was not written by this version of para (remove it to start with an empty cache)",cachefile);
+  }
+  if(nmagic==0&&(fseek(fp,0,SEEK_END)<0||fwrite(CACHE_MAGIC,1,CACHE_MAGICLEN,fp)!=CACHE_MAGICLEN||fflush(fp)!=0)){
+    app_message(FATAL,"failed writing to cache file: %s, errno: %d, errstr: %s",cachefile,errno,strerror(errno));
+  }
+  long goodpos=CACHE_MAGICLEN;
+  char*out=NULL;
+  size_t maxout=0;
+  while(1){
+    struct linekey_t key;
+    uint32_t linelen32;
+    uint32_t len32;
+    if(fread(&key.hash_,sizeof key.hash_,1,fp)!=1||fread(&key.check_,sizeof key.check_,1,fp)!=1)break;
+    if(fread(&linelen32,sizeof linelen32,1,fp)!=1||fread(&len32,sizeof len32,1,fp)!=1)break;
+    key.len_=linelen32;
+    if(len32>maxout){
+      free(out);
+      out=emalloc(maxout=len32);
+    }
+    if(fread(out,1,len32,fp)!=len32)break;
+    if(!find(cache,key))insert(cache,key,out,len32);
+    goodpos=ftell(fp);
+  }
+  free(out);
+  if(ftruncate(fileno(fp),goodpos)<0)app_message(FATAL,"failed truncating cache file: %s, errno: %d, errstr: %s",cachefile,errno,strerror(errno));
+  fseek(fp,0,SEEK_END);
+  cache->fp_=fp;
+  cache->filesize_=goodpos;
+  if(cache->filesize_>cache->maxfilesize_)compact(cache);
+}
+// write a record to cache file - returns size of record
+static size_t writerec(struct cache_t*cache,FILE*fp,struct linekey_t key,char const*out,size_t len){
+  uint32_t linelen32=key.len_;
+  uint32_t len32=len;
+  if(fwrite(&key.hash_,sizeof key.hash_,1,fp)!=1||fwrite(&key.check_,sizeof key.check_,1,fp)!=1||
+     fwrite(&linelen32,sizeof linelen32,1,fp)!=1||fwrite(&len32,sizeof len32,1,fp)!=1||fwrite(out,1,len,fp)!=len){
+    app_message(FATAL,"failed writing to cache file: %s, errno: %d, errstr: %s",cache->file_,errno,strerror(errno));
+  }
+  return sizeof key.hash_+sizeof key.check_+sizeof linelen32+sizeof len32+len;
+}
+// rewrite cache file with the entries in memory
+// (entries evicted from memory are dropped from the file - the new file is written to a temporary file and atomically renamed)
+static void compact(struct cache_t*cache){
+  FILE*fp=fopen(cache->tmpfile_,"wb");
+  if(!fp)app_message(FATAL,"failed opening cache file: %s, errno: %d, errstr: %s",cache->tmpfile_,errno,strerror(errno));
+  setfdcloexec(fileno(fp));
+  if(fwrite(CACHE_MAGIC,1,CACHE_MAGICLEN,fp)!=CACHE_MAGICLEN){
+    app_message(FATAL,"failed writing to cache file: %s, errno: %d, errstr: %s",cache->tmpfile_,errno,strerror(errno));
+  }
+  size_t filesize=CACHE_MAGICLEN;
+  for(size_t i=0;i<cache->nents_;++i){
+    struct cacheent_t*ent=cache->ents_[i];
+    filesize+=writerec(cache,fp,ent->key_,ent->out_,ent->outlen_);
+  }
+  if(fflush(fp)!=0||fsync(fileno(fp))<0){
+    app_message(FATAL,"failed flushing cache file: %s, errno: %d, errstr: %s",cache->tmpfile_,errno,strerror(errno));
+  }
+  if(rename(cache->tmpfile_,cache->file_)<0){
+    app_message(FATAL,"failed renaming cache file: %s to: %s, errno: %d, errstr: %s",cache->tmpfile_,cache->file_,errno,strerror(errno));
+  }
+  app_message(DEBUG,"rewrote cache file: %s, size: %lu --> %lu bytes",cache->file_,cache->filesize_,filesize);
+  efpclose(cache->fp_);
+  cache->fp_=fp;
+  cache->filesize_=filesize;
+}
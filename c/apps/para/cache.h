@@ -0,0 +1,46 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "inflight.h"
+
+// --- result cache for repeated input lines ---
+// (responses are keyed by the key of the input line computed by the in-flight tracker - see inflight.h)
+// (memory is bounded by a byte budget - entries are evicted using the CLOCK algorithm)
+// (optionally entries are appended to a cache file which is loaded on startup so re-runs and recoveries skip work already done)
+// (the cache file is rewritten with only the entries in memory once it grows past twice the byte budget)
+
+// cache entry
+struct cacheent_t{
+  struct linekey_t key_;          // key of input line
+  char*out_;                      // response
+  size_t outlen_;                 // length of response
+  int ref_;                       // referenced since CLOCK hand passed (CLOCK algorithm)
+  size_t ind_;                    // index in entry table
+  struct cacheent_t*next_;        // next entry in hash bucket
+};
+// cache
+struct cache_t{
+  size_t budget_;                 // max #of bytes used by cache entries
+  size_t used_;                   // #of bytes used by cache entries
+  struct cacheent_t**buckets_;    // hash buckets
+  size_t nbuckets_;               // #of buckets (power of 2)
+  struct cacheent_t**ents_;       // entries in CLOCK order
+  size_t nents_;                  // #of entries
+  size_t maxents_;                // #of allocated entries in 'ents_'
+  size_t hand_;                   // CLOCK hand
+  FILE*fp_;                       // cache file (NULL if cache is not persistent)
+  char file_[FILENAME_MAX];       // name of cache file
+  char tmpfile_[FILENAME_MAX];    // name of temporary file used when rewriting cache file
+  size_t filesize_;               // size of cache file
+  size_t maxfilesize_;            // cache file is rewritten when it grows past this size
+  int hasmiss_;                   // true if 'misslineno_' is valid
+  int misslineno_;                // line number of last line not found (a line waiting for a child process is counted only once)
+  size_t nhits_;                  // #of cache hits
+  size_t nmisses_;                // #of cache misses
+};
+struct cache_t*cache_ctor(size_t budget,char const*cachefile);                     // constructor
+void cache_dtor(struct cache_t*cache);                                             // destructor (flushes cache file)
+struct cacheent_t*cache_lookup(struct cache_t*cache,int lineno,struct linekey_t key);     // lookup response for an input line (NULL if not cached)
+void cache_completed(struct cache_t*cache,struct linekey_t key,char const*out,size_t len); // response for a line was read from child process
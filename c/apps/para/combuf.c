@@ -5,6 +5,11 @@
 #include "error.h"
 #include "const.h"
 #include "util.h"
+#include "rec.h"
+#include <errno.h>
+
+// forward decl
+static size_t readrec(struct combuf*cb,int seteof);
 
 // convert a state to a string
 static char*state2string(enum combuf_state state){
@@ -21,6 +26,8 @@ struct combuf*combuf_ctor(int pid,FILE*fp,int lineno,enum combuf_state state,siz
   ret->state_=state;
   ret->eof_=0;
   ret->buf_=buf_ctor(state==CBWRITE?WRBUF:RDBUF,maxbuf);
+  ret->rec_=NULL;
+  ret->recdone_=0;
   ret->next_=NULL;
   return ret;
 }
@@ -89,6 +96,10 @@ void combuf_setlineno(struct combuf*cb,int lineno){
 void combuf_settmo(struct combuf*cb,struct tmo_t*tmo){
   cb->tmo_=tmo;
 }
+// set record framing used when reading
+void combuf_setrec(struct combuf*cb,struct rec_t*rec){
+  cb->rec_=rec;
+}
 // true if combuf is empty, else false
 int combuf_empty(struct combuf*cb){
   return buf_empty(cb->buf_);
@@ -112,6 +123,7 @@ void combuf_swaprd4wr(struct combuf*rdsrc,struct combuf*wrtrg){
 
   // read buffer is the former write buffer --> reset buffer as a clean RDBUF
   buf_reset(rdsrc->buf_,RDBUF);
+  rdsrc->recdone_=0;
 }
 // clear a CBWRITE combuf so we can read as a CBREAD combuf (keep lineno and fp, clear tmo)
 void combuf_clearwr2rd(struct combuf*cb){
@@ -119,6 +131,7 @@ void combuf_clearwr2rd(struct combuf*cb){
   cb->state_=CBREAD;
   cb->tmo_=NULL;
   cb->eof_=0;
+  cb->recdone_=0;
   buf_reset(cb->buf_,RDBUF);
 }
 // clear a combuf so we can read
@@ -127,6 +140,7 @@ void combuf_clear4rd(struct combuf*cb){
   cb->tmo_=NULL;
   cb->lineno_=0;
   cb->eof_=0;
+  cb->recdone_=0;
   buf_reset(cb->buf_,RDBUF);
 }
 // clear a combuf so we can write
@@ -135,12 +149,14 @@ void combuf_clear4wr(struct combuf*cb){
   cb->tmo_=NULL;
   cb->lineno_=0;
   cb->eof_=0;
+  cb->recdone_=0;
   buf_reset(cb->buf_,WRBUF);
 }
 // does CBREAD combuf contain a complete line
-// (if buffer is empty return false, else return 'lastchar==LF')
+// (if buffer is empty return false, else return 'lastchar==LF' - or ask the record framing if there is one)
 int combuf_rdcomplete(struct combuf*cb){
   if(combuf_state(cb)!=CBREAD)app_message(FATAL,"attempt to retrieve #of characters which can be read into CBWRITE combuf combuf_rdcomplete()");
+  if(cb->rec_)return rec_complete(cb->rec_,cb->buf_,cb->recdone_);
   return buf_nbuf(cb->buf_)==0?0:buf_lastchar(cb->buf_)==LF;
 }
 // was entire line written from CBWRITE combuf
@@ -159,7 +175,9 @@ size_t combuf_read(struct combuf*cb,int seteof){
   struct buf_t*buf=combuf_buf(cb);          // get buffer to read into
   size_t max2read=buf_nfree(buf);           // max #of characters we can add to buffer
   if(max2read==0)app_message(FATAL,"attempt to read into full buffer in combuf_read()");
+  if(cb->rec_)return readrec(cb,seteof);    // record framing other than LF terminated lines
   int nread=ereadline(fp,buf_bufrd(buf),max2read,seteof);
+  if(nread==0&&errno==EAGAIN)return 0;      // no data available right now - not eof
   if(nread>0)buf_add(buf,nread);            // do book keeping in buffer (update indices)
   if(nread==0){                             // we reached eof
     if(seteof)cb->eof_=1;                   // set eof marker in combuf
@@ -175,6 +193,21 @@ size_t combuf_read(struct combuf*cb,int seteof){
   }
   return nread;
 }
+// read at most one record into buffer using the record framing of the combuf
+// (same contract as 'combuf_read()')
+static size_t readrec(struct combuf*cb,int seteof){
+  struct buf_t*buf=combuf_buf(cb);          // get buffer to read into
+  size_t nread=rec_read(cb->rec_,combuf_fp(cb),buf,&cb->recdone_);
+  if(nread==0&&errno==EAGAIN)return 0;      // no data available right now - not eof
+  if(nread==0){                             // we reached eof
+    if(seteof)cb->eof_=1;                   // set eof marker in combuf
+    nread=rec_eof(cb->rec_,buf,&cb->recdone_);// we might be missing a delimiter at eof - if so add it
+  }else
+  if(!combuf_rdcomplete(cb)&&buf_nfree(buf)==0){// record is not complete and we have no more room
+    app_message(FATAL,"no room in buffer for a complete record in combuf_read()");
+  }
+  return nread;
+}
 // write at most up to including LF
 // (this is the only function we use when writing data out from a combuf)
 size_t combuf_write(struct combuf*cb,int seteof){
@@ -184,7 +217,11 @@ size_t combuf_write(struct combuf*cb,int seteof){
   struct buf_t*buf=combuf_buf(cb);          // get buffer to write from
   size_t max2write=buf_nconsume(buf);       // max #of characters we can write out of buffer
   if(max2write==0)app_message(FATAL,"attempt to write from buffer that has no characters to write in combuf_write()");
-  int nwritten=ewrite(fileno(fp),buf_bufwr(buf),max2write,seteof);
+  int nwritten=ewrite(fileno(fp),buf_bufwr(buf),max2write,seteof,1);// (child processes and services are always connected through sockets)
+  if(nwritten<0){                           // peer closed connection (service closed connection or child process exited)
+    cb->eof_=1;                             // set eof marker in combuf - caller will handle closed connection
+    return 0;
+  }
   if(nwritten>0)buf_consume(buf,nwritten);  // do book keeping in buffer (update indices)
   if(nwritten==0){                          // we hit eof
     if(seteof)cb->eof_=1;                   // set eof marker in combuf
@@ -226,6 +263,8 @@ struct combuf*combufpool_get(struct combufpool*p,FILE*fp,enum combuf_state state
     ret->fp_=fp;
     ret->state_=state;
     ret->eof_=0;
+    ret->rec_=NULL;
+    ret->recdone_=0;
     return ret;
   }
   return combuf_ctor(-1,fp,0,state,p->maxbuf_);
@@ -236,6 +275,10 @@ void combufpool_putback(struct combufpool*p,struct combuf*cb){
   p->head_=cb;
 
 }
+// true if there are no combufs in pool
+int combufpool_empty(struct combufpool*p){
+  return p->head_==NULL;
+}
 
 // --- combuf table ---
 
@@ -20,6 +20,8 @@ struct combuf{
   enum combuf_state state_; // state of this buffer
   int eof_;                 // did we reach eof
   struct buf_t*buf_;        // buffer holding character and positions within buffer
+  struct rec_t*rec_;        // record framing used when reading (NULL: LF terminated lines) - note: combuf does not own framing
+  int recdone_;             // record framing reported a complete record (only used by multi-line framing)
   struct combuf*next_;      // so we can link combufs
 };
 
@@ -39,6 +41,7 @@ struct tmo_t*combuf_tmo(struct combuf*cb);
 void combuf_setpid(struct combuf*cb,int pid);                                           // set pid for combuf
 void combuf_setlineno(struct combuf*cb,int lineno);                                     // set lineno in combuf (this is normally the only thing changing except buffer)
 void combuf_settmo(struct combuf*cb,struct tmo_t*tmo);                                  // set timer in combuf
+void combuf_setrec(struct combuf*cb,struct rec_t*rec);                                  // set record framing used when reading (NULL: LF terminated lines)
 int combuf_empty(struct combuf*cb);                                                     // true if combuf is empty, else false
 
 // combuf management methods
@@ -64,6 +67,7 @@ struct combufpool*combufpool_ctor(size_t nel,enum combuf_state state,size_t maxb
 void combufpool_dtor(struct combufpool*p);                                             // pool destructor (wil kill all elements in pool)
 struct combuf*combufpool_get(struct combufpool*p,FILE*fp,enum combuf_state state);     // get a combuf from pool, expand if needed
 void combufpool_putback(struct combufpool*p,struct combuf*cb);                         // put back a combuf
+int combufpool_empty(struct combufpool*p);                                             // true if there are no combufs in pool
 
 // --- combuf table ---
 
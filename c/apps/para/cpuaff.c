@@ -0,0 +1,143 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#define _GNU_SOURCE                                   // (cpu_set_t and sched_setaffinity() are GNU extensions)
+#include "cpuaff.h"
+#include "error.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+// directory describing NUMA nodes
+#define CPUAFF_NODEDIR "/sys/devices/system/node"
+
+// forward decl
+static char*readline(char const*path,char*buf,size_t len);
+static void addset(struct cpuplace_t*place,struct cpuset_t*set);
+static void pin(int pid,struct cpuset_t const*set);
+
+// CPU set from a list such as '0-3,8,10-11'
+struct cpuset_t*cpuset_ctor(char const*spec){
+  struct cpuset_t*ret=emalloc(sizeof(struct cpuset_t));
+  size_t maxcpus=0;
+  char const*p=spec;
+  int ok=0;                                           // list parsed up to its end
+  while(1){
+    char*end;
+    long first=strtol(p,&end,10);                     // 'N' or 'N-M'
+    if(end==p||first<0)break;                         // ...
+    long last=first;                                  // ...
+    p=end;                                            // ...
+    if(*p=='-'){                                      // ...
+      last=strtol(++p,&end,10);                       // ...
+      if(end==p||last<first)break;                    // ...
+      p=end;                                          // ...
+    }
+    if(last>=CPU_SETSIZE)break;                       // ...
+    for(long cpu=first;cpu<=last;++cpu){              // add CPUs in range
+      if(ret->ncpus_==maxcpus){                       // ...
+        maxcpus=maxcpus?2*maxcpus:16;                 // ...
+        int*cpus=emalloc(maxcpus*sizeof(int));        // ...
+        if(ret->ncpus_)memcpy(cpus,ret->cpus_,ret->ncpus_*sizeof(int));
+        free(ret->cpus_);                             // ...
+        ret->cpus_=cpus;                              // ...
+      }                                               // ...
+      ret->cpus_[ret->ncpus_++]=cpu;                  // ...
+    }
+    if(*p==','){                                      // next range
+      ++p;                                            // ...
+      continue;                                       // ...
+    }
+    ok=*p=='\0'||*p=='\n';                           // (lists read from sysfs end with a newline)
+    break;
+  }
+  if(!ok){                                            // invalid list
+    cpuset_dtor(ret);                                 // ...
+    return NULL;                                      // ...
+  }
+  return ret;
+}
+// destructor
+void cpuset_dtor(struct cpuset_t*set){
+  free(set->cpus_);
+  free(set);
+}
+// one CPU for each child process in turn from a CPU list
+struct cpuplace_t*cpuplace_cpus(char const*spec){
+  struct cpuset_t*set=cpuset_ctor(spec);
+  if(!set)return NULL;
+  struct cpuplace_t*ret=emalloc(sizeof(struct cpuplace_t));
+  for(size_t i=0;i<set->ncpus_;++i){
+    struct cpuset_t*one=emalloc(sizeof(struct cpuset_t));
+    one->cpus_=emalloc(sizeof(int));
+    one->cpus_[0]=set->cpus_[i];
+    one->ncpus_=1;
+    addset(ret,one);
+  }
+  cpuset_dtor(set);
+  return ret;
+}
+// CPUs of one NUMA node for each child process in turn
+struct cpuplace_t*cpuplace_numa(){
+  char line[4096];
+  if(!readline(CPUAFF_NODEDIR "/online",line,sizeof line))return NULL;
+  struct cpuset_t*nodes=cpuset_ctor(line);            // (node list has the same format as a CPU list)
+  if(!nodes)return NULL;
+  struct cpuplace_t*ret=emalloc(sizeof(struct cpuplace_t));
+  for(size_t i=0;i<nodes->ncpus_;++i){
+    char path[128];
+    snprintf(path,sizeof path,CPUAFF_NODEDIR "/node%d/cpulist",nodes->cpus_[i]);
+    struct cpuset_t*set=readline(path,line,sizeof line)?cpuset_ctor(line):NULL;
+    if(set)addset(ret,set);                           // (memory only nodes have an empty CPU list)
+  }
+  cpuset_dtor(nodes);
+  if(ret->nsets_==0){
+    cpuplace_dtor(ret);
+    return NULL;
+  }
+  return ret;
+}
+// destructor
+void cpuplace_dtor(struct cpuplace_t*place){
+  for(size_t i=0;i<place->nsets_;++i)cpuset_dtor(place->sets_[i]);
+  free(place->sets_);
+  free(place);
+}
+// pin child process number 'ind'
+// (a child process that already exec'ed keeps running where it is until it is pinned - it is pinned right after it is spawned)
+void cpuplace_pin(struct cpuplace_t*place,size_t ind,int pid){
+  pin(pid,place->sets_[ind%place->nsets_]);
+}
+// pin calling thread to a CPU
+void cpu_pinthread(int cpu){
+  struct cpuset_t set={&cpu,1};
+  pin(0,&set);
+}
+
+// --- helpers ---
+
+// read first line of a file (returns NULL if file cannot be read)
+static char*readline(char const*path,char*buf,size_t len){
+  FILE*fp=fopen(path,"r");
+  if(!fp)return NULL;
+  char*ret=fgets(buf,len,fp);
+  fclose(fp);
+  return ret;
+}
+// add a set to a placement
+static void addset(struct cpuplace_t*place,struct cpuset_t*set){
+  struct cpuset_t**sets=emalloc((place->nsets_+1)*sizeof(struct cpuset_t*));
+  if(place->nsets_)memcpy(sets,place->sets_,place->nsets_*sizeof(struct cpuset_t*));
+  free(place->sets_);
+  place->sets_=sets;
+  place->sets_[place->nsets_++]=set;
+}
+// pin a process (or calling thread if 'pid' is 0) to a set of CPUs
+static void pin(int pid,struct cpuset_t const*set){
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for(size_t i=0;i<set->ncpus_;++i)CPU_SET(set->cpus_[i],&mask);
+  if(sched_setaffinity(pid,sizeof mask,&mask)<0){
+    app_message(FATAL,"failed setting CPU affinity of pid: %d to CPU: %d%s, errno: %d, errstr: %s",pid,set->cpus_[0],set->ncpus_>1?" (and others)":"",errno,strerror(errno));
+  }
+}
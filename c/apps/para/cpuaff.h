@@ -0,0 +1,26 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+
+// --- CPU affinity of the main loop and of child processes ---
+// (the main loop can be pinned to a CPU and child processes can be spread over a list of CPUs or over NUMA nodes)
+// (NUMA nodes and their CPUs are read from '/sys/devices/system/node' - nodes without CPUs are skipped)
+// (child process K is pinned to CPU set K modulo #of sets - one set per CPU in a list, or one set per NUMA node)
+
+// set of CPUs
+struct cpuset_t{
+  int*cpus_;                      // CPU numbers
+  size_t ncpus_;                  // ...
+};
+// placement of child processes
+struct cpuplace_t{
+  struct cpuset_t**sets_;         // child process K is pinned to 'sets_[K%nsets_]'
+  size_t nsets_;                  // ...
+};
+struct cpuset_t*cpuset_ctor(char const*spec);                        // CPU set from a list such as '0-3,8,10-11' (returns NULL if list is invalid)
+void cpuset_dtor(struct cpuset_t*set);                               // destructor
+struct cpuplace_t*cpuplace_cpus(char const*spec);                    // one CPU for each child process in turn from a CPU list (returns NULL if list is invalid)
+struct cpuplace_t*cpuplace_numa();                                   // CPUs of one NUMA node for each child process in turn (returns NULL if nodes cannot be read)
+void cpuplace_dtor(struct cpuplace_t*place);                         // destructor
+void cpuplace_pin(struct cpuplace_t*place,size_t ind,int pid);      // pin child process number 'ind' with process id 'pid'
+void cpu_pinthread(int cpu);                                         // pin calling thread to a CPU
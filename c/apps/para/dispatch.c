@@ -0,0 +1,129 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "dispatch.h"
+#include "error.h"
+#include "util.h"
+#include <string.h>
+
+// weight of latest response time in EWMA
+#define DISPATCH_EWMA_ALPHA 0.2
+
+// forward decl
+static size_t pickrr(struct dispatch_t*disp);
+static size_t pickleast(struct dispatch_t*disp);
+static size_t pickewma(struct dispatch_t*disp);
+static size_t pickp2c(struct dispatch_t*disp);
+static int usestime(struct dispatch_t*disp);
+
+// constructor
+struct dispatch_t*dispatch_ctor(enum dispatchpolicy_t policy,size_t nslots){
+  struct dispatch_t*ret=emalloc(sizeof(struct dispatch_t));
+  ret->policy_=policy;
+  ret->nslots_=nslots;
+  ret->idle_=emalloc(nslots*sizeof(size_t));
+  ret->nidle_=0;
+  ret->next_=0;
+  ret->ndispatched_=emalloc(nslots*sizeof(size_t));
+  ret->ewma_=emalloc(nslots*sizeof(double));
+  ret->sent_=emalloc(nslots*sizeof(double));
+  for(size_t i=0;i<nslots;++i){
+    ret->ndispatched_[i]=0;
+    ret->ewma_[i]=0;
+  }
+  ret->rnd_=88172645463325252UL;
+  return ret;
+}
+// destructor
+void dispatch_dtor(struct dispatch_t*disp){
+  free(disp->idle_);
+  free(disp->ndispatched_);
+  free(disp->ewma_);
+  free(disp->sent_);
+  free(disp);
+}
+// remove all idle child processes
+void dispatch_clearidle(struct dispatch_t*disp){
+  disp->nidle_=0;
+}
+// register an idle child process
+// (child processes must be registered in table order)
+void dispatch_setidle(struct dispatch_t*disp,size_t slot){
+  disp->idle_[disp->nidle_++]=slot;
+}
+// pick (and remove) idle child process to hand next line to
+int dispatch_next(struct dispatch_t*disp){
+  if(disp->nidle_==0)return -1;
+  size_t ind=0;                                               // index into idle list
+  switch(disp->policy_){
+  case DISPATCH_FIRST:ind=0;break;
+  case DISPATCH_RR:ind=pickrr(disp);break;
+  case DISPATCH_LEAST:ind=pickleast(disp);break;
+  case DISPATCH_EWMA:ind=pickewma(disp);break;
+  case DISPATCH_P2C:ind=pickp2c(disp);break;
+  }
+  size_t slot=disp->idle_[ind];
+  memmove(&disp->idle_[ind],&disp->idle_[ind+1],(disp->nidle_-ind-1)*sizeof(size_t)); // keep idle list in table order
+  --disp->nidle_;
+  ++disp->ndispatched_[slot];
+  disp->next_=slot+1;
+  if(usestime(disp))disp->sent_[slot]=nowusec();
+  return slot;
+}
+// complete response was read from child process
+void dispatch_done(struct dispatch_t*disp,size_t slot){
+  if(!usestime(disp))return;
+  double t=(nowusec()-disp->sent_[slot])/1e6;
+  if(disp->ewma_[slot]==0)disp->ewma_[slot]=t;
+  else disp->ewma_[slot]=DISPATCH_EWMA_ALPHA*t+(1-DISPATCH_EWMA_ALPHA)*disp->ewma_[slot];
+}
+// convert policy name to policy
+int dispatch_str2policy(char const*str,enum dispatchpolicy_t*policy){
+  if(!strcmp(str,"first"))*policy=DISPATCH_FIRST;else
+  if(!strcmp(str,"rr"))*policy=DISPATCH_RR;else
+  if(!strcmp(str,"least"))*policy=DISPATCH_LEAST;else
+  if(!strcmp(str,"ewma"))*policy=DISPATCH_EWMA;else
+  if(!strcmp(str,"p2c"))*policy=DISPATCH_P2C;else
+  return 0;
+  return 1;
+}
+
+// --- helpers ---
+
+// first idle child process at or after round robin position (wraps around)
+static size_t pickrr(struct dispatch_t*disp){
+  for(size_t i=0;i<disp->nidle_;++i){
+    if(disp->idle_[i]>=disp->next_)return i;
+  }
+  return 0;
+}
+// idle child process handed fewest lines
+static size_t pickleast(struct dispatch_t*disp){
+  size_t ret=0;
+  for(size_t i=1;i<disp->nidle_;++i){
+    if(disp->ndispatched_[disp->idle_[i]]<disp->ndispatched_[disp->idle_[ret]])ret=i;
+  }
+  return ret;
+}
+// idle child process with lowest EWMA response time
+// (a child process without a response yet has EWMA 0 and is tried first)
+static size_t pickewma(struct dispatch_t*disp){
+  size_t ret=0;
+  for(size_t i=1;i<disp->nidle_;++i){
+    if(disp->ewma_[disp->idle_[i]]<disp->ewma_[disp->idle_[ret]])ret=i;
+  }
+  return ret;
+}
+// lowest EWMA response time of two random idle child processes
+// (xorshift random numbers)
+static size_t pickp2c(struct dispatch_t*disp){
+  if(disp->nidle_==1)return 0;
+  disp->rnd_^=disp->rnd_<<13;
+  disp->rnd_^=disp->rnd_>>7;
+  disp->rnd_^=disp->rnd_<<17;
+  size_t i=disp->rnd_%disp->nidle_;
+  size_t j=(i+1+(disp->rnd_>>32)%(disp->nidle_-1))%disp->nidle_; // j != i
+  return disp->ewma_[disp->idle_[j]]<disp->ewma_[disp->idle_[i]]?j:i;
+}
+// true if policy needs response times
+static int usestime(struct dispatch_t*disp){
+  return disp->policy_==DISPATCH_EWMA||disp->policy_==DISPATCH_P2C;
+}
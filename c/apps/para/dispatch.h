@@ -0,0 +1,35 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+
+// --- scheduler choosing which idle child process gets the next line ---
+// (idle child processes are registered with 'dispatch_setidle()' and picked one by one with 'dispatch_next()')
+// (latency based policies measure the time from handing a line to a child process until the complete response is read)
+
+// scheduling policies
+enum dispatchpolicy_t{
+  DISPATCH_FIRST=0, // first idle child process in table order (low index children are preferred)
+  DISPATCH_RR=1,    // round robin over idle child processes
+  DISPATCH_LEAST=2, // idle child process that has been handed fewest lines
+  DISPATCH_EWMA=3,  // idle child process with lowest EWMA response time (untried child processes first)
+  DISPATCH_P2C=4    // power of two choices: lowest EWMA response time of two random idle child processes
+};
+
+struct dispatch_t{
+  enum dispatchpolicy_t policy_; // scheduling policy
+  size_t nslots_;                // #of child processes
+  size_t*idle_;                  // idle child processes (candidates)
+  size_t nidle_;                 // #of idle child processes
+  size_t next_;                  // next slot in round robin order
+  size_t*ndispatched_;           // #of lines handed to each child process
+  double*ewma_;                  // EWMA of response time in seconds for each child process (0: no response yet)
+  double*sent_;                  // time in micro seconds when last line was handed to each child process
+  unsigned long rnd_;            // state for random numbers (power of two choices)
+};
+struct dispatch_t*dispatch_ctor(enum dispatchpolicy_t policy,size_t nslots); // constructor
+void dispatch_dtor(struct dispatch_t*disp);                                  // destructor
+void dispatch_clearidle(struct dispatch_t*disp);                             // remove all idle child processes
+void dispatch_setidle(struct dispatch_t*disp,size_t slot);                   // register an idle child process
+int dispatch_next(struct dispatch_t*disp);                                   // pick (and remove) idle child process to hand next line to (-1 if none)
+void dispatch_done(struct dispatch_t*disp,size_t slot);                      // complete response was read from child process
+int dispatch_str2policy(char const*str,enum dispatchpolicy_t*policy);        // convert policy name to policy (returns 0 if unknown name)
@@ -0,0 +1,180 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "gz.h"
+#include "error.h"
+#include "sys.h"
+#include "util.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef PARA_HAVE_ZLIB
+#include <zlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#endif
+
+// size of buffers used when compressing/decompressing
+#define GZ_BUFSIZE 65536
+
+// magic number at start of gzip data
+#define GZ_MAGIC1 0x1f
+#define GZ_MAGIC2 0x8b
+
+// true if fd is a regular file starting with the gzip magic number
+// (uses pread so the file position is not changed)
+int gzin_isgzip(int fd){
+  struct stat st;
+  if(fstat(fd,&st)<0||!S_ISREG(st.st_mode))return 0;
+  off_t pos=lseek(fd,0,SEEK_CUR);
+  if(pos<0)return 0;
+  unsigned char magic[2];
+  if(pread(fd,magic,2,pos)!=2)return 0;
+  return magic[0]==GZ_MAGIC1&&magic[1]==GZ_MAGIC2;
+}
+
+#ifdef PARA_HAVE_ZLIB
+
+// true if para was built with zlib
+int gz_available(){
+  return 1;
+}
+
+// --- gzip input ---
+
+struct gzin_t{
+  pthread_t thread_;          // decompression thread
+  gzFile gzfp_;               // compressed input
+  int pipefds_[2];            // decompressed data is written to pipefds_[1] and read from pipefds_[0]
+};
+// decompression thread
+// (zlib reads concatenated gzip members and passes through data that is not compressed)
+static void*gzin_run(void*arg){
+  struct gzin_t*gzin=arg;
+  char*buf=emalloc(GZ_BUFSIZE);
+  int n;
+  while((n=gzread(gzin->gzfp_,buf,GZ_BUFSIZE))>0){
+    for(int i=0;i<n;){
+      ssize_t w=ewrite(gzin->pipefds_[1],buf+i,n-i,1,0);
+      if(w<0)app_message(FATAL,"reader of decompressed input went away");
+      i+=w;
+    }
+  }
+  if(n<0){
+    int errnum;
+    app_message(FATAL,"failed decompressing input: %s",gzerror(gzin->gzfp_,&errnum));
+  }
+  eclose(gzin->pipefds_[1]);                                  // eof for reader
+  free(buf);
+  return NULL;
+}
+// start a thread decompressing from fd
+struct gzin_t*gzin_ctor(int fd){
+  struct gzin_t*ret=emalloc(sizeof(struct gzin_t));
+  if(!(ret->gzfp_=gzdopen(fd,"rb")))app_message(FATAL,"gzdopen() failed on input fd: %d",fd);
+  gzbuffer(ret->gzfp_,GZ_BUFSIZE);
+  if(pipe(ret->pipefds_)<0)app_message(FATAL,"pipe failed, errno: %d, errstr: %s in gzin_ctor()",errno,strerror(errno));
+  setfdcloexec(ret->pipefds_[0]);                             // child processes have no use for the pipe
+  setfdcloexec(ret->pipefds_[1]);                             // ...
+  int stat=createthread(&ret->thread_,gzin_run,ret);
+  if(stat!=0)app_message(FATAL,"failed creating decompression thread, errstr: %s",strerror(stat));
+  return ret;
+}
+// wait for decompression thread to terminate
+// (read end of pipe is owned by the caller)
+void gzin_dtor(struct gzin_t*gzin){
+  int stat=pthread_join(gzin->thread_,NULL);
+  if(stat!=0)app_message(FATAL,"failed joining decompression thread, errstr: %s",strerror(stat));
+  gzclose(gzin->gzfp_);
+  free(gzin);
+}
+// fd from which decompressed input is read
+int gzin_fd(struct gzin_t*gzin){
+  return gzin->pipefds_[0];
+}
+
+// --- gzip output ---
+
+struct gzout_t{
+  int fd_;                    // output
+  z_stream zs_;               // compression state
+  unsigned char*obuf_;        // compressed data not yet written
+  size_t pos_;                // output position (#of compressed bytes written)
+  size_t nin_;                // #of uncompressed bytes in current member
+};
+// write compressed data in output buffer
+static void gzout_drain(struct gzout_t*gzout){
+  size_t n=GZ_BUFSIZE-gzout->zs_.avail_out;
+  for(size_t i=0;i<n;){
+    ssize_t w=ewrite(gzout->fd_,gzout->obuf_+i,n-i,1,0);
+    if(w<0)app_message(FATAL,"output connection closed by peer");
+    i+=w;
+  }
+  gzout->pos_+=n;
+  gzout->zs_.next_out=gzout->obuf_;
+  gzout->zs_.avail_out=GZ_BUFSIZE;
+}
+// constructor
+struct gzout_t*gzout_ctor(int fd,int level,size_t startpos){
+  struct gzout_t*ret=emalloc(sizeof(struct gzout_t));
+  ret->fd_=fd;
+  memset(&ret->zs_,0,sizeof ret->zs_);
+  if(deflateInit2(&ret->zs_,level,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY)!=Z_OK){ // 15+16: gzip header and trailer
+    app_message(FATAL,"deflateInit2() failed: %s",ret->zs_.msg?ret->zs_.msg:"");
+  }
+  ret->obuf_=emalloc(GZ_BUFSIZE);
+  ret->zs_.next_out=ret->obuf_;
+  ret->zs_.avail_out=GZ_BUFSIZE;
+  ret->pos_=startpos;
+  ret->nin_=0;
+  return ret;
+}
+// destructor
+void gzout_dtor(struct gzout_t*gzout){
+  deflateEnd(&gzout->zs_);
+  free(gzout->obuf_);
+  free(gzout);
+}
+// compress and write data
+void gzout_write(struct gzout_t*gzout,void const*buf,size_t n){
+  gzout->zs_.next_in=(unsigned char*)buf;
+  gzout->zs_.avail_in=n;
+  while(gzout->zs_.avail_in>0){
+    if(deflate(&gzout->zs_,Z_NO_FLUSH)==Z_STREAM_ERROR)app_message(FATAL,"deflate() failed");
+    if(gzout->zs_.avail_out==0)gzout_drain(gzout);
+  }
+  gzout->nin_+=n;
+}
+// end current gzip member and return output position at end of member
+// (nothing is written if nothing was compressed since the last member ended)
+size_t gzout_endmember(struct gzout_t*gzout){
+  if(gzout->nin_==0)return gzout->pos_;
+  int stat;
+  gzout->zs_.avail_in=0;
+  while((stat=deflate(&gzout->zs_,Z_FINISH))!=Z_STREAM_END){
+    if(stat==Z_STREAM_ERROR)app_message(FATAL,"deflate() failed");
+    gzout_drain(gzout);
+  }
+  gzout_drain(gzout);
+  if(deflateReset(&gzout->zs_)!=Z_OK)app_message(FATAL,"deflateReset() failed");
+  gzout->nin_=0;
+  return gzout->pos_;
+}
+// current output position
+size_t gzout_pos(struct gzout_t*gzout){
+  return gzout->pos_;
+}
+
+#else
+
+// stubs used when para is built without zlib
+int gz_available(){return 0;}
+struct gzin_t*gzin_ctor(int fd){app_message(FATAL,"para was built without zlib - cannot decompress input");return NULL;}
+void gzin_dtor(struct gzin_t*gzin){}
+int gzin_fd(struct gzin_t*gzin){return -1;}
+struct gzout_t*gzout_ctor(int fd,int level,size_t startpos){app_message(FATAL,"para was built without zlib - cannot compress output");return NULL;}
+void gzout_dtor(struct gzout_t*gzout){}
+void gzout_write(struct gzout_t*gzout,void const*buf,size_t n){}
+size_t gzout_endmember(struct gzout_t*gzout){return 0;}
+size_t gzout_pos(struct gzout_t*gzout){return 0;}
+
+#endif
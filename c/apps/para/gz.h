@@ -0,0 +1,28 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+
+// --- gzip compressed input and output ---
+// (only available if para is built with zlib - otherwise all functions terminate with an error)
+// (input is decompressed on a separate thread feeding the line splitter through a pipe)
+// (output is compressed on the writer thread - see 'iothread.h' - as a sequence of gzip members)
+// (when running in transactional mode a member ends at each commit so a committed output position is always at a member boundary)
+
+// forward decl
+struct gzin_t;
+struct gzout_t;
+
+int gz_available();                                     // true if para was built with zlib
+
+// gzip input
+int gzin_isgzip(int fd);                                // true if fd is a regular file starting with the gzip magic number (file position is not changed)
+struct gzin_t*gzin_ctor(int fd);                        // start a thread decompressing from fd (plain input is passed through as is)
+void gzin_dtor(struct gzin_t*gzin);                     // wait for decompression thread to terminate (after eof)
+int gzin_fd(struct gzin_t*gzin);                        // fd from which decompressed input is read
+
+// gzip output
+struct gzout_t*gzout_ctor(int fd,int level,size_t startpos); // constructor ('startpos' is the current output position)
+void gzout_dtor(struct gzout_t*gzout);                  // destructor (does not end current member)
+void gzout_write(struct gzout_t*gzout,void const*buf,size_t n); // compress and write data (fd is blocking)
+size_t gzout_endmember(struct gzout_t*gzout);           // end current gzip member and return output position at end of member
+size_t gzout_pos(struct gzout_t*gzout);                 // current output position (#of compressed bytes written)
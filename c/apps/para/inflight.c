@@ -0,0 +1,137 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "inflight.h"
+#include "error.h"
+#include "util.h"
+#include <string.h>
+
+// forward decl
+static struct inflightent_t*find(struct inflight_t*inf,struct linekey_t key);
+
+// true if keys identify the same line
+int linekey_eq(struct linekey_t k1,struct linekey_t k2){
+  return k1.hash_==k2.hash_&&k1.check_==k2.check_&&k1.len_==k2.len_;
+}
+// constructor
+// (the command line is part of the key so a key is never valid for a different command)
+struct inflight_t*inflight_ctor(char const*cmdline,size_t nslots,size_t maxperslot,int coalesce){
+  struct inflight_t*ret=emalloc(sizeof(struct inflight_t));
+  ret->seed_=fnv1a(FNV1A_OFFSET,cmdline,strlen(cmdline));
+  ret->checkseed_=mixhash(MIXHASH_OFFSET,cmdline,strlen(cmdline));
+  ret->maxperslot_=maxperslot;
+  ret->keys_=emalloc((nslots*maxperslot+1)*sizeof(struct linekey_t));
+  ret->owners_=emalloc((nslots*maxperslot+1)*sizeof(struct inflightent_t*));
+  ret->front_=emalloc((nslots+1)*sizeof(size_t));
+  ret->nkeys_=emalloc((nslots+1)*sizeof(size_t));
+  ret->coalesce_=coalesce;
+  ret->nbuckets_=1;                                  // at least twice as many buckets as lines in flight
+  while(ret->nbuckets_<2*nslots*maxperslot)ret->nbuckets_*=2;
+  ret->buckets_=emalloc(ret->nbuckets_*sizeof(struct inflightent_t*));
+  return ret;
+}
+// destructor
+void inflight_dtor(struct inflight_t*inf){
+  for(size_t i=0;i<inf->nbuckets_;++i){
+    while(inf->buckets_[i]){
+      struct inflightent_t*ent=inf->buckets_[i];
+      inf->buckets_[i]=ent->next_;
+      inflight_release(inf,ent);
+    }
+  }
+  while(inf->free_){
+    struct inflightent_t*ent=inf->free_;
+    inf->free_=ent->next_;
+    free(ent->line_);
+    free(ent->waiters_);
+    free(ent);
+  }
+  free(inf->buckets_);
+  free(inf->keys_);
+  free(inf->owners_);
+  free(inf->front_);
+  free(inf->nkeys_);
+  free(inf);
+}
+// key of a line
+// (a line that stays at the front of the input queue while child processes are busy is not hashed again)
+struct linekey_t inflight_key(struct inflight_t*inf,int lineno,char const*line,size_t len){
+  if(inf->hasmemo_&&inf->memolineno_==lineno)return inf->memokey_;
+  inf->hasmemo_=1;
+  inf->memolineno_=lineno;
+  inf->memokey_.hash_=fnv1a(inf->seed_,line,len);
+  inf->memokey_.check_=mixhash(inf->checkseed_,line,len);
+  inf->memokey_.len_=len;
+  return inf->memokey_;
+}
+// if a duplicate of the line is in flight, wait for its response
+// (a line with the same key but different bytes is not a duplicate - it goes to a child process)
+int inflight_wait(struct inflight_t*inf,struct linekey_t key,int lineno,char const*line,size_t len){
+  if(!inf->coalesce_)return 0;
+  struct inflightent_t*ent=find(inf,key);
+  if(!ent||memcmp(ent->line_,line,len))return 0;
+  if(ent->nwaiters_==ent->maxwaiters_){
+    ent->maxwaiters_=ent->maxwaiters_?2*ent->maxwaiters_:8;
+    int*waiters=emalloc(ent->maxwaiters_*sizeof(int));
+    memcpy(waiters,ent->waiters_,ent->nwaiters_*sizeof(int));
+    free(ent->waiters_);
+    ent->waiters_=waiters;
+  }
+  ent->waiters_[ent->nwaiters_++]=lineno;
+  ++inf->ncoalesced_;
+  return 1;
+}
+// line was handed to child process
+// (the line owns a new index entry unless a line with the same key is already in flight)
+void inflight_add(struct inflight_t*inf,size_t slot,struct linekey_t key,char const*line,size_t len){
+  if(inf->nkeys_[slot]==inf->maxperslot_)app_message(FATAL,"too many lines in flight for child process in inflight_add()");
+  size_t ind=slot*inf->maxperslot_+(inf->front_[slot]+inf->nkeys_[slot])%inf->maxperslot_;
+  inf->keys_[ind]=key;
+  inf->owners_[ind]=NULL;
+  ++inf->nkeys_[slot];
+  if(!inf->coalesce_)return;
+  if(find(inf,key))return;                          // a line with the same key is already in flight and collects the waiters
+  struct inflightent_t*ent;
+  if((ent=inf->free_)!=NULL)inf->free_=ent->next_;
+  else ent=emalloc(sizeof(struct inflightent_t));
+  ent->key_=key;
+  if(len>ent->maxline_){                             // keep a copy of the line
+    free(ent->line_);                                // ...
+    ent->line_=emalloc(ent->maxline_=len);           // ...
+  }
+  memcpy(ent->line_,line,len);                       // ...
+  ent->nwaiters_=0;
+  inf->owners_[ind]=ent;
+  size_t b=key.hash_&(inf->nbuckets_-1);
+  ent->next_=inf->buckets_[b];
+  inf->buckets_[b]=ent;
+}
+// response for oldest line in flight on child process was read
+// (the entry owned by the line is removed from the index - its waiters get this response)
+struct inflightent_t*inflight_done(struct inflight_t*inf,size_t slot,struct linekey_t*key){
+  if(inf->nkeys_[slot]==0)app_message(FATAL,"response without a line in flight in inflight_done()");
+  size_t ind=slot*inf->maxperslot_+inf->front_[slot];
+  *key=inf->keys_[ind];
+  inf->front_[slot]=(inf->front_[slot]+1)%inf->maxperslot_;
+  --inf->nkeys_[slot];
+  struct inflightent_t*ent=inf->owners_[ind];
+  if(!ent)return NULL;                               // line does not own an index entry
+  struct inflightent_t**p=&inf->buckets_[ent->key_.hash_&(inf->nbuckets_-1)];
+  while(*p!=ent)p=&(*p)->next_;
+  *p=ent->next_;
+  return ent;
+}
+// release entry returned by 'inflight_done()'
+void inflight_release(struct inflight_t*inf,struct inflightent_t*ent){
+  ent->nwaiters_=0;
+  ent->next_=inf->free_;
+  inf->free_=ent;
+}
+
+// --- helpers ---
+
+// find line in flight
+static struct inflightent_t*find(struct inflight_t*inf,struct linekey_t key){
+  for(struct inflightent_t*ent=inf->buckets_[key.hash_&(inf->nbuckets_-1)];ent;ent=ent->next_){
+    if(linekey_eq(ent->key_,key))return ent;
+  }
+  return NULL;
+}
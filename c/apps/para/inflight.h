@@ -0,0 +1,54 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+
+// --- lines in flight to child processes ---
+// (lines are identified by a key: a 64 bit hash of the line seeded with a hash of the command line, verified by the length and an independent hash of the line)
+// (the keys of lines in flight are tracked per child process in the order lines were handed to it so a response can be associated with the key of its input line)
+// (when coalescing, an index of lines in flight lets a duplicate line wait for the response of the line in flight instead of occupying a child process)
+// (a line only waits if its bytes match a copy of the line in flight kept in the index - the key alone is not trusted)
+
+// key identifying a line
+// ('hash_' is used for indexing - two lines are the same line only if all fields match)
+struct linekey_t{
+  uint64_t hash_;                 // FNV-1a hash of line
+  uint64_t check_;                // hash of line independent of 'hash_'
+  size_t len_;                    // length of line
+};
+int linekey_eq(struct linekey_t k1,struct linekey_t k2);  // true if keys identify the same line
+
+// line in flight with line numbers waiting for its response
+struct inflightent_t{
+  struct linekey_t key_;          // key of line
+  char*line_;                     // copy of line
+  size_t maxline_;                // allocated size of 'line_'
+  int*waiters_;                   // line numbers of duplicate lines waiting for the response
+  size_t nwaiters_;               // #of waiting line numbers
+  size_t maxwaiters_;             // allocated size of 'waiters_'
+  struct inflightent_t*next_;     // next entry in bucket (or in free list)
+};
+struct inflight_t{
+  uint64_t seed_;                 // hash of command line
+  uint64_t checkseed_;            // independent hash of command line
+  size_t maxperslot_;             // max #of lines in flight per child process
+  struct linekey_t*keys_;         // keys of lines in flight (ring buffer for each child process)
+  struct inflightent_t**owners_;  // index entry owned by each line in flight (NULL if none - same ring buffers as 'keys_')
+  size_t*front_;                  // front of ring buffer for each child process
+  size_t*nkeys_;                  // #of lines in flight for each child process
+  int coalesce_;                  // if true, duplicate lines wait for the line in flight
+  struct inflightent_t**buckets_; // index of lines in flight (if coalescing)
+  size_t nbuckets_;               // #of buckets (power of 2)
+  struct inflightent_t*free_;     // free entries
+  int hasmemo_;                   // true if 'memolineno_' and 'memokey_' are valid
+  int memolineno_;                // line number of last line hashed (a line waiting for a child process is hashed only once)
+  struct linekey_t memokey_;      // key of last line hashed
+  size_t ncoalesced_;             // #of lines that waited for a duplicate line in flight
+};
+struct inflight_t*inflight_ctor(char const*cmdline,size_t nslots,size_t maxperslot,int coalesce); // constructor
+void inflight_dtor(struct inflight_t*inf);                                                    // destructor
+struct linekey_t inflight_key(struct inflight_t*inf,int lineno,char const*line,size_t len);   // key of a line
+int inflight_wait(struct inflight_t*inf,struct linekey_t key,int lineno,char const*line,size_t len); // if a duplicate of the line is in flight, wait for its response (returns true if line is waiting)
+void inflight_add(struct inflight_t*inf,size_t slot,struct linekey_t key,char const*line,size_t len); // line was handed to child process
+struct inflightent_t*inflight_done(struct inflight_t*inf,size_t slot,struct linekey_t*key);  // response for oldest line in flight on child process was read - returns entry with waiters (NULL if none)
+void inflight_release(struct inflight_t*inf,struct inflightent_t*ent);                       // release entry returned by 'inflight_done()'
@@ -3,6 +3,7 @@
 #include "combuf.h"
 #include "util.h"
 #include "error.h"
+#include "probe.h"
 
 // input queue constructor
 struct inq_t*inq_ctor(int startlineno){
@@ -33,6 +34,7 @@ struct combuf*inq_back(struct inq_t*q){
 // push a combuf on input queue (line number will be automatically set in combuf)
 void inq_push(struct inq_t*q,struct combuf*cb){
   combuf_setlineno(cb,q->nextlineno_++);
+  PARA_PROBE1(line__read,combuf_lineno(cb));
   if(q->front_==NULL){
     q->front_=q->back_=cb;
     cb->next_=NULL;
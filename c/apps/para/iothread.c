@@ -0,0 +1,247 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "iothread.h"
+#include "paraloop.h"
+#include "error.h"
+#include "combuf.h"
+#include "outq.h"
+#include "spscq.h"
+#include "gz.h"
+#include "txn.h"
+#include "stats.h"
+#include "sys.h"
+#include "util.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/select.h>
+
+// helper methods
+static void*reader_run(void*arg);                 // reader thread
+static void*writer_run(void*arg);                 // writer thread
+static void wakeifsleeping(int*sleeping,int fd);  // wake up a thread if it is sleeping
+static void sleepon(int fd);                      // sleep until woken up through wakeup pipe
+
+// --- reader thread ---
+
+// constructor
+struct reader_t*reader_ctor(FILE*fp,size_t maxlines,int mainwakefd,int*mainsleeping){
+  struct reader_t*ret=emalloc(sizeof(struct reader_t));
+  ret->fp_=fp;
+  ret->qlines_=spscq_ctor(maxlines);
+  ret->qfree_=spscq_ctor(maxlines);
+  ret->maxlines_=maxlines;
+  ret->nheld_=0;
+  ewakepipe(ret->wakefds_);
+  ret->sleeping_=0;
+  ret->mainwakefd_=mainwakefd;
+  ret->mainsleeping_=mainsleeping;
+  ret->eof_=0;
+  return ret;
+}
+// destructor
+// (combufs still held by reader are destroyed)
+void reader_dtor(struct reader_t*reader){
+  struct combuf*cb;
+  while((cb=spscq_pop(reader->qfree_))!=NULL)combuf_dtor(cb);
+  while((cb=spscq_pop(reader->qlines_))!=NULL)combuf_dtor(cb);
+  spscq_dtor(reader->qfree_);
+  spscq_dtor(reader->qlines_);
+  eclose(reader->wakefds_[0]);
+  eclose(reader->wakefds_[1]);
+  free(reader);
+}
+// start reader thread
+void reader_start(struct reader_t*reader){
+  int stat=createthread(&reader->thread_,reader_run,reader);
+  if(stat!=0)app_message(FATAL,"failed creating reader thread, errstr: %s",strerror(stat));
+}
+// wait for reader thread to terminate
+void reader_join(struct reader_t*reader){
+  int stat=pthread_join(reader->thread_,NULL);
+  if(stat!=0)app_message(FATAL,"failed joining reader thread, errstr: %s",strerror(stat));
+}
+// true if reader can take more free combufs
+int reader_wantfree(struct reader_t*reader){
+  return reader->nheld_<reader->maxlines_;
+}
+// hand a free combuf to reader
+void reader_putfree(struct reader_t*reader,struct combuf*cb){
+  if(!spscq_push(reader->qfree_,cb))app_message(FATAL,"free queue full in reader_putfree()");
+  ++reader->nheld_;
+}
+// wake up reader if it is waiting for free combufs
+void reader_kick(struct reader_t*reader){
+  wakeifsleeping(&reader->sleeping_,reader->wakefds_[1]);
+}
+// get a complete line
+struct combuf*reader_recv(struct reader_t*reader){
+  struct combuf*ret=spscq_pop(reader->qlines_);
+  if(ret)--reader->nheld_;
+  return ret;
+}
+// true if a line is available or reader reached eof
+int reader_ready(struct reader_t*reader){
+  return __atomic_load_n(&reader->eof_,__ATOMIC_ACQUIRE)||!spscq_empty(reader->qlines_);
+}
+// true if reader reached eof and all lines have been received
+// (eof is set after the last line was queued so we must check eof before checking the queue)
+int reader_done(struct reader_t*reader){
+  int eof=__atomic_load_n(&reader->eof_,__ATOMIC_ACQUIRE);
+  return eof&&spscq_empty(reader->qlines_);
+}
+// reader thread
+// (reads one complete line into each free combuf handed to us by the main thread)
+static void*reader_run(void*arg){
+  struct reader_t*reader=arg;
+  while(1){
+    struct combuf*cb=spscq_pop(reader->qfree_);                // get a free combuf
+    if(!cb){                                                   // none available - sleep until main thread hands us one
+      __atomic_store_n(&reader->sleeping_,1,__ATOMIC_SEQ_CST); // tell main thread we are going to sleep
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);                 // ...
+      if(spscq_empty(reader->qfree_))sleepon(reader->wakefds_[0]);
+      __atomic_store_n(&reader->sleeping_,0,__ATOMIC_SEQ_CST); // ...
+      continue;
+    }
+    combuf_init(cb,reader->fp_,0,CBREAD);                      // read a complete line (input is blocking)
+    combuf_clear4rd(cb);                                       // ...
+    while(!combuf_eof(cb)&&!combuf_rdcomplete(cb))combuf_read(cb,1);
+    int eof=combuf_eof(cb);                                    // ...
+    if(combuf_empty(cb))combuf_dtor(cb);                       // nothing read at eof
+    else spscq_push(reader->qlines_,cb);                       // hand line to main thread (never full since we hold at most 'maxlines' combufs)
+    if(eof)__atomic_store_n(&reader->eof_,1,__ATOMIC_RELEASE); // tell main thread there are no more lines
+    wakeifsleeping(reader->mainsleeping_,reader->mainwakefd_); // ...
+    if(eof)break;                                              // ...
+  }
+  return NULL;
+}
+
+// --- writer thread ---
+
+// constructor
+struct writer_t*writer_ctor(int fd,int issock,int startlineno,size_t maxlines,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats,int mainwakefd,int*mainsleeping){
+  struct writer_t*ret=emalloc(sizeof(struct writer_t));
+  ret->fd_=fd;
+  ret->issock_=issock;
+  ret->qout_=outq_ctor(maxlines,0,startlineno);
+  ret->cbpool_=combufpool_ctor(0,CBWRITE,0);
+  ret->qlines_=spscq_ctor(maxlines);
+  ret->qdone_=spscq_ctor(maxlines);
+  ret->maxlines_=maxlines;
+  ret->nheld_=0;
+  ret->txncommitnlines_=txncommitnlines;
+  ret->txn_=txn;
+  ret->lasttxnlog_=lasttxnlog;
+  ret->nexttxnlog_=nexttxnlog;
+  ret->gzout_=gzout;
+  ret->stats_=stats;
+  ewakepipe(ret->wakefds_);
+  ret->sleeping_=0;
+  ret->mainwakefd_=mainwakefd;
+  ret->mainsleeping_=mainsleeping;
+  ret->done_=0;
+  return ret;
+}
+// destructor
+void writer_dtor(struct writer_t*writer){
+  struct combuf*cb;
+  while((cb=spscq_pop(writer->qdone_))!=NULL)combuf_dtor(cb);
+  spscq_dtor(writer->qlines_);
+  spscq_dtor(writer->qdone_);
+  combufpool_dtor(writer->cbpool_);
+  outq_dtor(writer->qout_);
+  if(writer->gzout_)gzout_dtor(writer->gzout_);
+  eclose(writer->wakefds_[0]);
+  eclose(writer->wakefds_[1]);
+  free(writer);
+}
+// start writer thread
+void writer_start(struct writer_t*writer){
+  int stat=createthread(&writer->thread_,writer_run,writer);
+  if(stat!=0)app_message(FATAL,"failed creating writer thread, errstr: %s",strerror(stat));
+}
+// tell writer no more lines are coming and wait for it to write all lines
+void writer_stop(struct writer_t*writer){
+  __atomic_store_n(&writer->done_,1,__ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  ewakeup(writer->wakefds_[1]);
+  int stat=pthread_join(writer->thread_,NULL);
+  if(stat!=0)app_message(FATAL,"failed joining writer thread, errstr: %s",strerror(stat));
+}
+// true if writer can take more lines (or has combufs to hand back)
+int writer_room(struct writer_t*writer){
+  return writer->nheld_<writer->maxlines_||!spscq_empty(writer->qdone_);
+}
+// hand next line to writer
+int writer_cansend(struct writer_t*writer){
+  return writer->nheld_<writer->maxlines_;
+}
+// hand next line to writer
+void writer_send(struct writer_t*writer,struct combuf*cb){
+  if(!writer_cansend(writer)||!spscq_push(writer->qlines_,cb))app_message(FATAL,"attempt to hand line to full writer in writer_send()");
+  ++writer->nheld_;
+}
+// wake up writer if it is waiting for lines
+void writer_kick(struct writer_t*writer){
+  wakeifsleeping(&writer->sleeping_,writer->wakefds_[1]);
+}
+// get back a written combuf
+struct combuf*writer_recv(struct writer_t*writer){
+  struct combuf*ret=spscq_pop(writer->qdone_);
+  if(ret)--writer->nheld_;
+  return ret;
+}
+// writer thread
+// (lines are written with 'flushoutq()' on a blocking fd so transactions are handled exactly as in the main thread)
+static void*writer_run(void*arg){
+  struct writer_t*writer=arg;
+  while(1){
+    int done=__atomic_load_n(&writer->done_,__ATOMIC_ACQUIRE); // check done before looking for lines
+    size_t n=0;                                                // move lines to our output queue
+    struct combuf*cb;                                          // ...
+    while((cb=spscq_pop(writer->qlines_))!=NULL){              // ...
+      outq_push(writer->qout_,cb);                             // ...
+      ++n;                                                     // ...
+    }
+    if(n==0){                                                  // no lines
+      if(done){                                                // ... and no more lines are coming
+        if(writer->gzout_){                                    // end last gzip member before main thread does final commit
+          size_t startpos=gzout_pos(writer->gzout_);           // ...
+          writer->nexttxnlog_->outfilepos_=gzout_endmember(writer->gzout_);
+          writer->stats_->noutbytes_+=gzout_pos(writer->gzout_)-startpos;
+        }
+        break;
+      }
+      __atomic_store_n(&writer->sleeping_,1,__ATOMIC_SEQ_CST); // sleep until main thread hands us lines
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);                 // ...
+      if(spscq_empty(writer->qlines_)&&!__atomic_load_n(&writer->done_,__ATOMIC_ACQUIRE))sleepon(writer->wakefds_[0]);
+      __atomic_store_n(&writer->sleeping_,0,__ATOMIC_SEQ_CST); // ...
+      continue;
+    }
+    if(flushoutq(writer->qout_,writer->fd_,writer->issock_,writer->cbpool_,writer->txncommitnlines_,writer->txn_,writer->lasttxnlog_,writer->nexttxnlog_,writer->gzout_,writer->stats_,NULL)){
+      app_message(FATAL,"output connection closed by peer");
+    }
+    while(!combufpool_empty(writer->cbpool_)){                 // hand written combufs back to main thread
+      spscq_push(writer->qdone_,combufpool_get(writer->cbpool_,NULL,CBWRITE));
+    }
+    wakeifsleeping(writer->mainsleeping_,writer->mainwakefd_); // ...
+  }
+  return NULL;
+}
+
+// --- helpers ---
+
+// wake up a thread if it is sleeping (or about to sleep)
+// (the fence orders our earlier queue operations before reading the sleeping flag - the sleeping thread does the opposite)
+static void wakeifsleeping(int*sleeping,int fd){
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(sleeping,__ATOMIC_SEQ_CST))ewakeup(fd);
+}
+// sleep until woken up through wakeup pipe
+static void sleepon(int fd){
+  fd_set rdset;
+  FD_ZERO(&rdset);
+  FD_SET(fd,&rdset);
+  if(select(fd+1,&rdset,NULL,NULL,NULL)<0&&errno!=EINTR){
+    app_message(FATAL,"select() failed on wakeup pipe, errno: %d, errstr: %s",errno,strerror(errno));
+  }
+  edrain(fd);
+}
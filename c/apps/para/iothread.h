@@ -0,0 +1,80 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// --- dedicated reader and writer threads ---
+// (the reader thread reads lines from input and the writer thread writes ordered output)
+// (both are connected to the main thread through lock free queues of combuf pointers so a slow sink or a bursty source does not stall the main thread)
+// (a thread only wakes up another thread through a pipe if the other thread is sleeping, or about to sleep, in select())
+
+// forward decl
+struct combuf;
+struct combufpool;
+struct outq_t;
+struct spscq;
+struct txn_t;
+struct txnlog_t;
+struct gzout_t;
+struct stats_t;
+
+// --- reader thread ---
+
+struct reader_t{
+  pthread_t thread_;                  // reader thread
+  FILE*fp_;                           // input (blocking)
+  struct spscq*qlines_;               // complete lines: reader --> main thread
+  struct spscq*qfree_;                // free combufs: main thread --> reader
+  size_t maxlines_;                   // max #of combufs held by reader
+  size_t nheld_;                      // #of combufs held by reader (main thread only)
+  int wakefds_[2];                    // pipe used by main thread to wake up reader
+  int sleeping_;                      // reader is waiting for free combufs
+  int mainwakefd_;                    // write end of pipe used to wake up main thread
+  int*mainsleeping_;                  // main thread is sleeping in select()
+  int eof_;                           // set by reader once all lines have been handed to main thread
+};
+struct reader_t*reader_ctor(FILE*fp,size_t maxlines,int mainwakefd,int*mainsleeping);  // constructor
+void reader_dtor(struct reader_t*reader);                                              // destructor
+void reader_start(struct reader_t*reader);                                             // start reader thread
+void reader_join(struct reader_t*reader);                                              // wait for reader thread to terminate (after eof)
+int reader_wantfree(struct reader_t*reader);                                           // true if reader can take more free combufs
+void reader_putfree(struct reader_t*reader,struct combuf*cb);                          // hand a free combuf to reader
+void reader_kick(struct reader_t*reader);                                              // wake up reader if it is waiting for free combufs
+struct combuf*reader_recv(struct reader_t*reader);                                     // get a complete line (NULL if no line is available)
+int reader_ready(struct reader_t*reader);                                              // true if a line is available or reader reached eof
+int reader_done(struct reader_t*reader);                                               // true if reader reached eof and all lines have been received
+
+// --- writer thread ---
+
+struct writer_t{
+  pthread_t thread_;                  // writer thread
+  int fd_;                            // output (blocking)
+  int issock_;                        // true if output is a socket
+  struct outq_t*qout_;                // output queue owned by writer (lines arrive in line number order)
+  struct combufpool*cbpool_;          // written combufs not yet handed back to main thread
+  struct spscq*qlines_;               // lines in line number order: main thread --> writer
+  struct spscq*qdone_;                // written combufs: writer --> main thread
+  size_t maxlines_;                   // max #of combufs held by writer
+  size_t nheld_;                      // #of combufs held by writer (main thread only)
+  size_t txncommitnlines_;            // commit every 'txncommitnlines' - if 0, no commits are executed
+  struct txn_t*txn_;                  // transaction (NULL if not in transactional mode)
+  struct txnlog_t*lasttxnlog_;        // last committed position
+  struct txnlog_t*nexttxnlog_;        // current position
+  struct gzout_t*gzout_;              // if not NULL, output is gzip compressed (owned by writer)
+  struct stats_t*stats_;              // output statistics
+  int wakefds_[2];                    // pipe used by main thread to wake up writer
+  int sleeping_;                      // writer is waiting for lines
+  int mainwakefd_;                    // write end of pipe used to wake up main thread
+  int*mainsleeping_;                  // main thread is sleeping in select()
+  int done_;                          // set by main thread when no more lines will be handed to writer
+};
+struct writer_t*writer_ctor(int fd,int issock,int startlineno,size_t maxlines,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats,int mainwakefd,int*mainsleeping); // constructor
+void writer_dtor(struct writer_t*writer);                                              // destructor
+void writer_start(struct writer_t*writer);                                             // start writer thread
+void writer_stop(struct writer_t*writer);                                              // tell writer no more lines are coming and wait for it to write all lines
+int writer_room(struct writer_t*writer);                                               // true if writer can take more lines (or has combufs to hand back)
+int writer_cansend(struct writer_t*writer);                                            // true if writer can take another line
+void writer_send(struct writer_t*writer,struct combuf*cb);                             // hand next line to writer (fatal if writer cannot take more lines)
+void writer_kick(struct writer_t*writer);                                              // wake up writer if it is waiting for lines
+struct combuf*writer_recv(struct writer_t*writer);                                     // get back a written combuf (NULL if none available)
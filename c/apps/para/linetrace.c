@@ -0,0 +1,127 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "linetrace.h"
+#include "error.h"
+#include "sys.h"
+#include "util.h"
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+
+// #of traced lines that can be in flight at the same time
+#define LINETRACE_MAXENTS 4096
+
+// forward decl
+static struct linetraceent_t*findent(struct linetrace_t*lt,int lineno);
+static void emit(struct linetrace_t*lt,char const*fmt,...);
+static void emitasync(struct linetrace_t*lt,char const*name,int lineno,double tstart,double tend);
+
+// constructor
+struct linetrace_t*linetrace_ctor(char const*file,int sample,int startlineno,size_t nslots){
+  struct linetrace_t*ret=emalloc(sizeof(struct linetrace_t));
+  ret->fp_=fopen(file,"wb");
+  if(!ret->fp_)app_message(FATAL,"failed opening line trace file: %s for writing, errno: %d, err: %s",file,errno,strerror(errno));
+  setfdcloexec(fileno(ret->fp_));
+  ret->sample_=sample;
+  ret->nextlineno_=startlineno;
+  ret->nents_=LINETRACE_MAXENTS;
+  ret->ents_=emalloc(ret->nents_*sizeof(struct linetraceent_t));
+  for(size_t i=0;i<ret->nents_;++i)ret->ents_[i].lineno_=-1;
+  ret->start_=nowusec();
+  fprintf(ret->fp_,"[\n");
+  emit(ret,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"para\"}}");
+  for(size_t i=0;i<nslots;++i){                                // one track per child process
+    emit(ret,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"child process %lu\"}}",i+1,i);
+  }
+  return ret;
+}
+// destructor
+void linetrace_dtor(struct linetrace_t*lt){
+  fprintf(lt->fp_,"\n]\n");
+  efpclose(lt->fp_);
+  free(lt->ents_);
+  free(lt);
+}
+// lines with line numbers up to 'nextlineno' have been read
+// (start tracing the sampled ones)
+void linetrace_read(struct linetrace_t*lt,int nextlineno){
+  if(nextlineno<=lt->nextlineno_)return;
+  double now=nowusec()-lt->start_;
+  int lineno=(lt->nextlineno_+lt->sample_-1)/lt->sample_*lt->sample_; // first sampled line number
+  for(;lineno<nextlineno;lineno+=lt->sample_){
+    struct linetraceent_t*ent=&lt->ents_[(lineno/lt->sample_)%lt->nents_];
+    ent->lineno_=lineno;
+    ent->slot_=-1;
+    ent->tread_=now;
+    ent->tsend_=ent->twritten_=ent->tresp_=ent->tflush_=-1;
+  }
+  lt->nextlineno_=nextlineno;
+}
+// line is being written to child process
+void linetrace_sending(struct linetrace_t*lt,size_t slot,int lineno){
+  struct linetraceent_t*ent=findent(lt,lineno);
+  if(!ent||ent->slot_>=0)return;
+  ent->slot_=slot;
+  ent->tsend_=nowusec()-lt->start_;
+}
+// line was completely written to child process
+void linetrace_written(struct linetrace_t*lt,int lineno){
+  struct linetraceent_t*ent=findent(lt,lineno);
+  if(ent)ent->twritten_=nowusec()-lt->start_;
+}
+// response was read from child process
+void linetrace_response(struct linetrace_t*lt,int lineno){
+  struct linetraceent_t*ent=findent(lt,lineno);
+  if(ent)ent->tresp_=nowusec()-lt->start_;
+}
+// line is in write list of output queue
+void linetrace_flushing(struct linetrace_t*lt,int lineno){
+  struct linetraceent_t*ent=findent(lt,lineno);
+  if(ent&&ent->tflush_<0)ent->tflush_=nowusec()-lt->start_;
+}
+// line was completely written to output
+// (write all events for the line and release its entry)
+void linetrace_output(struct linetrace_t*lt,int lineno){
+  struct linetraceent_t*ent=findent(lt,lineno);
+  if(!ent)return;
+  double tout=nowusec()-lt->start_;
+  if(ent->tflush_<0)ent->tflush_=tout;
+  char name[32];
+  snprintf(name,sizeof name,"line %d",lineno);
+  emit(lt,"{\"name\":\"%s\",\"cat\":\"line\",\"ph\":\"b\",\"id\":%d,\"pid\":1,\"tid\":0,\"ts\":%.0f}",name,lineno,ent->tread_);
+  if(ent->slot_>=0&&ent->tresp_>=0){                            // line went through a child process
+    emitasync(lt,"inq",lineno,ent->tread_,ent->tsend_);
+    emitasync(lt,"child",lineno,ent->tsend_,ent->tresp_);
+    emitasync(lt,"outq",lineno,ent->tresp_,ent->tflush_);
+    double twritten=ent->twritten_>=0?ent->twritten_:ent->tresp_;
+    emit(lt,"{\"name\":\"write\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f,\"args\":{\"line\":%d}}",ent->slot_+1,ent->tsend_,twritten-ent->tsend_,lineno);
+    emit(lt,"{\"name\":\"wait\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f,\"args\":{\"line\":%d}}",ent->slot_+1,twritten,ent->tresp_-twritten,lineno);
+  }else{                                                        // line went straight to output queue
+    emitasync(lt,"queued",lineno,ent->tread_,ent->tflush_);
+  }
+  emitasync(lt,"flush",lineno,ent->tflush_,tout);
+  emit(lt,"{\"name\":\"%s\",\"cat\":\"line\",\"ph\":\"e\",\"id\":%d,\"pid\":1,\"tid\":0,\"ts\":%.0f}",name,lineno,tout);
+  ent->lineno_=-1;
+  ++lt->ntraced_;
+}
+
+// --- helpers ---
+
+// find entry for a traced line (NULL if line is not traced)
+static struct linetraceent_t*findent(struct linetrace_t*lt,int lineno){
+  if(lineno%lt->sample_)return NULL;
+  struct linetraceent_t*ent=&lt->ents_[(lineno/lt->sample_)%lt->nents_];
+  return ent->lineno_==lineno?ent:NULL;
+}
+// write an event to trace file
+static void emit(struct linetrace_t*lt,char const*fmt,...){
+  if(lt->nevents_++)fprintf(lt->fp_,",\n");
+  va_list ap;
+  va_start(ap,fmt);
+  vfprintf(lt->fp_,fmt,ap);
+  va_end(ap);
+}
+// write a nested async slice for a line
+static void emitasync(struct linetrace_t*lt,char const*name,int lineno,double tstart,double tend){
+  emit(lt,"{\"name\":\"%s\",\"cat\":\"line\",\"ph\":\"b\",\"id\":%d,\"pid\":1,\"tid\":0,\"ts\":%.0f}",name,lineno,tstart);
+  emit(lt,"{\"name\":\"%s\",\"cat\":\"line\",\"ph\":\"e\",\"id\":%d,\"pid\":1,\"tid\":0,\"ts\":%.0f}",name,lineno,tend);
+}
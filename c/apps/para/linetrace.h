@@ -0,0 +1,45 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+// --- tracing the life cycle of sampled lines ---
+// (every Nth line is timestamped when it is read, when it starts being written to a child process, when it is completely written,
+//  when the response is read, when it is moved to the write list of the output queue and when it is completely written to output)
+// (the trace file is in Chrome trace event format (JSON) and can be loaded into Perfetto or chrome://tracing)
+//
+// tracks in the trace:
+//   child process K   one slice per traced line: 'write' (writing line to child process) followed by 'wait' (waiting for response)
+//   lines             one async slice per traced line split into 'inq' (queued in input), 'child' (at child process), 'outq' (waiting
+//                     in output queue behind lines with lower line numbers) and 'flush' (being written to output)
+// (lines not sent to a child process - not selected, cached or coalesced - have a single 'queued' slice instead of 'inq', 'child' and 'outq')
+// (when output is written by a writer thread ('-a') a line is flushed when it is handed to the writer thread)
+
+// life cycle of a traced line (times in micro seconds since trace started, -1: not reached)
+struct linetraceent_t{
+  int lineno_;                    // line number (-1: entry not in use)
+  int slot_;                      // child process handling line (-1: not sent to a child process)
+  double tread_;                  // line read from input
+  double tsend_;                  // first write of line to child process
+  double twritten_;               // line completely written to child process
+  double tresp_;                  // response read from child process
+  double tflush_;                 // line moved to write list of output queue
+};
+struct linetrace_t{
+  FILE*fp_;                       // trace file
+  int sample_;                    // trace every 'sample_' line
+  int nextlineno_;                // next line number not yet seen in input queue
+  struct linetraceent_t*ents_;    // traced lines in flight indexed by (lineno/sample_)%nents_ (oldest entry is overwritten if full)
+  size_t nents_;                  // ...
+  double start_;                  // time trace started (absolute micro seconds)
+  int nevents_;                   // #of events written (to separate events with commas)
+  size_t ntraced_;                // #of lines completely traced
+};
+struct linetrace_t*linetrace_ctor(char const*file,int sample,int startlineno,size_t nslots); // constructor
+void linetrace_dtor(struct linetrace_t*lt);                                                  // destructor (terminates and closes trace file)
+void linetrace_read(struct linetrace_t*lt,int nextlineno);                                   // lines with line numbers up to 'nextlineno' have been read
+void linetrace_sending(struct linetrace_t*lt,size_t slot,int lineno);                       // line is being written to child process (only the first call for a line counts)
+void linetrace_written(struct linetrace_t*lt,int lineno);                                   // line was completely written to child process
+void linetrace_response(struct linetrace_t*lt,int lineno);                                  // response was read from child process
+void linetrace_flushing(struct linetrace_t*lt,int lineno);                                  // line is in write list of output queue (only the first call for a line counts)
+void linetrace_output(struct linetrace_t*lt,int lineno);                                    // line was completely written to output - its life cycle is written to trace file
@@ -18,6 +18,9 @@ struct outq_t*outq_ctor(size_t maxel,size_t inc,int startlineno){
   struct outq_t*ret=emalloc(sizeof(struct outq_t));
   ret->nextlineno_=startlineno;
   ret->pq_=priq_ctor(maxel,inc,combufcmp);
+  ret->nwr_=0;
+  ret->wrfront_=NULL;
+  ret->wrback_=NULL;
   return ret;
 }
 // output queue destructor
@@ -28,6 +31,11 @@ void outq_dtor(struct outq_t*q){
     priq_pop(pq);
     combuf_dtor(cb);
   }
+  while(outq_wrsize(q)){
+    struct combuf*cb=outq_wrfront(q);
+    outq_wrpop(q);
+    combuf_dtor(cb);
+  }
   priq_dtor(pq);
   free(q);
 }
@@ -47,15 +55,47 @@ void outq_pop(struct outq_t*q){
   ++q->nextlineno_;
 }
 // true if top element on queue is ready (has correct line number) to be written
-int outq_ready(struct outq_t*q){
+static int outq_topready(struct outq_t*q){
   struct combuf*cb=outq_front(q);
   if(!cb)return 0;
-
-// NOTE!
-//fprintf(stderr,"==== combuf_lineno(cb): %d, q->nextlineno_: %d\n",combuf_lineno(cb), q->nextlineno_);
   return combuf_lineno(cb)==q->nextlineno_;
 }
-// size of q
+// true if write list is non-empty or top element on queue is ready (has correct line number) to be written
+int outq_ready(struct outq_t*q){
+  return q->nwr_>0||outq_topready(q);
+}
+// size of q (including write list)
 size_t outq_size(struct outq_t*q){
-  return priq_size(q->pq_);
+  return priq_size(q->pq_)+q->nwr_;
+}
+// move ready combufs to write list until write list has 'maxel' elements
+// (combufs are appended in line number order)
+size_t outq_fillwr(struct outq_t*q,size_t maxel){
+  while(q->nwr_<maxel&&outq_topready(q)){
+    struct combuf*cb=outq_front(q);
+    outq_pop(q);
+    cb->next_=NULL;
+    if(q->wrback_)q->wrback_->next_=cb;
+    else q->wrfront_=cb;
+    q->wrback_=cb;
+    ++q->nwr_;
+  }
+  return q->nwr_;
+}
+// get front of write list (might be NULL)
+struct combuf*outq_wrfront(struct outq_t*q){
+  return q->wrfront_;
+}
+// pop front of write list (fatal if list is empty)
+void outq_wrpop(struct outq_t*q){
+  if(q->wrfront_==NULL)app_message(FATAL,"attempt to pop empty write list in outq_wrpop()");
+  struct combuf*cb=q->wrfront_;
+  q->wrfront_=cb->next_;
+  if(q->wrback_==cb)q->wrback_=NULL;
+  cb->next_=NULL;
+  --q->nwr_;
+}
+// #of elements in write list
+size_t outq_wrsize(struct outq_t*q){
+  return q->nwr_;
 }
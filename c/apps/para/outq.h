@@ -5,11 +5,16 @@
 
 // --- type used for output queue ---
 // (wrapper around 'priq')
+// (combufs ready for output are moved in line number order from the priority queue to a FIFO write list)
+// (the write list is flushed in batches - a combuf stays in the write list until it has been completely written)
 
 // output queue struct
 struct outq_t{
   int nextlineno_;                                               // next line number to output
   struct priq*pq_;                                               // priority queue
+  size_t nwr_;                                                   // #of elements in write list
+  struct combuf*wrfront_;                                        // front of write list (next combuf to write)
+  struct combuf*wrback_;                                         // back of write list
 };
 
 // basic methods
@@ -18,5 +23,11 @@ void outq_dtor(struct outq_t*q);                                 // output queue
 struct combuf*outq_front(struct outq_t*q);                       // get next combuf for output
 void outq_push(struct outq_t*q,struct combuf*cb);                // push a combuf on queue
 void outq_pop(struct outq_t*q);                                  // pop queue
-int outq_ready(struct outq_t*q);                                 // true if top element on queue is ready (has correct line number) to be written
-size_t outq_size(struct outq_t*q);                               // size of q
+int outq_ready(struct outq_t*q);                                 // true if write list is non-empty or top element on queue is ready (has correct line number) to be written
+size_t outq_size(struct outq_t*q);                               // size of q (including write list)
+
+// write list methods
+size_t outq_fillwr(struct outq_t*q,size_t maxel);                // move ready combufs to write list until write list has 'maxel' elements (returns size of write list)
+struct combuf*outq_wrfront(struct outq_t*q);                     // get front of write list (might be NULL)
+void outq_wrpop(struct outq_t*q);                                // pop front of write list (fatal if list is empty)
+size_t outq_wrsize(struct outq_t*q);                             // #of elements in write list
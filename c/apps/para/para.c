@@ -19,10 +19,6 @@
   - add dump of stats at end of processing
     (internal details, stats about #of lines, timings etc.)
 
-  - support input/output as tcp connectios
-
-  - support 'child process' being a tcp service
-
 */
 
 #include "version.h"
@@ -30,11 +26,18 @@
 #include "error.h"
 #include "util.h"
 #include "sys.h"
+#include "server.h"
+#include "gz.h"
+#include "rec.h"
+#include "sel.h"
+#include "replay.h"
+#include "cpuaff.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <string.h>
 
 // max #of cmd line parameters to child process
 #define ARG_MAX 1024
@@ -44,7 +47,45 @@ static int print=0;                                // print cmd line parameters
 static int verbose=0;                              // verbose level (maximum debug level on)
 static int version=0;                              // print version number and exit (default false)
 static int printrecoveryinfo=0;                    // print recovery info
+static int printstats=0;                           // print statistics at end of processing
 static size_t maxclients=1;                        // #of child processes
+static size_t nthreads=1;                          // #of event loop threads driving child processes
+static int iothreads=0;                            // read input and write output on dedicated threads
+static int gzinput=0;                              // decompress input (gzip compressed input files are detected automatically)
+static int gzoutlevel=0;                           // if > 0, gzip compress output with this compression level
+static char*dispatchname="first";                  // policy choosing which idle child process gets the next line
+static enum dispatchpolicy_t dispatchpolicy=DISPATCH_FIRST;// ...
+static size_t maxbatch=1;                          // max #of lines handed to a child process in one dispatch
+static size_t batchms=5;                           // target response time in milliseconds for a batch (0: fixed batch size)
+static size_t cachemb=0;                           // max size in MB of cache of responses for repeated input lines (0: no cache)
+static char*cachefile=NULL;                        // cached responses are loaded from and appended to this file
+static int coalesce=0;                             // duplicates of a line in flight wait for its response
+static char*recfmt=NULL;                           // record framing of input (NULL: LF terminated lines)
+static char*childrecfmt=NULL;                      // record framing of responses from child processes (NULL: same as input)
+static size_t selfirst=0;                          // first line number to process (0: not set)
+static size_t selcount=0;                          // #of lines to process (0: all)
+static size_t selevery=0;                          // process only every Nth line (0: not set)
+static char*selmatch=NULL;                         // process only lines matching regular expression
+static char*selmatchlineno=NULL;                   // process only line numbers matching regular expression
+static int seldrop=0;                              // drop lines not processed instead of passing them unchanged to output
+static size_t keyfield=0;                          // route lines to child processes by key in this field (0: not set)
+static char keydelim='\t';                         // field delimiter for '--key-field'
+static char*keyregex=NULL;                         // route lines to child processes by key matching this regular expression
+static size_t keyqueue=16;                         // max #of lines queued per child process when routing by key
+static size_t projfield=0;                         // send only this field to child processes and splice responses back into lines (0: not set)
+static char projdelim='\t';                        // field delimiter for '--field'
+static char*recordfile=NULL;                       // record responses from child processes and their timing in this trace file
+static char*replayfile=NULL;                       // replace child processes by simulated child processes answering from this trace file
+static double replayscale=1;                       // recorded times are multiplied by this factor when replaying (0: respond immediately)
+static char*linetracefile=NULL;                    // write life cycle of sampled lines to this trace file (Chrome trace event format)
+static size_t linetracesample=1000;                // trace every Nth line
+static int profile=0;                              // account time spent in each phase of the main loop
+static int cpuloop=-1;                             // pin main loop to this CPU (-1: not set)
+static char*cpuchildren=NULL;                      // pin child processes to CPUs in this list in turn
+static int numachildren=0;                         // pin child processes to NUMA nodes in turn
+static int zygote=0;                               // spawn 'cmd' once as a zygote forking the child processes
+static int lazy=0;                                 // spawn child processes on demand instead of at startup
+static size_t idleretire=0;                        // retire child processes idle for this many seconds (0: never)
 static size_t clientsec=5;                         // client tmo in seconds
 static size_t heartsec=5;                          // heart beat timer sec
 static size_t maxoutq=1000;                        // max size of output priority queue (a child process might be slow blocking output) 
@@ -52,6 +93,9 @@ static size_t incoutq=1000;                        // increment when extending o
 static size_t maxbuf=4096;                         // max length of a line in bytes
 static int startlineno=0;                          // line number for first line
 static char*cmd=NULL;                              // command to execute in child processes
+static char*svcaddr=NULL;                          // network address of service to connect to instead of spawning child processes
+static char*servesock=NULL;                        // run as a server listening for jobs on this unix socket
+static char*clientsock=NULL;                       // submit job to server listening on this unix socket
 static char*inputfile=NULL;                        // inputfile, if NULL the <stdin>
 static char*outputfile=NULL;                       // outputfile, if NULL the <stdout>
 static size_t txncommitnlines=0;                   // commit every 'txncommitnlines' - if 0, no commits are executed
@@ -62,10 +106,51 @@ static char*txnlog=".para.txnlog";                 // default name of transactio
 static size_t txnenabled=0;                        // transactional mode enabled
 static size_t recoveryenabled=0;                   // recovery mode enabled
 
+// long options (long only options have values outside the range of characters)
+enum{OPT_SERVE=256,OPT_CLIENT,OPT_DISPATCH,OPT_CACHE,OPT_CACHEFILE,OPT_COALESCE,OPT_RECORD,OPT_CHILDRECORD,OPT_FIRST,OPT_COUNT,OPT_EVERY,OPT_MATCH,OPT_MATCHLINENO,OPT_DROP,OPT_KEYFIELD,OPT_KEYDELIM,OPT_KEYREGEX,OPT_KEYQUEUE,OPT_FIELD,OPT_DELIM,OPT_RECORDCHILDREN,OPT_REPLAYCHILDREN,OPT_REPLAYSCALE,OPT_TRACELINES,OPT_TRACESAMPLE,OPT_PROFILE,OPT_CPULOOP,OPT_CPUCHILDREN,OPT_NUMACHILDREN,OPT_ZYGOTE,OPT_LAZY,OPT_IDLERETIRE};
+static struct option longopts[]={
+  {"serve",required_argument,NULL,OPT_SERVE},
+  {"client",required_argument,NULL,OPT_CLIENT},
+  {"dispatch",required_argument,NULL,OPT_DISPATCH},
+  {"cache",required_argument,NULL,OPT_CACHE},
+  {"cache-file",required_argument,NULL,OPT_CACHEFILE},
+  {"coalesce",no_argument,NULL,OPT_COALESCE},
+  {"record",required_argument,NULL,OPT_RECORD},
+  {"child-record",required_argument,NULL,OPT_CHILDRECORD},
+  {"first",required_argument,NULL,OPT_FIRST},
+  {"count",required_argument,NULL,OPT_COUNT},
+  {"every",required_argument,NULL,OPT_EVERY},
+  {"match",required_argument,NULL,OPT_MATCH},
+  {"match-lineno",required_argument,NULL,OPT_MATCHLINENO},
+  {"drop",no_argument,NULL,OPT_DROP},
+  {"key-field",required_argument,NULL,OPT_KEYFIELD},
+  {"key-delim",required_argument,NULL,OPT_KEYDELIM},
+  {"key-regex",required_argument,NULL,OPT_KEYREGEX},
+  {"key-queue",required_argument,NULL,OPT_KEYQUEUE},
+  {"field",required_argument,NULL,OPT_FIELD},
+  {"delim",required_argument,NULL,OPT_DELIM},
+  {"record-children",required_argument,NULL,OPT_RECORDCHILDREN},
+  {"replay-children",required_argument,NULL,OPT_REPLAYCHILDREN},
+  {"replay-scale",required_argument,NULL,OPT_REPLAYSCALE},
+  {"trace-lines",required_argument,NULL,OPT_TRACELINES},
+  {"trace-sample",required_argument,NULL,OPT_TRACESAMPLE},
+  {"profile",no_argument,NULL,OPT_PROFILE},
+  {"cpu-loop",required_argument,NULL,OPT_CPULOOP},
+  {"cpu-children",required_argument,NULL,OPT_CPUCHILDREN},
+  {"numa-children",no_argument,NULL,OPT_NUMACHILDREN},
+  {"zygote",no_argument,NULL,OPT_ZYGOTE},
+  {"lazy",no_argument,NULL,OPT_LAZY},
+  {"idle-retire",required_argument,NULL,OPT_IDLERETIRE},
+  {NULL,0,NULL,0}
+};
+
 // usage strings
 static char*strusage[]={
   "Usage:",
   "  para [options] -- maxclients cmd cmdargs ...",
+  "  para [options] -S address -- maxclients",
+  "  para [options] --serve socket -- maxclients cmd cmdargs ...",
+  "  para [options] --client socket",
   "",
   "options:",
   "  -h          help and exit (default: not set)",
@@ -73,17 +158,57 @@ static char*strusage[]={
   "  -v          verbose mode (maximum debug level, default: not set)",
   "  -V          print version number (optional, default: not set)",
   "  -r          print recovery info - if any - and exit",
+  "  -s          print statistics at end of processing (default: not set)",
+  "  -a          read input and write output on dedicated threads (default: not set)",
+  "  -z          decompress gzip compressed input on a separate thread, compressed input files are detected without this option (default: not set)",
   "  -R          execute in recovery mode (default: no recovery is performed , optional)",
   "  -b arg      maximum length in bytes of a line (optional, default: 4096)",
   "  -T arg      timeout in seconds waiting for response from a sub-process (default 5)",
   "  -H arg      heartbeat in seconds (optional, default: 5)",
   "  -m arg      #of child processes to spawn (optional if specified as a positional parameter, default: 1)",
+  "  -Z arg      gzip compress output on the writer thread with compression level 1-9, implies '-a' (default: not set)",
+  "  -B arg      max #of lines handed to a child process in one dispatch, the batch size adapts to the target set with '-L' (default: 1)",
+  "  -L arg      target response time in milliseconds for a batch, 0 sends batches of exactly '-B' lines (default: 5)",
+  "  -t arg      #of event loop threads driving child processes, child processes are evenly distributed over threads (optional, default: 1)",
   "  -M arg      maximum number of lines to store in the output queue before terminating, if non-zero the queue will be incremented (see '-x' option) (default: 1000)",
   "  -x arg      increment output queue with this #of elements if overflow (default: 1000)",
   "  -c arg      command to execute in child process (optional if specified as positional parameter)",
-  "  -i arg      input file (default is standard input, optional)",
-  "  -o arg      output file (default is standard output, optional)",
+  "  -S arg      connect 'maxclients' times to a running service at network address 'tcp://host:port' | 'unix:/path' instead of spawning child processes",
+  "  -i arg      input file or network address 'tcp://host:port' | 'unix:/path' (default is standard input, optional)",
+  "  -o arg      output file or network address 'tcp://host:port' | 'unix:/path' (default is standard output, optional)",
   "  -C arg      execute in transactional mode with #of lines per commit (default: no commits are performed , optional)",
+  "  --serve arg   run as a server keeping 'maxclients' child processes running and accepting jobs on unix socket 'arg'",
+  "  --client arg  submit a job (input -> output) to a server listening on unix socket 'arg'",
+  "  --dispatch arg policy choosing which idle child process gets the next line: first | rr | least | ewma | p2c (default: first)",
+  "  --cache arg   cache responses for repeated input lines using at most 'arg' MB of memory (default: no cache)",
+  "  --cache-file arg  load cached responses from and append new responses to file 'arg', implies '--cache 64' unless '--cache' is specified",
+  "  --coalesce    duplicates of a line being processed by a child process wait for its response instead of being sent to a child process",
+  "  --record arg  record framing of input: lf | nul | byte:C | byte:0xHH | len32 | re:REGEX, records are passed verbatim to child processes (default: lf)",
+  "  --child-record arg  record framing of responses from child processes, same formats as '--record' except 're:', or eor:MARKER for zero or more lines followed by the line MARKER (default: '--record' framing, lf if '--record' is 're:')",
+  "  --first arg   first line number (counting from 1) to process by child processes, other lines are passed unchanged to output (default: 1)",
+  "  --count arg   #of lines, starting at '--first', to process by child processes (default: all)",
+  "  --every arg   process only every 'arg' line, counting from '--first', by child processes (default: 1)",
+  "  --match arg   process only lines matching regular expression 'arg' by child processes",
+  "  --match-lineno arg  process only lines with line number matching regular expression 'arg' by child processes",
+  "  --drop        drop lines not processed by child processes instead of passing them unchanged to output (default: not set)",
+  "  --key-field arg  route each line to the child process owning the key in field 'arg' (counting from 1) so lines with the same key go to the same child process",
+  "  --key-delim arg  field delimiter for '--key-field' (default: tab)",
+  "  --key-regex arg  route each line to the child process owning the key matched by regular expression 'arg' (first subexpression, or whole match)",
+  "  --key-queue arg  max #of lines queued per child process when routing by key (default: 16)",
+  "  --field arg   send only field 'arg' (counting from 1) of each line to child processes and splice the response back into the line in place of the field",
+  "  --delim arg   field delimiter for '--field' (default: tab)",
+  "  --record-children arg  record responses from child processes and the time they took in trace file 'arg'",
+  "  --replay-children arg  replace child processes by simulated child processes answering lines from trace file 'arg' ('cmd' is not specified)",
+  "  --replay-scale arg  multiply recorded times by 'arg' when replaying, 0 answers immediately (default: 1)",
+  "  --trace-lines arg  write the life cycle of sampled lines to trace file 'arg' in Chrome trace event format (view in Perfetto or chrome://tracing)",
+  "  --trace-sample arg  trace every 'arg' line when tracing lines (default: 1000)",
+  "  --profile     account time spent in each phase of the main loop, log it on each heartbeat and print it at exit",
+  "  --cpu-loop arg  pin the main loop of para to CPU 'arg'",
+  "  --cpu-children arg  pin child processes in turn to the CPUs in list 'arg', for example 0-3,8,10-11",
+  "  --numa-children  pin child processes in turn to the CPUs of each NUMA node",
+  "  --zygote      spawn 'cmd' once as a zygote that initializes and then forks the child processes (see README for the protocol)",
+  "  --lazy        spawn child processes when lines are waiting for them (up to 'maxclients') instead of at startup",
+  "  --idle-retire arg  stop child processes that have been idle for 'arg' seconds, they are spawned again on demand (implies --lazy)",
   "  --",
   "  maxclients  #of child processes to spawn (optional if specified as command line parameter, default: 1)",
   "  cmd         command to execute in child processes (optional if specified as '-c' option)",
@@ -97,17 +222,57 @@ void printcmds(){
   fprintf(stderr,"-v: %s\n",bool2str(verbose));
   fprintf(stderr,"-V: %s\n",bool2str(version));
   fprintf(stderr,"-r: %s\n",bool2str(printrecoveryinfo));
+  fprintf(stderr,"-s: %s\n",bool2str(printstats));
+  fprintf(stderr,"-a: %s\n",bool2str(iothreads));
+  fprintf(stderr,"-z: %s\n",bool2str(gzinput));
   fprintf(stderr,"-R: %s\n",bool2str(recoveryenabled));
   fprintf(stderr,"-b: %lu\n",maxbuf);
   fprintf(stderr,"-T: %lu\n",clientsec);
   fprintf(stderr,"-H: %lu\n",heartsec);
   fprintf(stderr,"-m: %lu\n",maxclients);
+  fprintf(stderr,"-t: %lu\n",nthreads);
+  fprintf(stderr,"-B: %lu\n",maxbatch);
+  fprintf(stderr,"-L: %lu\n",batchms);
+  fprintf(stderr,"-Z: %d\n",gzoutlevel);
   fprintf(stderr,"-M: %lu\n",maxoutq);
   fprintf(stderr,"-I: %lu\n",incoutq);
   fprintf(stderr,"-c: %s\n",cmd);
+  fprintf(stderr,"-S: %s\n",svcaddr?svcaddr:"");
   fprintf(stderr,"-i: %s\n",inputfile?inputfile:"<stdin>");
   fprintf(stderr,"-o: %s\n",outputfile?outputfile:"<stdout>");
   fprintf(stderr,"-C: %lu\n",txncommitnlines);
+  fprintf(stderr,"--serve: %s\n",servesock?servesock:"");
+  fprintf(stderr,"--client: %s\n",clientsock?clientsock:"");
+  fprintf(stderr,"--dispatch: %s\n",dispatchname);
+  fprintf(stderr,"--cache: %lu\n",cachemb);
+  fprintf(stderr,"--cache-file: %s\n",cachefile?cachefile:"");
+  fprintf(stderr,"--coalesce: %d\n",coalesce);
+  fprintf(stderr,"--record: %s\n",recfmt?recfmt:"");
+  fprintf(stderr,"--child-record: %s\n",childrecfmt?childrecfmt:"");
+  fprintf(stderr,"--first: %lu\n",selfirst);
+  fprintf(stderr,"--count: %lu\n",selcount);
+  fprintf(stderr,"--every: %lu\n",selevery);
+  fprintf(stderr,"--match: %s\n",selmatch?selmatch:"");
+  fprintf(stderr,"--match-lineno: %s\n",selmatchlineno?selmatchlineno:"");
+  fprintf(stderr,"--drop: %d\n",seldrop);
+  fprintf(stderr,"--key-field: %lu\n",keyfield);
+  fprintf(stderr,"--key-delim: %c\n",keydelim);
+  fprintf(stderr,"--key-regex: %s\n",keyregex?keyregex:"");
+  fprintf(stderr,"--key-queue: %lu\n",keyqueue);
+  fprintf(stderr,"--field: %lu\n",projfield);
+  fprintf(stderr,"--delim: %c\n",projdelim);
+  fprintf(stderr,"--record-children: %s\n",recordfile?recordfile:"");
+  fprintf(stderr,"--replay-children: %s\n",replayfile?replayfile:"");
+  fprintf(stderr,"--replay-scale: %g\n",replayscale);
+  fprintf(stderr,"--trace-lines: %s\n",linetracefile?linetracefile:"");
+  fprintf(stderr,"--trace-sample: %lu\n",linetracesample);
+  fprintf(stderr,"--profile: %d\n",profile);
+  fprintf(stderr,"--cpu-loop: %d\n",cpuloop);
+  fprintf(stderr,"--cpu-children: %s\n",cpuchildren?cpuchildren:"");
+  fprintf(stderr,"--numa-children: %d\n",numachildren);
+  fprintf(stderr,"--zygote: %d\n",zygote);
+  fprintf(stderr,"--lazy: %d\n",lazy);
+  fprintf(stderr,"--idle-retire: %lu\n",idleretire);
   fprintf(stderr,"----------------------------\n");
 }
 // print version
@@ -130,7 +295,7 @@ void usage(char const*msg,...){
 // main test program
 int main(int argc,char**argv){
   int opt;
-  while((opt=getopt(argc,argv,"hpvVrRC:T:H:b:m:M:x:c:i:o:"))!=-1){ // get non-positional command line parameters
+  while((opt=getopt_long(argc,argv,"hpvVrsazRC:T:H:b:m:t:Z:B:L:M:x:c:S:i:o:",longopts,NULL))!=-1){ // get non-positional command line parameters
     switch(opt){
     case 'h':
       usage("");
@@ -149,6 +314,15 @@ int main(int argc,char**argv){
     case 'R':
       recoveryenabled=1;
       break;
+    case 's':
+      printstats=1;
+      break;
+    case 'a':
+      iothreads=1;
+      break;
+    case 'z':
+      gzinput=1;
+      break;
     case 'b':
       if(!isposnumber(optarg))usage("invalid parameter '%s' to '-b' option, must be a positive number",optarg);
       if((maxbuf=atol(optarg))<2)usage("parameter to '-b' must be a positive number greater than two (2)");
@@ -170,6 +344,22 @@ int main(int argc,char**argv){
       if(!isposnumber(optarg))usage("invalid parameter '%s' to '-m' option, must be a positive number",optarg);
       maxclients=atol(optarg);
       break;
+    case 't':
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '-t' option, must be a positive number",optarg);
+      if((nthreads=atol(optarg))<1)usage("parameter to '-t' must be a positive number greater than zero");
+      break;
+    case 'Z':
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '-Z' option, must be a positive number",optarg);
+      if((gzoutlevel=atoi(optarg))<1||gzoutlevel>9)usage("parameter to '-Z' must be a compression level between 1 and 9");
+      break;
+    case 'B':
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '-B' option, must be a positive number",optarg);
+      if((maxbatch=atol(optarg))<1)usage("parameter to '-B' must be a positive number greater than zero");
+      break;
+    case 'L':
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '-L' option, must be a positive number",optarg);
+      batchms=atol(optarg);
+      break;
     case 'M':
       if(!isposnumber(optarg))usage("invalid parameter '%s' to '-M' option, must be a positive number",optarg);
       maxoutq=atol(optarg);
@@ -181,12 +371,128 @@ int main(int argc,char**argv){
     case 'c':
       cmd=optarg;
       break;
+    case 'S':
+      if(!isnetaddr(optarg))usage("invalid parameter '%s' to '-S' option, must be a network address 'tcp://host:port' or 'unix:/path'",optarg);
+      svcaddr=optarg;
+      break;
     case 'i':
       inputfile=optarg;
       break;
     case 'o':
       outputfile=optarg;
       break;
+    case OPT_SERVE:
+      servesock=optarg;
+      break;
+    case OPT_CLIENT:
+      clientsock=optarg;
+      break;
+    case OPT_DISPATCH:
+      if(!dispatch_str2policy(optarg,&dispatchpolicy))usage("invalid parameter '%s' to '--dispatch' option, must be one of: first, rr, least, ewma, p2c",optarg);
+      dispatchname=optarg;
+      break;
+    case OPT_CACHE:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--cache' option, must be a positive number",optarg);
+      if((cachemb=atol(optarg))<1)usage("parameter to '--cache' must be a positive number greater than zero");
+      break;
+    case OPT_CACHEFILE:
+      cachefile=optarg;
+      break;
+    case OPT_COALESCE:
+      coalesce=1;
+      break;
+    case OPT_RECORD:
+      recfmt=optarg;
+      break;
+    case OPT_CHILDRECORD:
+      childrecfmt=optarg;
+      break;
+    case OPT_FIRST:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--first' option, must be a positive number",optarg);
+      if((selfirst=atol(optarg))<1)usage("parameter to '--first' must be a positive number greater than zero");
+      break;
+    case OPT_COUNT:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--count' option, must be a positive number",optarg);
+      if((selcount=atol(optarg))<1)usage("parameter to '--count' must be a positive number greater than zero");
+      break;
+    case OPT_EVERY:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--every' option, must be a positive number",optarg);
+      if((selevery=atol(optarg))<1)usage("parameter to '--every' must be a positive number greater than zero");
+      break;
+    case OPT_MATCH:
+      selmatch=optarg;
+      break;
+    case OPT_MATCHLINENO:
+      selmatchlineno=optarg;
+      break;
+    case OPT_DROP:
+      seldrop=1;
+      break;
+    case OPT_KEYFIELD:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--key-field' option, must be a positive number",optarg);
+      if((keyfield=atol(optarg))<1)usage("parameter to '--key-field' must be a positive number greater than zero");
+      break;
+    case OPT_KEYDELIM:
+      if(strlen(optarg)!=1)usage("invalid parameter '%s' to '--key-delim' option, must be a single character",optarg);
+      keydelim=optarg[0];
+      break;
+    case OPT_KEYREGEX:
+      keyregex=optarg;
+      break;
+    case OPT_KEYQUEUE:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--key-queue' option, must be a positive number",optarg);
+      if((keyqueue=atol(optarg))<1)usage("parameter to '--key-queue' must be a positive number greater than zero");
+      break;
+    case OPT_FIELD:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--field' option, must be a positive number",optarg);
+      if((projfield=atol(optarg))<1)usage("parameter to '--field' must be a positive number greater than zero");
+      break;
+    case OPT_DELIM:
+      if(strlen(optarg)!=1)usage("invalid parameter '%s' to '--delim' option, must be a single character",optarg);
+      projdelim=optarg[0];
+      break;
+    case OPT_RECORDCHILDREN:
+      recordfile=optarg;
+      break;
+    case OPT_REPLAYCHILDREN:
+      replayfile=optarg;
+      break;
+    case OPT_REPLAYSCALE:{
+      char*end;
+      replayscale=strtod(optarg,&end);
+      if(*optarg=='\0'||*end!='\0'||replayscale<0)usage("invalid parameter '%s' to '--replay-scale' option, must be a non-negative number",optarg);
+      break;
+    }
+    case OPT_TRACELINES:
+      linetracefile=optarg;
+      break;
+    case OPT_TRACESAMPLE:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--trace-sample' option, must be a positive number",optarg);
+      if((linetracesample=atol(optarg))<1)usage("parameter to '--trace-sample' must be a positive number greater than zero");
+      break;
+    case OPT_PROFILE:
+      profile=1;
+      break;
+    case OPT_CPULOOP:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--cpu-loop' option, must be a CPU number",optarg);
+      cpuloop=atoi(optarg);
+      break;
+    case OPT_CPUCHILDREN:
+      cpuchildren=optarg;
+      break;
+    case OPT_NUMACHILDREN:
+      numachildren=1;
+      break;
+    case OPT_ZYGOTE:
+      zygote=1;
+      break;
+    case OPT_LAZY:
+      lazy=1;
+      break;
+    case OPT_IDLERETIRE:
+      if(!isposnumber(optarg))usage("invalid parameter '%s' to '--idle-retire' option, must be a positive number",optarg);
+      if((idleretire=atol(optarg))<1)usage("parameter to '--idle-retire' must be a positive number greater than zero");
+      break;
     case '?':
       usage("unknown option: %c\n",optopt);
     }
@@ -204,12 +510,15 @@ int main(int argc,char**argv){
   for(;optind<argc;++optind,++pospar){                                         // ...
     if(cargc>=ARG_MAX)app_message(FATAL,"too many command line parameters to child process, max: %d",ARG_MAX);
     char const*optarg=argv[optind];                                            // ...
+    if(clientsock)usage("positional arguments cannot be specified when submitting a job to a server ('--client')");
     if(pospar==0){                                                             // 'maxclient'
       if(cmd)usage("'maxclients' cannot be specified both as a command line parameters ('m') and as a positional argument ('maxclients')");
       if(!isposnumber(optarg))usage("invalid parameter '%s' as first positional argument, 'maxclient' must be a positive number",optarg);
       maxclients=atol(optarg);                                                 // ...
     }else                                                                      // ...
     if(pospar==1){                                                             // 'cmd'
+      if(svcaddr)usage("'cmd' cannot be specified when connecting to a service ('-S')");
+      if(replayfile)usage("'cmd' cannot be specified when replaying child processes ('--replay-children')");
       if(cmd)usage("'cmd' cannot be specified both as a command line parameters ('c') and as a positional argument ('cmd')");
       cmd=argv[optind];                                                        // ...
       cargv[cargc++]=cmd;                                                      // ...
@@ -220,17 +529,92 @@ int main(int argc,char**argv){
   cargv[cargc++]=NULL;                                                         // need to terminate cmd parameters for child processes
 
   // check that we have all parameters
-  if(!cmd)usage("'cmd' (or -c) command line parameters must specify command for child process");
+  if(servesock&&clientsock)usage("'--serve' and '--client' cannot both be specified");
+  if(servesock&&(svcaddr||txncommitnlines||recoveryenabled))usage("'-S', '-C' and '-R' cannot be specified when running as a server ('--serve')");
+  if(nthreads>1&&(svcaddr||servesock))usage("'-t' cannot be specified when connecting to a service ('-S') or when running as a server ('--serve')");
+  if(iothreads&&(servesock||clientsock))usage("'-a' cannot be specified when running as a server ('--serve') or when submitting a job to a server ('--client')");
+  if((gzinput||gzoutlevel)&&(servesock||clientsock))usage("'-z' and '-Z' cannot be specified when running as a server ('--serve') or when submitting a job to a server ('--client')");
+  if((gzinput||gzoutlevel)&&!gz_available())usage("'-z' and '-Z' require para to be built with zlib");
+  if(gzoutlevel)iothreads=1;                                                   // output is compressed on the writer thread
+  if(dispatchpolicy!=DISPATCH_FIRST&&(nthreads>1||servesock||clientsock))usage("'--dispatch' cannot be specified with '-t', '--serve' or '--client'");
+  if(maxbatch>1&&(nthreads>1||svcaddr||servesock||clientsock))usage("'-B' cannot be specified with '-t', '-S', '--serve' or '--client'");
+  if(cachefile&&cachemb==0)cachemb=64;                                         // default cache size when using a cache file
+  if(cachemb>0&&(nthreads>1||servesock||clientsock))usage("'--cache' and '--cache-file' cannot be specified with '-t', '--serve' or '--client'");
+  if(coalesce&&(nthreads>1||servesock||clientsock))usage("'--coalesce' cannot be specified with '-t', '--serve' or '--client'");
+  if((recfmt||childrecfmt)&&(nthreads>1||servesock||clientsock))usage("'--record' and '--child-record' cannot be specified with '-t', '--serve' or '--client'");
+  struct rec_t*recin=NULL;                                                     // record framing of input and of responses from child processes
+  struct rec_t*recchild=NULL;                                                  // ...
+  if(recfmt&&!(recin=rec_ctor(recfmt,maxbuf)))usage("invalid record framing '%s' to '--record' option",recfmt);
+  if(recin&&recin->type_==REC_EOR)usage("'eor:' framing can only be used for responses from child processes ('--child-record')");
+  if(!childrecfmt&&recin&&recin->type_!=REC_REGEX)childrecfmt=recfmt;          // responses use the input framing unless input records are multi-line
+  if(childrecfmt&&!(recchild=rec_ctor(childrecfmt,maxbuf)))usage("invalid record framing '%s' to '--child-record' option",childrecfmt);
+  if(recchild&&recchild->type_==REC_REGEX)usage("'re:' framing cannot be used for responses from child processes ('--child-record')");
+  if(keyfield&&keyregex)usage("'--key-field' and '--key-regex' cannot both be specified");
+  if((keyfield||keyregex)&&(nthreads>1||servesock||clientsock||maxbatch>1||dispatchpolicy!=DISPATCH_FIRST||cachemb>0||coalesce)){
+    usage("'--key-field' and '--key-regex' cannot be specified with '-t', '-B', '--dispatch', '--cache', '--coalesce', '--serve' or '--client'");
+  }
+  if(projfield&&(nthreads>1||servesock||clientsock||cachemb>0||coalesce||recfmt||childrecfmt)){
+    usage("'--field' cannot be specified with '-t', '--cache', '--coalesce', '--record', '--child-record', '--serve' or '--client'");
+  }
+  if(recordfile&&replayfile)usage("'--record-children' and '--replay-children' cannot both be specified");
+  if(recordfile&&(nthreads>1||maxbatch>1||servesock||clientsock||recfmt||childrecfmt)){
+    usage("'--record-children' cannot be specified with '-t', '-B', '--record', '--child-record', '--serve' or '--client'");
+  }
+  if(replayfile&&(nthreads>1||svcaddr||servesock||clientsock||recfmt||childrecfmt)){
+    usage("'--replay-children' cannot be specified with '-t', '-S', '--record', '--child-record', '--serve' or '--client'");
+  }
+  if(linetracefile&&(nthreads>1||maxbatch>1||servesock||clientsock)){
+    usage("'--trace-lines' cannot be specified with '-t', '-B', '--serve' or '--client'");
+  }
+  if(profile&&(servesock||clientsock))usage("'--profile' cannot be specified with '--serve' or '--client'");
+  if(cpuchildren&&numachildren)usage("'--cpu-children' and '--numa-children' cannot both be specified");
+  if((cpuchildren||numachildren)&&(svcaddr||replayfile||clientsock)){
+    usage("'--cpu-children' and '--numa-children' cannot be specified with '-S', '--replay-children' or '--client'");
+  }
+  if(zygote&&(nthreads>1||maxbatch>1||svcaddr||replayfile||servesock||clientsock)){
+    usage("'--zygote' cannot be specified with '-t', '-B', '-S', '--replay-children', '--serve' or '--client'");
+  }
+  if((lazy||idleretire)&&(nthreads>1||svcaddr||servesock||clientsock||keyfield||keyregex)){
+    usage("'--lazy' and '--idle-retire' cannot be specified with '-t', '-S', '--serve', '--client', '--key-field' or '--key-regex'");
+  }
+  if(cpuloop>=0&&clientsock)usage("'--cpu-loop' cannot be specified with '--client'");
+  struct cpuplace_t*cpuplace=NULL;                                             // placement of child processes on CPUs
+  if(cpuchildren&&!(cpuplace=cpuplace_cpus(cpuchildren)))usage("invalid CPU list '%s' to '--cpu-children' option",cpuchildren);
+  if(numachildren&&!(cpuplace=cpuplace_numa()))usage("failed reading NUMA nodes for '--numa-children' option");
+  struct replay_t*replay=NULL;                                                 // simulated child processes
+  if(replayfile&&!(replay=replay_ctor(replayfile,replayscale)))usage("failed reading trace file '%s' to '--replay-children' option",replayfile);
+  int selenabled=selfirst||selcount||selevery||selmatch||selmatchlineno;      // selection of lines to process
+  if((selenabled||seldrop)&&(nthreads>1||servesock||clientsock))usage("'--first', '--count', '--every', '--match', '--match-lineno' and '--drop' cannot be specified with '-t', '--serve' or '--client'");
+  if(seldrop&&!selenabled)usage("'--drop' requires at least one of '--first', '--count', '--every', '--match' or '--match-lineno'");
+  struct sel_t*sel=NULL;                                                       // ...
+  if(selenabled&&!(sel=sel_ctor(startlineno,selfirst,selcount,selevery,selmatch,selmatchlineno,seldrop))){
+    usage("invalid regular expression to '--match' or '--match-lineno' option");
+  }
+  if(recin&&recin->type_==REC_REGEX){                                          // multi-line records are terminated by the delimiter of responses
+    if(recchild&&recchild->type_==REC_LEN32)usage("'--child-record' cannot be 'len32' when '--record' is 're:'");
+    rec_setterm(recin,recchild&&recchild->type_==REC_BYTE?recchild->delim_:'\n');// ...
+  }
+  if(nthreads>maxclients)nthreads=maxclients;                                  // no point having threads without child processes
+  if(clientsock&&(txncommitnlines||recoveryenabled))usage("'-C' and '-R' cannot be specified when submitting a job to a server ('--client')");
+  if(!cmd&&!svcaddr&&!clientsock&&!replayfile)usage("'cmd' (or -c) command line parameters must specify command for child process");
+  if(cmd&&svcaddr)usage("'cmd' (or -c) cannot be specified when connecting to a service ('-S')");
+  if(cmd&&replayfile)usage("'cmd' (or -c) cannot be specified when replaying child processes ('--replay-children')");
 
   if(verbose)loglevel(DEBUG);                                                  // set debug level
   if(print)printcmds();                                                        // print cmd linet parameters if needed
 
-  // open input file if needed
+  // open input file (or connect to network address) if needed
   int fdin=STDIN_FILENO;                                                       // input and output fds
   int fdout=STDOUT_FILENO;                                                     // ...
-  if(inputfile)fdin=eopen(inputfile,O_RDONLY,0777);                            // open input file for reading
+  int outIsPositionable=0;                                                     // can we position in output (only if output is a file)
+  int outIsSyncable=0;                                                         // can we sync output to disk (only if output is a file)
+  if(isnetaddr(inputfile))fdin=econnect(inputfile);                            // connect to network server supplying input
+  else if(inputfile)fdin=eopen(inputfile,O_RDONLY,0777);                       // open input file for reading
 
   // open output differently depending on how recovery flag is set and if transaction log exists
+  if(isnetaddr(outputfile)){                                                   // network sink - not positionable and cannot be synced
+    fdout=econnect(outputfile);                                                // ...
+  }else
   if(outputfile){                                                              // if output file is specified then open it with correct parameters
     int txnlogexists=0;                                                        // flag set to true of transactio log exist 
     if(access(txnlog,R_OK)==0)txnlogexists=1;                                  // check if transaction log exists and can be access in read mode
@@ -240,9 +624,65 @@ int main(int argc,char**argv){
     }else{                                                                     // no recovery
       oflags|=O_CREAT|O_TRUNC;                                                 // truncate outfile if no recovery
     }                                                                          // ...
-    if(outputfile)fdout=eopen(outputfile,oflags,0777);                         // open output file for writing
+    fdout=eopen(outputfile,oflags,0777);                                       // open output file for writing
+    outIsPositionable=1;                                                       // ...
+    outIsSyncable=1;                                                           // ...
+  }
+  // submit job to server if requested
+  if(clientsock){                                                              // ...
+    paraclient(clientsock,fdin,fdout);                                         // ...
+    return 0;                                                                  // ...
   }
   // kickoff select() loop
-  paraloop(cmd,cargv,maxclients,clientsec,heartsec,maxoutq,incoutq,maxbuf,startlineno,fdin,fdout,txncommitnlines,txnlog,
-           recoveryenabled,outputfile!=0,outputfile!=0);
+  struct paraopt_t popt;                                                       // collect parameters for main loop
+  memset(&popt,0,sizeof popt);                                                 // ...
+  popt.cfile_=cmd;                                                             // ...
+  popt.cargv_=cargv;                                                           // ...
+  popt.svcaddr_=svcaddr;                                                       // ...
+  popt.nsubprocesses_=maxclients;                                              // ...
+  popt.client_tmo_sec_=clientsec;                                              // ...
+  popt.heart_sec_=heartsec;                                                    // ...
+  popt.maxoutq_=maxoutq;                                                       // ...
+  popt.outqinc_=incoutq;                                                       // ...
+  popt.maxbuf_=maxbuf;                                                         // ...
+  popt.startlineno_=startlineno;                                               // ...
+  popt.fdin_=fdin;                                                             // ...
+  popt.fdout_=fdout;                                                           // ...
+  popt.txncommitnlines_=txncommitnlines;                                       // ...
+  popt.txnlogfile_=txnlog;                                                     // ...
+  popt.recoveryenabled_=recoveryenabled;                                       // ...
+  popt.outIsPositionable_=outIsPositionable;                                   // ...
+  popt.outIsSyncable_=outIsSyncable;                                           // ...
+  popt.printstats_=printstats;                                                 // ...
+  popt.nthreads_=nthreads;                                                     // ...
+  popt.iothreads_=iothreads;                                                   // ...
+  popt.gzinput_=gzinput;                                                       // ...
+  popt.gzoutlevel_=gzoutlevel;                                                 // ...
+  popt.maxbatch_=maxbatch;                                                     // ...
+  popt.batchtarget_=batchms/1000.0;                                            // ...
+  popt.cachebudget_=cachemb*1024*1024;                                         // ...
+  popt.cachefile_=cachefile;                                                   // ...
+  popt.coalesce_=coalesce;                                                     // ...
+  popt.recin_=recin;                                                           // ...
+  popt.recchild_=recchild;                                                     // ...
+  popt.sel_=sel;                                                               // ...
+  popt.keyfield_=keyfield;                                                     // ...
+  popt.keydelim_=keydelim;                                                     // ...
+  popt.keyregex_=keyregex;                                                     // ...
+  popt.keyqueue_=keyqueue;                                                     // ...
+  popt.projfield_=projfield;                                                   // ...
+  popt.projdelim_=projdelim;                                                   // ...
+  popt.recordfile_=recordfile;                                                 // ...
+  popt.replay_=replay;                                                         // ...
+  popt.linetracefile_=linetracefile;                                           // ...
+  popt.linetracesample_=linetracesample;                                       // ...
+  popt.profile_=profile;                                                       // ...
+  popt.cpuloop_=cpuloop;                                                       // ...
+  popt.cpuplace_=cpuplace;                                                     // ...
+  popt.zygote_=zygote;                                                         // ...
+  popt.lazy_=lazy;                                                             // ...
+  popt.idleretire_=idleretire;                                                 // ...
+  popt.dispatchpolicy_=dispatchpolicy;                                         // ...
+  if(servesock)paraserve(&popt,servesock);                                     // run as server (never returns)
+  paraloop(&popt);
 }
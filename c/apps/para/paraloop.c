@@ -14,7 +14,25 @@
 #include "inq.h"
 #include "sys.h"
 #include "txn.h"
+#include "stats.h"
+#include "shard.h"
+#include "iothread.h"
+#include "gz.h"
+#include "dispatch.h"
+#include "batch.h"
+#include "cache.h"
+#include "inflight.h"
+#include "sel.h"
+#include "affinity.h"
+#include "proj.h"
+#include "replay.h"
+#include "zygote.h"
+#include "linetrace.h"
+#include "prof.h"
+#include "probe.h"
+#include "cpuaff.h"
 #include "util.h"
+#include "paraloop.h"
 #include <stdio.h>
 #include <errno.h>
 #include <signal.h>
@@ -24,23 +42,64 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+// max #of lines written to output in a single write call
+#define MAXIOV 256
+
+// max #of lines held by each of the reader and writer threads
+#define IOTHREAD_MAXLINES 1024
+
+// max #of attempts (one per second) to reconnect to a service before giving up
+#define SVC_MAXRETRY 10
+
+// seconds between attempts to reconnect to a service
+#define SVC_RETRYSEC 1
+
+// max #of child processes forked by a zygote that may exit in a row on the same line
+#define ZYGOTE_MAXEXITS 3
+
 // helper methods
-static int readinq(struct inq_t*qin,FILE*fpin,size_t maxlines,struct combufpool*cbpool);                         // read lines from input
-static int flushoutq(struct outq_t*qout,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog);// flush output queue
-static void inq2cbtab(struct inq_t*qin,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool);              // transfer data from inq to child process write buffer
-static int cbtabread(struct combuf*cb,fd_set*rdall_set,fd_set*fdrd);                                             // read data into sub process buffer
-static int cbtabwrite(struct combuf*cb,fd_set*rdall_set,fd_set*wrall_set,fd_set*wrset,struct combufpool*cbpool); // write data in sub process buffer
-static void cbtab2outq(struct outq_t*qout,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool,FILE*fpout);// copy sub process buffer to output queue
+static int childidle(struct combuf*cb,struct batch_t*batch);                  // true if slot has a child process without lines in flight
+static void svcreconnect(struct combuf*cb,size_t ind,char const*svcaddr,struct zygote_t*zygote,struct buf_t*sent,size_t*nretries,struct priq*qtmo,fd_set*rdall_set,fd_set*wrall_set,FILE***fd2fpmap,int*fd2fpmap_size,struct stats_t*stats); // reconnect a closed service connection (or fork a new child process from the zygote)
+static void svcretry(struct combuf*cb,size_t ind,char const*svcaddr,size_t*nretries,struct priq*qtmo,fd_set*wrall_set,FILE***fd2fpmap,int*fd2fpmap_size,struct stats_t*stats); // try to reconnect a disconnected service connection (arms a RECONNECT timer on failure)
+static int svcqueued(struct combuftab*cbtab);                                                                    // true if a line is queued on a disconnected service connection
+static void fd2fpmap_set(FILE***fd2fpmap,int*fd2fpmap_size,int fd,FILE*fp);                                     // register fd --> FILE* in map (extend map if needed)
 static void handle_txn(size_t txncommitnlines,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,int forcecommit,struct txn_t*txn); // commit transaction if needed
+static void inq2shards(struct inq_t*qin,struct shard_t**shards,size_t nshards);                                  // hand lines from input queue to least loaded shards
+static void shards2outq(struct shard_t**shards,size_t nshards,struct outq_t*qout,FILE*fpout);                    // move lines processed by shards to output queue
+static size_t shards_ninflight(struct shard_t**shards,size_t nshards);                                           // #of lines handed to shards not yet returned
+static int reader2inq(struct reader_t*reader,struct inq_t*qin,size_t maxlines,struct combufpool*cbpool,FILE*fpin,struct rec_t*rec); // move lines from reader thread to input queue
+static void outq2writer(struct outq_t*qout,struct writer_t*writer,struct combufpool*cbpool,struct linetrace_t*lt);                     // move ready lines from output queue to writer thread
+static void inq2batch(struct inq_t*qin,struct batch_t*batch,size_t nlines,size_t nbytes,struct sel_t*sel,struct inflight_t*inf,struct cache_t*cache,struct proj_t*proj,size_t slot,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout); // move lines from input queue to a batch
+static int cbtabwritebatch(struct combuf*cb,struct batch_t*batch,fd_set*rdall_set,fd_set*wrall_set,fd_set*wrset,struct combufpool*cbpool); // write lines in a batch to child process
+static int cbtabreadbatch(struct outq_t*qout,struct combuf*cb,struct batch_t*batch,fd_set*rdall_set,fd_set*rdset,struct combufpool*cbpool,FILE*fpout,struct inflight_t*inf,struct cache_t*cache,struct proj_t*proj,size_t slot); // read responses for a batch into output queue
+static int inq2outq(struct inq_t*qin,struct sel_t*sel,struct inflight_t*inf,struct cache_t*cache,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout,struct linekey_t*key); // move lines not needing a child process from input queue to output queue
+static void inq2affinity(struct inq_t*qin,struct sel_t*sel,struct affinity_t*aff,struct proj_t*proj,struct combuftab*cbtab,fd_set*wrall_set,struct buf_t**svcsent,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout); // hand lines to child processes owning their keys
+static void inflight2outq(struct inflight_t*inf,struct cache_t*cache,size_t slot,struct combuf*cb,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout); // response was read from child process - copy it to lines waiting for it
+static char*cmdline2str(char const*cfile,char**cargv);                                                          // command line as a single string
+static void logbatches(struct batch_t**batches,size_t nslots);                                                   // log current batch sizes
+static int flushoutqgz(struct outq_t*qout,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats); // flush output queue through gzip compression
+
+// child processes retired after being idle - they are expected to exit
+// (only changed by the main loop while SIGCHLD is blocked and by the SIGCHLD handler)
+static int*retiredpids=NULL;
+static size_t nretiredpids=0;
+static size_t maxretiredpids=0;
+static void addretired(int pid);
+static int removeretired(int pid);
 
 // handle SIGCHLD signal
-static int childExited=0;
+int childExited=0;
 void sigchldHandler(int signo){
-  app_message(WARNING,"sigchldHandler caught sigchild");
+  app_message(DEBUG,"sigchldHandler caught sigchild");
   int pid;
   int stat;
   while((pid=waitpid(-1,&stat,WNOHANG))>0||(stat<0&&errno==EINTR)){
     if(pid>0){
+      PARA_PROBE2(child__exit,pid,stat);
+      if(removeretired(pid)){
+        app_message(DEBUG,"retired child with pid: %d terminated",pid);
+        continue;
+      }
       app_message(WARNING,"child with pid: %d terminated",pid);
       childExited=1;
     }
@@ -60,10 +119,69 @@ void recoveryinfo(char const*txnlogfile,size_t*skipnfirstlines,size_t*skipoutput
 }
 // select loop
 // (this is the main loop in the para program)
-void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_tmo_sec,size_t heart_sec,size_t maxoutq,size_t outqinc,size_t maxbuf,int startlineno,int fdin,int fdout,size_t txncommitnlines,char const*txnlogfile,int recoveryenabled,int outIsPositionable,int outIsSyncable){
+void paraloop(struct paraopt_t const*opt){
+  // grab parameters
+  char const*cfile=opt->cfile_;                     // command to execute in child processes
+  char**cargv=opt->cargv_;                          // ...
+  char const*svcaddr=opt->svcaddr_;                 // service address (if NULL spawn child processes)
+  size_t nsubprocesses=opt->nsubprocesses_;         // ...
+  size_t client_tmo_sec=opt->client_tmo_sec_;       // ...
+  size_t heart_sec=opt->heart_sec_;                 // ...
+  size_t maxoutq=opt->maxoutq_;                     // ...
+  size_t outqinc=opt->outqinc_;                     // ...
+  size_t maxbuf=opt->maxbuf_;                       // ...
+  int startlineno=opt->startlineno_;                // ...
+  int fdin=opt->fdin_;                              // ...
+  int fdout=opt->fdout_;                            // ...
+  size_t txncommitnlines=opt->txncommitnlines_;     // ...
+  char const*txnlogfile=opt->txnlogfile_;           // ...
+  int recoveryenabled=opt->recoveryenabled_;        // ...
+  int outIsPositionable=opt->outIsPositionable_;    // ...
+  int outIsSyncable=opt->outIsSyncable_;            // ...
+  int printstats=opt->printstats_;                  // ...
+  size_t nthreads=opt->nthreads_;                   // ...
+  int iothreads=opt->iothreads_;                    // ...
+  int gzinput=opt->gzinput_;                        // ...
+  int gzoutlevel=opt->gzoutlevel_;                  // ...
+  enum dispatchpolicy_t dispatchpolicy=opt->dispatchpolicy_;// ...
+  size_t maxbatch=opt->maxbatch_;                   // ...
+  double batchtarget=opt->batchtarget_;             // ...
+  size_t maxinq=nsubprocesses*(maxbatch>1?maxbatch:1);// keep enough lines in input queue to fill a batch for each child process
+  size_t cachebudget=opt->cachebudget_;             // ...
+  char const*cachefile=opt->cachefile_;             // ...
+  int coalesce=opt->coalesce_;                      // ...
+  struct rec_t*recin=opt->recin_;                   // ...
+  struct rec_t*recchild=opt->recchild_;             // ...
+  struct sel_t*sel=opt->sel_;                       // ...
+  size_t keyfield=opt->keyfield_;                   // ...
+  char const*keyregex=opt->keyregex_;               // ...
+  size_t projfield=opt->projfield_;                 // ...
+  char const*recordfile=opt->recordfile_;           // ...
+  struct replay_t*replay=opt->replay_;              // ...
+  char const*linetracefile=opt->linetracefile_;     // ...
+  int profile=opt->profile_;                        // ...
+  int cpuloop=opt->cpuloop_;                        // ...
+  struct cpuplace_t*cpuplace=opt->cpuplace_;        // ...
+  int usezygote=opt->zygote_;                       // ...
+  size_t idleretire=opt->idleretire_;               // ...
+  int lazy=opt->lazy_||idleretire>0;                // (retired child processes are spawned again on demand)
+
+  // decompress input on a separate thread if input is gzip compressed
+  // (from here on input is read from a pipe fed by the decompression thread)
+  struct gzin_t*gzin=NULL;
+  if(gzinput||gzin_isgzip(fdin)){
+    gzin=gzin_ctor(fdin);
+    fdin=gzin_fd(gzin);
+  }
+
   // set input and output to non-blocking
-  setfdnonblock(fdin);
-  setfdnonblock(fdout);
+  // (dedicated reader and writer threads use blocking input and output)
+  if(!iothreads){
+    setfdnonblock(fdin);
+    setfdnonblock(fdout);
+  }
+  int outIsSock=fdissock(fdout);                    // output is a socket (tcp or unix) - we must avoid SIGPIPE when writing
+  struct stats_t*stats=stats_ctor();                // statistics
 
   // if recovery is enabled then retrieve #of lins that were committed
   // (note: we can do recovery even if we won't execute in transactional mode)
@@ -87,7 +205,8 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
   FD_SET(fdin,&rdall_set);                          // set read fd - everything is started by reading from input
 
   // setup timer queue
-  size_t maxtmos=1+nsubprocesses;                   // maxtmos: heartbeat timer + one timer for each child process
+  size_t maxtmos=1+nsubprocesses;                   // maxtmos: heartbeat timer + one timer for each child process (or reconnect timer for each service connection)
+  if(idleretire>0)maxtmos+=nsubprocesses;           // ... (+ one idle timer for each child process)
   struct priq*qtmo=tmoq_ctor(maxtmos);
   struct tmo_t*heart_tmo=tmo_ctor(HEARTBEAT,heart_sec,-1);
   tmoq_push(qtmo,heart_tmo);
@@ -99,7 +218,6 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
 
   // setup output queue
   // (output queue is a priority queue with lowest line number at front)
-  int outputeof=0;
   struct outq_t*qout=outq_ctor(maxoutq,outqinc,startlineno+skipnfirstlines);
 
   // setup a pool of free combuf objects
@@ -126,24 +244,108 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
   if(sigprocmask(SIG_BLOCK,&mask,&orig_mask)<0){                      // ...
     app_message(FATAL,"failed in sigprocmask(): %s",strerror(errno)); // bail out
   }
+  // when talking to a service a closed connection must show up as an error from write() - not as a SIGPIPE
+  // (we don't spawn any child processes in this case so ignoring SIGPIPE is not inherited by anyone)
+  // (writes to child processes - forked by a zygote or not - use MSG_NOSIGNAL, see 'combuf_write()', so we don't need to ignore SIGPIPE for them)
+  if(svcaddr){
+    struct sigaction sigpipe;                                         // ignore SIGPIPE
+    memset(&sigpipe,0,sizeof sigpipe);                                // ...
+    sigpipe.sa_handler=SIG_IGN;                                       // ...
+    if(sigaction(SIGPIPE,&sigpipe,0)<0){                              // ...
+      app_message(FATAL,"failed in sigaction(): %s",strerror(errno)); // bail out
+    }
+  }
+  // when running with more than one event loop thread child processes are distributed over shards
+  // (each shard is driven by its own thread - this thread reads input, hands lines to shards and writes output)
+  struct shard_t**shards=NULL;
+  int mainwakefds[2]={-1,-1};                                         // pipe used by other threads to wake up this thread
+  int mainsleeping=0;                                                 // tells reader and writer threads we are sleeping in select()
+  if(nthreads>1||iothreads)ewakepipe(mainwakefds);
+  if(nthreads>1){
+    shards=emalloc(nthreads*sizeof(struct shard_t*));
+    for(size_t k=0;k<nthreads;++k)shards[k]=shard_ctor(k,(nsubprocesses+nthreads-1)/nthreads,maxbuf,client_tmo_sec,mainwakefds[1]);
+  }
   // setup a table of combufs for tracking child processes
   // (combuftab is a table with entries tracking sub processes - each element is a simple combuf struct)
+  // (when running against a service each entry is a connection to the service and the pid is -1)
+  // (when running with shards the table is empty since child processes are tracked by the shards)
+  // (when using a zygote, child processes are forked by the zygote once it has initialized)
+  // (when spawning child processes on demand, slots start out empty - an empty slot has no FILE*)
   struct combuftab*cbtab=combuftab_ctor(nsubprocesses);
+  struct zygote_t*zygote=NULL;
+  if(usezygote)zygote=zygote_ctor(cfile,cargv);
   for(size_t i=0;i<nsubprocesses;++i){
-    struct intpair p=spawn(cfile,cargv);
+    if(lazy){
+      struct combuf*cb=combufpool_get(cbpool,NULL,CBWRITE);
+      combuf_setpid(cb,-1);
+      combuf_setrec(cb,recchild);
+      combuftab_add(cbtab,cb);
+      continue;
+    }
+    struct intpair p={-1,-1};
+    if(svcaddr)p.second=econnect(svcaddr);
+    else if(replay)p=replay_spawn(replay);
+    else if(zygote)p=zygote_fork(zygote);
+    else p=spawn(cfile,cargv);
+    if(cpuplace&&p.first>=0)cpuplace_pin(cpuplace,i,p.first);   // spread child processes over CPUs
+    if(shards){
+      shard_addchild(shards[i%nthreads],p.first,p.second);
+      continue;
+    }
+    if(svcaddr)setfdnonblock(p.second);
     FILE*fp=efdopen(p.second,"rwb");
     struct combuf*cb=combufpool_get(cbpool,fp,CBWRITE);
     combuf_setpid(cb,p.first);
+    combuf_setrec(cb,recchild);
     combuftab_add(cbtab,cb);
   }
+  size_t nslots=combuftab_size(cbtab);                                // #of child processes handled directly by this thread
+  struct dispatch_t*disp=dispatch_ctor(dispatchpolicy,nslots);        // scheduler picking child process for next line
+  struct batch_t**batches=NULL;                                       // batches handed to child processes (if batching is enabled)
+  if(maxbatch>1){                                                     // ...
+    batches=emalloc(nslots*sizeof(struct batch_t*));                  // ...
+    for(size_t i=0;i<nslots;++i)batches[i]=batch_ctor(maxbatch,batchtarget);
+  }
+  struct inflight_t*inf=NULL;                                         // keys of lines in flight (if caching or coalescing)
+  if(cachebudget>0||coalesce){                                        // ...
+    char*cmdline=cmdline2str(cfile?cfile:svcaddr?svcaddr:replay->file_,cargv); // (keys are only valid for the same command)
+    inf=inflight_ctor(cmdline,nslots,maxbatch>1?maxbatch:1,coalesce); // ...
+    free(cmdline);                                                    // ...
+  }
+  struct cache_t*cache=NULL;                                          // cache of responses for repeated input lines
+  if(cachebudget>0)cache=cache_ctor(cachebudget,cachefile);           // ...
+  struct affinity_t*aff=NULL;                                         // queues of lines for child processes owning their keys (if key affinity is enabled)
+  if(keyfield||keyregex){                                             // ...
+    aff=affinity_ctor(keyfield,opt->keydelim_,keyregex,nslots,opt->keyqueue_);
+    if(!aff)app_message(FATAL,"invalid regular expression for key: %s",keyregex);
+  }
+  struct proj_t*proj=NULL;                                            // original lines in flight (if only a field is sent to child processes)
+  if(projfield)proj=proj_ctor(projfield,opt->projdelim_,nslots,maxbatch>1?maxbatch:1);
+  struct replayrec_t*rrec=NULL;                                       // recorder of responses from child processes (if recording)
+  if(recordfile)rrec=replayrec_ctor(recordfile,nslots);               // ...
+  struct linetrace_t*lt=NULL;                                         // life cycle trace of sampled lines (if tracing lines)
+  if(linetracefile)lt=linetrace_ctor(linetracefile,opt->linetracesample_,startlineno,nslots);
+  for(size_t k=0;shards&&k<nthreads;++k)shard_start(shards[k]);       // kick off shard threads
+  // when running against a service we keep a copy of the line sent on each connection
+  // (if the connection fails we reconnect and resend the line)
+  // (the same goes for child processes forked by a zygote - if one exits the zygote forks a new one)
+  struct buf_t**svcsent=NULL;
+  if(svcaddr||zygote){
+    svcsent=emalloc(nsubprocesses*sizeof(struct buf_t*));
+    for(size_t i=0;i<nsubprocesses;++i)svcsent[i]=buf_ctor(WRBUF,maxbuf);
+  }
+  // #of failed attempts to reconnect each service connection
+  // (a disconnected connection is retried from a RECONNECT timer so the loop keeps serving the other connections)
+  size_t*svcnretries=NULL;
+  if(svcaddr)svcnretries=emalloc(nsubprocesses*sizeof(size_t));
   // setup a table mapping fd --> FILE* 
   // (we use this table to map fd's to FILE pointers to use when reading/writing)
   // (at the IO level it's up to the IO routines to choose between FILE* and fd's)
   // (for reading line it is simpler to use 'fgets()' instead of managing IO buffering our selves)
   int fd2fpmap_size=maxint(fdin,fdout);
-  for(size_t i=0;i<nsubprocesses;++i){
+  for(size_t i=0;i<nslots;++i){
     struct combuf*cb=combuftab_at(cbtab,i);
-    fd2fpmap_size=maxint(fd2fpmap_size,combuf_fd(cb));
+    if(combuf_fp(cb))fd2fpmap_size=maxint(fd2fpmap_size,combuf_fd(cb));
   }
   fd2fpmap_size+=1;
   FILE**fd2fpmap=emalloc(fd2fpmap_size*sizeof(FILE**));
@@ -151,12 +353,40 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
   // add entries into 'fd2fpmap'
   fd2fpmap[fdin]=efdopen(fdin,"rb");
   fd2fpmap[fdout]=efdopen(fdout,"wb");
-  for(size_t i=0;i<nsubprocesses;++i){
+  for(size_t i=0;i<nslots;++i){
     struct combuf*cb=combuftab_at(cbtab,i);
-    fd2fpmap[combuf_fd(cb)]=combuf_fp(cb);
+    if(combuf_fp(cb))fd2fpmap[combuf_fd(cb)]=combuf_fp(cb);
+  }
+  // when retiring idle child processes each idle child process has a timer
+  struct tmo_t**idletmos=NULL;
+  if(idleretire>0)idletmos=emalloc(nslots*sizeof(struct tmo_t*));
+  size_t nspawned=lazy?0:nslots;                                      // #of child processes started (if spawning on demand)
+  size_t nretired=0;                                                  // #of idle child processes retired
+  // when running with dedicated reader and writer threads, input is read and output is written by these threads
+  // (the writer thread handles transactions - this thread does the final commit once the writer is done)
+  struct reader_t*reader=NULL;
+  struct writer_t*writer=NULL;
+  struct gzout_t*gzout=NULL;
+  if(iothreads){
+    reader=reader_ctor(fd2fpmap[fdin],IOTHREAD_MAXLINES,mainwakefds[1],&mainsleeping);
+    if(gzoutlevel>0)gzout=gzout_ctor(fdout,gzoutlevel,skipoutputpos);  // writer compresses output
+    writer=writer_ctor(fdout,outIsSock,startlineno+skipnfirstlines,IOTHREAD_MAXLINES,txncommitnlines,txn,lasttxnlog,nexttxnlog,gzout,stats,mainwakefds[1],&mainsleeping);
+    reader_start(reader);
+    writer_start(writer);
+    reader2inq(reader,qin,maxinq,cbpool,fd2fpmap[fdin],recin);              // hand free combufs to reader
+    FD_CLR(fdin,&rdall_set);                                          // reader wakes us up when it has lines
+    FD_SET(mainwakefds[0],&rdall_set);                                // ...
   }
+  // pin this thread to a CPU
+  // (shard, reader and writer threads are already running and keep the CPU affinity para was started with)
+  if(cpuloop>=0)cpu_pinthread(cpuloop);
+
   // loop until nothing more to read/write ...
+  struct prof_t*prof=NULL;                                       // time spent in each phase of the loop (if profiling)
+  if(profile)prof=prof_ctor();                                   // ...
+  int redispatch=0;                                              // child processes became idle while we had lines ready for them
   while(1){                                                      // loop until we are not waiting for read or write anymore
+    if(prof)prof_phase(prof,PROF_OTHER,0);                       // (fd set bookkeeping at end of last iteration)
     fd_set rdset=rdall_set;                                      // grab current fd masks (read and write)
     fd_set wrset=wrall_set;                                      // ...
     int maxfd=maxinfdsets(&rdset,&wrset);                        // get max fd
@@ -164,97 +394,291 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
     sigset_t emptyset;                                           // signal mask to pass to pselect()
     sigemptyset(&emptyset);                                      // ...
     struct timespec*ptspec=tmoq_select_timeout(qtmo,&tspec);     // ... (returns null if timer queue is empty)
+    int nowait=redispatch;                                       // poll instead of sleeping in select() if we have work to do
+    if(iothreads){                                               // tell reader and writer threads we are going to sleep
+      __atomic_store_n(&mainsleeping,1,__ATOMIC_SEQ_CST);        // ... (they wake us up if they hand us something)
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);                   // ...
+      if(!inputeof&&inq_size(qin)<nsubprocesses&&reader_ready(reader))nowait=1;
+      if(outq_ready(qout)&&writer_room(writer))nowait=1;         // ...
+    }
+    if(nowait){                                                  // don't sleep
+      tspec.tv_sec=0;                                            // ...
+      tspec.tv_nsec=0;                                           // ...
+      ptspec=&tspec;                                             // ...
+    }
     int sstat=pselect(maxfd+1,&rdset,&wrset,0,ptspec,&emptyset); // do pselect() call ...
+    if(iothreads)__atomic_store_n(&mainsleeping,0,__ATOMIC_SEQ_CST);
+    if(prof){                                                    // time in pselect() is idle time
+      prof_phase(prof,PROF_SELECT,0);                            // ...
+      prof_iteration(prof);                                      // ...
+    }
 
     // check if we received a SIGCHLD signal
     // (can happen if exec() call fails)
     if(childExited)app_message(FATAL,"child process exited");
 
     // select() error
+    // (SIGCHLD from a retired child process interrupts pselect() - nothing happened so we go around again)
+    if(sstat<0&&errno==EINTR)continue;
     if(sstat<0)app_message(FATAL,"maxfd: %d, tv: %lu, %lu",maxfd,ptspec->tv_sec,ptspec->tv_nsec);
 
     // select() timeout
-    if(sstat==0){
+    // (a reconnect timer is also popped when it expired while other connections kept select() busy)
+    struct tmo_t*fronttmo=tmoq_front(qtmo);                      // ...
+    int reconnectdue=fronttmo&&tmo_type(fronttmo)==RECONNECT&&tmo_sec2tmo(fronttmo)<=(size_t)time(NULL);
+    if((sstat==0&&!nowait)||reconnectdue){
       struct tmo_t*tmo=tmoq_front(qtmo);                       // get popped timer and remove it from timer queue
       if(tmo==NULL)app_message(FATAL,"timer popped but no timer on tmo queue in para.cc");
       app_message(INFO,"timer popped, type: %s",tmo_type2str(tmo));
       tmoq_pop(qtmo);                                          // remove timer from queue
+      PARA_PROBE2(timer__fired,tmo_type(tmo),tmo_key(tmo));    // ...
       if(tmo_type(tmo)==HEARTBEAT){                            // did we get a heartbeat or a child timeout tmo?
         tmoq_push(qtmo,tmo_reactivate(tmo));                   // reactivate heartbeat timer
+        if(batches)logbatches(batches,nslots);                 // log current batch sizes
+        if(prof)prof_heartbeat(prof);                          // log time spent in each phase since last heartbeat
+      }else
+      if(tmo_type(tmo)==IDLE){                                 // child process has been idle long enough - retire it
+        size_t ind=tmo_key(tmo);                               // ...
+        struct combuf*cb=combuftab_at(cbtab,ind);              // ...
+        app_message(INFO,"retiring child process: %lu with pid: %d after %lu sec idle",ind,combuf_pid(cb),idleretire);
+        retirechild(cb,zygote!=NULL,&rdall_set,&wrall_set,fd2fpmap);
+        idletmos[ind]=NULL;                                    // ...
+        tmo_dtor(tmo);                                         // ...
+        ++nretired;                                            // ...
+      }else
+      if(tmo_type(tmo)==RECONNECT){                            // time to try reconnecting a disconnected service connection
+        size_t ind=tmo_key(tmo);                               // ...
+        struct combuf*cb=combuftab_at(cbtab,ind);              // ...
+        combuf_settmo(cb,NULL);                                // ...
+        tmo_dtor(tmo);                                         // ...
+        svcretry(cb,ind,svcaddr,&svcnretries[ind],qtmo,&wrall_set,&fd2fpmap,&fd2fpmap_size,stats);
       }else{                                                   // a child timedout ... we'll terminate since no point continuing
         size_t ind=tmo_key(tmo);                               // get combuf for child process that timed out
         struct combuf*cb=combuftab_at(cbtab,ind);              // ...
         app_message(FATAL,"child process timeout for pid: %d at input line: %d ... terminating",combuf_pid(cb),combuf_lineno(cb));
       }
     }
-    // (1) read data into input queue (select triggered on input fd)
+    // drain wakeups from other threads
+    if(mainwakefds[0]>=0&&FD_ISSET(mainwakefds[0],&rdset))edrain(mainwakefds[0]);
+    int profnextlineno=0;                                        // for counting lines read and dispatched (if profiling)
+    if(prof){                                                    // ...
+      prof_phase(prof,PROF_OTHER,0);                             // ...
+      profnextlineno=inq_nextlineno(qin);                        // ...
+    }
+
+    // (1) read data into input queue (select triggered on input fd, or lines handed to us by reader thread)
+    if(reader){
+      if(!inputeof)inputeof=reader2inq(reader,qin,maxinq,cbpool,fd2fpmap[fdin],recin);
+    }else
     if(FD_ISSET(fdin,&rdset)){
-      if(!inputeof)inputeof=readinq(qin,fd2fpmap[fdin],nsubprocesses,cbpool);
+      if(!inputeof)inputeof=readinq(qin,fd2fpmap[fdin],maxinq,cbpool,recin);
     }
     // (1.5) if we 'skipnfirstlines>0 remove 'skipnfirstlines' from input queue
     if(skipnfirstlines>0)skipnfirstlines-=inq_popnlines(qin,skipnfirstlines,cbpool);
+    if(lt)linetrace_read(lt,inq_nextlineno(qin));                // timestamp sampled lines read
+    size_t profinqsize=0;                                        // ...
+    if(prof){                                                    // ...
+      prof_phase(prof,PROF_READ,inq_nextlineno(qin)-profnextlineno);
+      profinqsize=inq_size(qin);                                 // ...
+    }
+
+    // (1.7) when running with shards, shards do steps (2) to (5) - collect processed lines and hand new lines to shards
+    if(shards){
+      shards2outq(shards,nthreads,qout,fd2fpmap[fdout]);         // move processed lines to output queue
+      inq2shards(qin,shards,nthreads);                           // hand lines to shards
+    }
 
     // (2) copy data from input queue into sub-process buffer
-    for(size_t i=0;i<nsubprocesses;++i){
+    // (the scheduler picks which idle sub-process gets the next line)
+    dispatch_clearidle(disp);                                    // collect idle sub-processes
+    for(size_t i=0;inq_dataready(qin)&&i<nslots;++i){            // ...
       struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process and check if we can write data to it
-      if(combuf_state(cb)!=CBWRITE)continue;                     // not a WRITE buffer
-      inq2cbtab(qin,cb,&wrall_set,cbpool);                       // transfer data from inq to child process if possible
+      if(combuf_state(cb)!=CBWRITE||!combuf_empty(cb))continue;  // not an idle WRITE buffer
+      if(!combuf_fp(cb))continue;                                // empty slot
+      dispatch_setidle(disp,i);                                  // ...
+    }
+    // (when spawning on demand, start child processes for lines that idle child processes cannot take)
+    for(size_t i=0;lazy&&inq_size(qin)>disp->nidle_&&i<nslots;++i){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // ...
+      if(combuf_fp(cb))continue;                                 // slot has a child process
+      startchild(cb,i,cfile,cargv,zygote,replay,cpuplace,&fd2fpmap,&fd2fpmap_size);
+      dispatch_setidle(disp,i);                                  // ...
+      ++nspawned;                                                // ...
     }
+    // (lines not selected and lines with a cached response go directly to the output queue, duplicates of lines in flight wait for their response)
+    // (with key affinity lines are instead handed to the child process owning their key)
+    if(aff)inq2affinity(qin,sel,aff,proj,cbtab,&wrall_set,svcsent,qout,cbpool,fd2fpmap[fdout]);
+    struct linekey_t key={0,0,0};                                // key of line at front of input queue (if caching or coalescing)
+    for(int i;!aff&&(sel||inf?inq2outq(qin,sel,inf,cache,qout,cbpool,fd2fpmap[fdout],&key):inq_dataready(qin))&&(i=dispatch_next(disp))>=0;){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // ...
+      if(inf)inflight_add(inf,i,key,buf_buf(combuf_buf(inq_front(qin))),buf_size(combuf_buf(inq_front(qin)))); // line is in flight on child process
+      if(batches){                                               // hand a batch of lines to child process
+        size_t nidle=disp->nidle_+1;                             // (spread lines evenly over idle child processes)
+        size_t nlines=batch_size(batches[i]);                    // ...
+        if(nlines>(inq_size(qin)+nidle-1)/nidle)nlines=(inq_size(qin)+nidle-1)/nidle;
+        if(outq_size(qout)>0&&!outq_ready(qout))nlines=(nlines+1)/2; // output is waiting for a line - keep batches short
+        batch_start(batches[i]);                                 // ...
+        if(proj)proj_project(proj,i,combuf_buf(inq_front(qin))); // ...
+        inq2cbtab(qin,cb,&wrall_set,cbpool);                     // ...
+        inq2batch(qin,batches[i],nlines,buf_size(combuf_buf(cb)),sel,inf,cache,proj,i,qout,cbpool,fd2fpmap[fdout]);
+        continue;
+      }
+      if(proj)proj_project(proj,i,combuf_buf(inq_front(qin)));   // send only projected field
+      inq2cbtab(qin,cb,&wrall_set,cbpool);                       // transfer data from inq to child process
+      if(svcsent)buf_copy(svcsent[i],combuf_buf(cb));            // keep a copy of line in case service connection fails
+    }
+    if(prof)prof_phase(prof,PROF_DISPATCH,profinqsize-inq_size(qin));
+
     // (3) write data stored in child process buffer + set timer for chile process if needed
-    for(size_t i=0;i<nsubprocesses;++i){
+    size_t profnwritten=0;                                       // #of lines completely written to child processes (if profiling)
+    for(size_t i=0;i<nslots;++i){
       struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process and check if we can write data to it
-      if(combuf_state(cb)!=CBWRITE)continue;                     // not a WRITE buffer
-      int complete=cbtabwrite(cb,&rdall_set,&wrall_set,&wrset,cbpool);// write data stored in child process buffer
+      if(combuf_state(cb)!=CBWRITE||!combuf_fp(cb))continue;     // not a WRITE buffer (or an empty slot)
+      if(rrec&&!combuf_empty(cb))replayrec_sending(rrec,i,combuf_buf(cb)); // hash of line for trace file
+      if(lt&&!combuf_empty(cb))linetrace_sending(lt,i,combuf_lineno(cb)); // ...
+      int complete=batches?cbtabwritebatch(cb,batches[i],&rdall_set,&wrall_set,&wrset,cbpool): // write data stored in child process buffer
+                           cbtabwrite(cb,&rdall_set,&wrall_set,&wrset,cbpool);
+      if((svcaddr||zygote)&&combuf_eof(cb)){                     // service closed connection (or forked child exited) - reconnect and resend line
+        svcreconnect(cb,i,svcaddr,zygote,svcsent[i],svcnretries?&svcnretries[i]:NULL,qtmo,&rdall_set,&wrall_set,&fd2fpmap,&fd2fpmap_size,stats);
+        continue;
+      }
+      if(combuf_eof(cb))app_message(FATAL,"child process with pid: %d closed its connection",combuf_pid(cb));
+      if(complete&&rrec)replayrec_written(rrec,i);               // ...
+      if(complete&&lt)linetrace_written(lt,combuf_lineno(cb));   // ...
+      profnwritten+=complete;                                    // ...
       if(complete){                                              // if we wrote a complete buffer, then set child timer
         struct tmo_t*client_tmo=tmo_ctor(CLIENT,client_tmo_sec,i);// the 'key' for timer is the index into 'cbtab'
         combuf_settmo(combuftab_at(cbtab,i),client_tmo);          // set tmo in combuf fro client process so that we can retrieve it ;ater
         tmoq_push(qtmo,client_tmo);                               // push timer on tmo queue
       }
     }
+    if(prof)prof_phase(prof,PROF_WRITE,profnwritten);
+
     // (4) read data into child process buffer + remove timer from child process if needed
-    for(size_t i=0;i<nsubprocesses;++i){
+    // (when batching, responses are moved to the output queue as they are read and the timer is removed once the whole batch is read)
+    int batchdone=0;                                             // ...
+    size_t profnread=0;                                          // #of complete responses read from child processes (if profiling)
+    for(size_t i=0;i<nslots;++i){
       struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process and check if we can write data to it
       if(combuf_state(cb)!=CBREAD)continue;                      // not a READ buffer
-      int complete=cbtabread(cb,&rdall_set,&rdset);              // read data into child process buffer
+      int complete=batches?cbtabreadbatch(qout,cb,batches[i],&rdall_set,&rdset,cbpool,fd2fpmap[fdout],inf,cache,proj,i): // read data into child process buffer
+                           cbtabread(cb,&rdall_set,&rdset);
+      if(complete&&batches&&inq_dataready(qin))batchdone=1;     // child becomes idle and we have lines for it
+      if((svcaddr||zygote)&&combuf_eof(cb)){                     // service closed connection (or forked child exited) - reconnect and resend line
+        svcreconnect(cb,i,svcaddr,zygote,svcsent[i],svcnretries?&svcnretries[i]:NULL,qtmo,&rdall_set,&wrall_set,&fd2fpmap,&fd2fpmap_size,stats);
+        continue;
+      }
+      profnread+=complete;                                       // ...
       if(complete){                                              // if we read a complete buffer then remove child timer
         struct combuf*cb=combuftab_at(cbtab,i);                  // deactivate client timer 
         struct tmo_t*client_tmo=combuf_tmo(cb);                  // ...
         tmoq_remove(qtmo,client_tmo);                            // remove timer from queue
         tmo_dtor(client_tmo);                                    // destroy timer
+        dispatch_done(disp,i);                                   // response time for scheduler
       }
     }
+    size_t profoutqsize=0;                                       // ...
+    if(prof){                                                    // ...
+      prof_phase(prof,PROF_READCHILD,profnread);                 // ...
+      profoutqsize=outq_size(qout);                              // ...
+    }
+
     // (5) copy data from sub process buffer to output queue
-    for(size_t i=0;i<nsubprocesses;++i){
+    redispatch=batchdone;                                        // ...
+    for(size_t i=0;i<nslots;++i){
       struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process and check if we can write data to it
       if(combuf_state(cb)!=CBREAD)continue;                      // not a READ buffer
+      if(combuf_rdcomplete(cb)&&inq_dataready(qin))redispatch=1; // child becomes idle and we have a line for it
+      if(combuf_rdcomplete(cb)&&aff&&affinity_nqueued(aff,i)>0)redispatch=1; // ...
+      if(rrec&&combuf_rdcomplete(cb))replayrec_response(rrec,i,combuf_buf(cb)); // record response in trace file
+      if(lt&&combuf_rdcomplete(cb))linetrace_response(lt,combuf_lineno(cb)); // ...
+      if(proj&&combuf_rdcomplete(cb))proj_splice(proj,i,combuf_buf(cb)); // splice response into original line
+      if(inf&&combuf_rdcomplete(cb))inflight2outq(inf,cache,i,cb,qout,cbpool,fd2fpmap[fdout]); // add response to cache and copy it to waiting lines
       cbtab2outq(qout,cb,&wrall_set,cbpool,fd2fpmap[fdout]);     // copy data from sub process buffer to output queue
     }
-    // (6) flush output queue (select() triggered on output fd)
+    // (start timers for child processes that became idle and stop timers for child processes that got lines)
+    for(size_t i=0;idletmos&&i<nslots;++i){
+      int idle=childidle(combuftab_at(cbtab,i),batches?batches[i]:NULL);
+      if(idle&&!idletmos[i]){                                    // ...
+        idletmos[i]=tmo_ctor(IDLE,idleretire,i);                 // ...
+        tmoq_push(qtmo,idletmos[i]);                             // ...
+      }else
+      if(!idle&&idletmos[i]){                                    // ...
+        tmoq_remove(qtmo,idletmos[i]);                           // ...
+        tmo_dtor(idletmos[i]);                                   // ...
+        idletmos[i]=NULL;                                        // ...
+      }
+    }
+    if(prof){                                                    // ...
+      prof_phase(prof,PROF_TOOUTQ,outq_size(qout)-profoutqsize); // ...
+      profoutqsize=outq_size(qout);                              // ...
+    }
+
+    // (6) flush output queue (select() triggered on output fd, or hand ready lines to writer thread)
+    if(writer){
+      outq2writer(qout,writer,cbpool,lt);
+    }else
     if(FD_ISSET(fdout,&wrset)){
-      if(!outputeof)outputeof=flushoutq(qout,cbpool,txncommitnlines,txn,lasttxnlog,nexttxnlog);
+      if(flushoutq(qout,fdout,outIsSock,cbpool,txncommitnlines,txn,lasttxnlog,nexttxnlog,NULL,stats,lt)){
+        app_message(FATAL,"output connection closed by peer");
+      }
     }
+    if(prof)prof_phase(prof,PROF_FLUSH,profoutqsize-outq_size(qout));
     // trigger on input in select()?
-    // (do not trigger if eof, trigger if there is partially read data or, if we have fewer than 'nsubprocesses' lines in input queue)
-    if(!inputeof&&(inq_partialrd(qin)||inq_size(qin)<nsubprocesses)){
+    // (do not trigger if eof, trigger if there is partially read data or, if we have fewer than 'maxinq' lines in input queue)
+    if(!reader&&!inputeof&&(inq_partialrd(qin)||inq_size(qin)<maxinq)){
       FD_SET(fdin,&rdall_set);
     }
     else{
       FD_CLR(fdin,&rdall_set);
     }
+    // trigger on wakeups from other threads in select()?
+    // (only while shards have lines in flight, reader has not reached eof or, writer has to take more lines)
+    if((shards&&shards_ninflight(shards,nthreads)>0)||(reader&&!inputeof)||(writer&&outq_ready(qout))){
+      FD_SET(mainwakefds[0],&rdall_set);
+    }
+    else
+    if(mainwakefds[0]>=0){
+      FD_CLR(mainwakefds[0],&rdall_set);
+    }
     // trigger on output in select()?
-    if(outq_ready(qout)){
+    if(!writer&&outq_ready(qout)){
       FD_SET(fdout,&wrall_set);
     }
     else{
       FD_CLR(fdout,&wrall_set);
     }
     // done?
-    if(maxinfdsets(&rdall_set,&wrall_set)<0&&inq_size(qin)==0&&outq_size(qout)==0){
+    // (a line queued on a disconnected service connection is still waiting to be resent)
+    if(maxinfdsets(&rdall_set,&wrall_set)<0&&inq_size(qin)==0&&outq_size(qout)==0&&(!aff||affinity_size(aff)==0)&&(!svcaddr||!svcqueued(cbtab))){
       break;
     }
   }
+  if(prof)prof_phase(prof,PROF_OTHER,0);                         // (loop ended)
+  for(size_t i=0;idletmos&&i<nslots;++i){                        // stop timers of idle child processes
+    if(!idletmos[i])continue;                                    // ...
+    tmoq_remove(qtmo,idletmos[i]);                               // ...
+    tmo_dtor(idletmos[i]);                                       // ...
+  }
+  free(idletmos);                                                // ...
+  for(size_t i=0;svcnretries&&i<nslots;++i){                     // stop reconnect timers of disconnected service connections
+    struct combuf*cb=combuftab_at(cbtab,i);                      // ...
+    if(combuf_fp(cb)||!combuf_tmo(cb))continue;                  // ...
+    tmoq_remove(qtmo,combuf_tmo(cb));                            // ...
+    tmo_dtor(combuf_tmo(cb));                                    // ...
+    combuf_settmo(cb,NULL);                                      // ...
+  }
   app_message(DEBUG,"#timers in queue: %d (expected: 1 HEARTBEAT timer)",qtmo->nel_);
 
+  // stop shards - they close connections to their child processes
+  for(size_t k=0;shards&&k<nthreads;++k)shard_stop(shards[k]);
+
+  // wait for writer thread to write remaining lines and for reader thread to terminate
+  // (writer ends the last gzip member if output is compressed)
+  if(writer)writer_stop(writer);
+  if(reader)reader_join(reader);
+  if(gzin)gzin_dtor(gzin);
+
   // we can do a final commit at this point
   // (txn will flush output file before committing)
   handle_txn(txncommitnlines,lasttxnlog,nexttxnlog,1,txn);
@@ -265,6 +689,26 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
   txnlog_dtor(lasttxnlog);             // destroy transaction log object
   txnlog_dtor(nexttxnlog);             // destroy transaction log object
 
+  // print statistics if requested
+  if(printstats){
+    fprintf(stderr,"stats: ");
+    stats_dump(stats,stderr,1);
+    if(cache)fprintf(stderr,"cache: hits: %lu, misses: %lu, entries: %lu, bytes: %lu\n",cache->nhits_,cache->nmisses_,cache->nents_,cache->used_);
+    if(coalesce)fprintf(stderr,"coalesced: %lu\n",inf->ncoalesced_);
+    if(aff)fprintf(stderr,"key affinity: input blocked by full child process queue: %lu times\n",aff->nblocked_);
+    if(proj)fprintf(stderr,"projection: bytes sent to child processes: %lu of %lu, lines without field: %lu\n",proj->nfieldbytes_,proj->nlinebytes_,proj->nmissing_);
+    if(rrec)fprintf(stderr,"recorded responses: %lu\n",rrec->nrecorded_);
+    if(replay)fprintf(stderr,"replay: lines not in trace (echoed): %lu\n",replay->nmisses_);
+    if(lt)fprintf(stderr,"line trace: traced lines: %lu\n",lt->ntraced_);
+    if(zygote)fprintf(stderr,"zygote: forked child processes: %lu\n",zygote->nforks_);
+    if(lazy)fprintf(stderr,"on demand: started child processes: %lu, retired: %lu\n",nspawned,nretired);
+    if(sel)fprintf(stderr,"selection: not processed: %lu (%s)\n",sel->nunselected_,sel->drop_?"dropped":"passed to output");
+  }
+  if(prof){                                                      // time spent in each phase of the loop
+    prof_dump(prof,stderr);                                      // ...
+    prof_dtor(prof);                                             // ...
+  }
+
   // close all FILE* in fd2fpmap
   app_message(DEBUG,"closing files ...");
   for(int i=0;i<fd2fpmap_size;++i){
@@ -273,36 +717,69 @@ void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_t
     efpclose(fp);
   }
   // wait for all child processes to terminate
-  // (all pid's in combufs in the combuf table are valid)
+  // (all pid's in combufs in the combuf table are valid unless we are connected to a service)
+  // (child processes forked by a zygote are reaped by the zygote - we wait for the zygote instead)
   app_message(DEBUG,"waiting for child processes ...");
   for(size_t i=0;i<combuftab_size(cbtab);++i){
     struct combuf*cb=combuftab_at(cbtab,i);
-    ewaitpid(combuf_pid(cb));
+    if(combuf_pid(cb)>=0&&!zygote)ewaitpid(combuf_pid(cb));
+  }
+  for(size_t i=0;i<nretiredpids;++i)ewaitpid(retiredpids[i]);  // retired child processes not yet reaped
+  nretiredpids=0;                                                // ...
+  if(zygote)zygote_dtor(zygote);                                 // zygote sees its control connection closed
+  if(replay)replay_dtor(replay);                                  // simulated child processes see their connections closed
+  if(shards){                                                    // shards wait for their child processes
+    for(size_t k=0;k<nthreads;++k)shard_dtor(shards[k]);         // ...
+    free(shards);                                                // ...
+  }
+  if(reader)reader_dtor(reader);                                 // reader and writer threads
+  if(writer)writer_dtor(writer);                                 // ...
+  if(mainwakefds[0]>=0){                                         // pipe used by other threads to wake us up
+    eclose(mainwakefds[0]);                                      // ...
+    eclose(mainwakefds[1]);                                      // ...
   }
   // cleanup allocated memory
   app_message(DEBUG,"cleaning up memory ...");
   free(fd2fpmap);                                                // free memory for table mapping fd --> FILE*
+  if(svcsent){                                                   // copies of lines sent to service
+    for(size_t i=0;i<nsubprocesses;++i)buf_dtor(svcsent[i]);     // ...
+    free(svcsent);                                               // ...
+  }
+  free(svcnretries);                                             // ...
   combuftab_dtor(cbtab);                                         // destroy child process table
+  dispatch_dtor(disp);                                           // scheduler
+  if(cache)cache_dtor(cache);                                    // cache (flushes cache file)
+  if(inf)inflight_dtor(inf);                                     // lines in flight
+  if(aff)affinity_dtor(aff);                                     // key affinity queues (empty at this point)
+  if(proj)proj_dtor(proj);                                       // original lines in flight (none at this point)
+  if(rrec)replayrec_dtor(rrec);                                  // trace file
+  if(lt)linetrace_dtor(lt);                                      // line trace file
+  if(batches){                                                   // batches
+    for(size_t i=0;i<nslots;++i)batch_dtor(batches[i]);          // ...
+    free(batches);                                               // ...
+  }
   tmoq_dtor(qtmo);                                               // cleanup time queue
   outq_dtor(qout);                                               // output queue
   inq_dtor(qin);                                                 // input queue
   combufpool_dtor(cbpool);                                       // pool of combufs
+  stats_dtor(stats);                                             // statistics
   app_message(DEBUG,"... cleanup done");
 }
 // read a line from input and store in input queue
 // (we must know we can read since if we read 0 bytes we'll interpret it as if we reached eof)
 // (returns 1 if eof reached, else false)
-int readinq(struct inq_t*qin,FILE*fpin,size_t maxlines,struct combufpool*cbpool){
+int readinq(struct inq_t*qin,FILE*fpin,size_t maxlines,struct combufpool*cbpool,struct rec_t*rec){
   int firsttime=1;
   struct combuf*cbin=0;                                       // buffer we are dealing with
   int isfreebuf=0;                                            // keep track of if the buffer we are dealing with is 'free' (not in queue) or in queue
-  while(inq_size(qin)<maxlines){                              // keep a fixed number of lines loaded in input queue
+  while(inq_size(qin)<maxlines||inq_partialrd(qin)){          // keep a fixed number of lines loaded in input queue (always complete a partially read line)
     isfreebuf=0;
     cbin=inq_back(qin);                                       // get last element in queue
     if(cbin==NULL||combuf_rdcomplete(cbin)){                  // get a new buffer if qin is empty or, last element in qin is complete
       isfreebuf=1;                                            // remember that the buffer is a 'free buffer', not in the queue
       cbin=combufpool_get(cbpool,fpin,CBREAD);                // get hold of a new combuf
       combuf_clear4rd(cbin);                                  // initialize from scratch
+      combuf_setrec(cbin,rec);                                // ...
     }
     size_t nread=combuf_read(cbin,firsttime);                 // read unless we reached eof
     if(nread==0)break;                                        // if we read 0 bytes we are done
@@ -327,37 +804,63 @@ int readinq(struct inq_t*qin,FILE*fpin,size_t maxlines,struct combufpool*cbpool)
   return combuf_eof(cbin);
 }
 // flush output queue as much as we can
-// (we stop when qout is closed (eof), qout is empty or we cannot write more data to output
-// (returns 1 if eof reached, else false)
-int flushoutq(struct outq_t*qout,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog){
-  int firsttime=1;                                           // must track if first time, since writing 0 bytes first time means eof
-  while(outq_ready(qout)){                                   // as long as we have a buffer with right line number ...
-    struct combuf*cbout=outq_front(qout);                    // get top of queue (we'll only have one entry in queue for right now)
-    size_t nwritten=0;
-    if(!combuf_eof(cbout))nwritten=combuf_write(cbout,firsttime);// write unless we reached eof on output
-    if(combuf_wrcomplete(cbout)){                            // if buffer is completly written pop it from queue
-      outq_pop(qout);                                        // ...
-      combufpool_putback(cbpool,cbout);                      // ...
+// (ready lines are written in batches using a single writev()/sendmsg() call per batch)
+// (we stop when qout has no more ready lines or output cannot accept more data - partially written lines stay in the write list)
+// (returns 1 if output is a socket that was closed by peer, else 0)
+int flushoutq(struct outq_t*qout,int fdout,int outIsSock,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats,struct linetrace_t*lt){
+  if(gzout)return flushoutqgz(qout,cbpool,txncommitnlines,txn,lasttxnlog,nexttxnlog,gzout,stats);
+  struct iovec iov[MAXIOV];                                  // one entry per line in write list
+  while(outq_fillwr(qout,MAXIOV)>0){                         // as long as we have lines in right line number order ...
+    int niov=0;                                              // setup io vector from write list
+    size_t nbytes=0;                                         // ...
+    for(struct combuf*cb=outq_wrfront(qout);cb;cb=cb->next_){// ...
+      struct buf_t*buf=combuf_buf(cb);                       // ...
+      iov[niov].iov_base=buf_bufwr(buf);                     // ...
+      if(lt)linetrace_flushing(lt,combuf_lineno(cb));        // ...
+      iov[niov].iov_len=buf_nconsume(buf);                   // ...
+      nbytes+=iov[niov++].iov_len;                           // ...
+    }
+    ssize_t wstat=ewritev(fdout,iov,niov,outIsSock);         // write as much as possible
+    if(wstat<0)return 1;                                     // peer closed connection
+    size_t nwritten=wstat;                                   // ...
+    ++stats->noutwrites_;                                    // ...
+    stats->noutbytes_+=nwritten;                             // ...
+    size_t nleft=nwritten;                                   // consume written bytes from combufs in write list
+    while(outq_wrsize(qout)>0){                              // ...
+      struct combuf*cbout=outq_wrfront(qout);                // ...
+      struct buf_t*buf=combuf_buf(cbout);                    // ...
+      size_t n=buf_nconsume(buf)<nleft?buf_nconsume(buf):nleft;
+      buf_consume(buf,n);                                    // ...
+      nleft-=n;                                              // ...
+      if(!combuf_wrcomplete(cbout))break;                    // partially written line stays at front of write list
+      outq_wrpop(qout);                                      // buffer completly written - pop it from write list
+      PARA_PROBE1(line__flush,combuf_lineno(cbout));         // ...
+      if(lt)linetrace_output(lt,combuf_lineno(cbout));       // ...
+      ++stats->nlinesout_;                                   // ...
       ++nexttxnlog->nlines_;                                 // increment #of full lines written
-      nexttxnlog->outfilepos_+=buf_size(combuf_buf(cbout));  // increment variable tracking position in output file
+      nexttxnlog->outfilepos_+=buf_size(buf);                // increment variable tracking position in output file
+      combufpool_putback(cbpool,cbout);                      // ...
       handle_txn(txncommitnlines,lasttxnlog,nexttxnlog,0,txn); // check if we need to commit transaction
     }
-    if(combuf_eof(cbout))return 1;                           // only the flag eof only if this is the first timeiun the loop since the first time we MUST be able tro write
-    if(nwritten==0)break;                                    // done - nothing written (we must be second or third ... time around
-    firsttime=0;                                             // ...
+    if(nwritten<nbytes){                                     // output cannot accept more data right now (backpressure)
+      ++stats->noutstalls_;                                  // ...
+      break;                                                 // wait for select() to trigger on output
+    }
   }
   return 0;
 }
 // transfer data from inq to child process if possible
-void inq2cbtab(struct inq_t*qin,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool){
-  if(!combuf_empty(cb))return;                              // if buffer is not empty then we are busy doing something with it
+// (returns true if a line was transferred, else false)
+int inq2cbtab(struct inq_t*qin,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool){
+  if(!combuf_empty(cb))return 0;                            // if buffer is not empty then we are busy doing something with it
   int fd=combuf_fd(cb);                                     // get fd to child process
-  if(!inq_dataready(qin))return;                            // if no data to get from qin, nothing to do
+  if(!inq_dataready(qin))return 0;                          // if no data to get from qin, nothing to do
   struct combuf*cbin=inq_front(qin);                        // get buffer from input queue
   combuf_swaprd4wr(cbin,cb);                                // swap internal input/output buffers
   inq_pop(qin);                                             // we are done with cbin from input queue
   combufpool_putback(cbpool,cbin);                          // put cbin back in pool
   FD_SET(fd,wrall_set);                                     // trigger on write next time around
+  return 1;
 }
 // write data waiting in child process combuf
 // (return true if complete buffer was written, else false)
@@ -366,6 +869,7 @@ int cbtabwrite(struct combuf*cb,fd_set*rdall_set,fd_set*wrall_set,fd_set*wrset,s
   if(!FD_ISSET(fd,wrset))return 0;                          // if we cannot write then nothing to do
   combuf_write(cb,1);                                       // we now have buffer for child process - write as much as possibly
   if(!combuf_wrcomplete(cb))return 0;                       // we did not write complete buffer - will continue next time around
+  PARA_PROBE2(line__dispatch,combuf_pid(cb),combuf_lineno(cb)); // ...
   combuf_clearwr2rd(cb);                                    // if we wrote complete buffer, then switch combuf to read mode
   FD_SET(fd,rdall_set);                                     // prepare to read from child process (trigger on read in select())
   FD_CLR(fd,wrall_set);                                     // we are done writing to child process - clear write select() flag
@@ -380,6 +884,7 @@ int cbtabread(struct combuf*cb,fd_set*rdall_set,fd_set*rdset){
   if(!FD_ISSET(fd,rdset))return 0;                            // if we cannot read then nothing to do here
   combuf_read(cb,1);                                          // read as much as possible
   if(!combuf_rdcomplete(cb))return 0;                         // return if we didn't read a complete line from child
+  PARA_PROBE2(line__reply,combuf_pid(cb),combuf_lineno(cb));  // ...
   FD_CLR(fd,rdall_set);                                       // if we completed buffer, turn off read flag
   return 1;
 }
@@ -391,6 +896,146 @@ void cbtab2outq(struct outq_t*qout,struct combuf*cb,fd_set*wrall_set,struct comb
   outq_push(qout,cbout);                                    // push it on output queue
   combuf_clear4wr(cb);                                      // clear child process buffer so we can write to it
 }
+// start a child process in an empty slot
+// (the slot keeps its combuf - only FILE* and pid change)
+// (the server loop keeps no fd --> FILE* map and passes NULL for 'fd2fpmap')
+void startchild(struct combuf*cb,size_t ind,char const*cfile,char**cargv,struct zygote_t*zygote,struct replay_t*replay,struct cpuplace_t*cpuplace,FILE***fd2fpmap,int*fd2fpmap_size){
+  struct intpair p;
+  if(replay)p=replay_spawn(replay);
+  else if(zygote)p=zygote_fork(zygote);
+  else p=spawn(cfile,cargv);
+  if(cpuplace&&p.first>=0)cpuplace_pin(cpuplace,ind,p.first); // spread child processes over CPUs
+  FILE*fp=efdopen(p.second,"rwb");                          // ...
+  if(fd2fpmap)fd2fpmap_set(fd2fpmap,fd2fpmap_size,p.second,fp);// ...
+  combuf_init(cb,fp,combuf_lineno(cb),CBWRITE);             // ...
+  combuf_setpid(cb,p.first);                                // ...
+  app_message(DEBUG,"started child process: %lu with pid: %d",ind,p.first);
+}
+// stop an idle child process and leave its slot empty
+// (the child process sees EOF on stdin and exits - the SIGCHLD handler reaps it without treating the exit as an error)
+// (child processes forked by a zygote are reaped by the zygote)
+void retirechild(struct combuf*cb,int zygoted,fd_set*rdall_set,fd_set*wrall_set,FILE**fd2fpmap){
+  int fd=combuf_fd(cb);                                     // close connection to child process
+  FD_CLR(fd,rdall_set);                                     // ...
+  FD_CLR(fd,wrall_set);                                     // ...
+  if(fd2fpmap)fd2fpmap[fd]=NULL;                            // ...
+  if(combuf_pid(cb)>=0&&!zygoted)addretired(combuf_pid(cb));// (before closing - the child may exit as soon as it sees EOF)
+  efpclose(combuf_fp(cb));                                  // ...
+  combuf_init(cb,NULL,combuf_lineno(cb),CBWRITE);           // ...
+  combuf_setpid(cb,-1);                                     // ...
+}
+// true if slot has a child process without lines in flight
+int childidle(struct combuf*cb,struct batch_t*batch){
+  if(!combuf_fp(cb)||combuf_state(cb)!=CBWRITE||!combuf_empty(cb))return 0;
+  return !batch||(batch_nwait(batch)==0&&!batch->pendfront_);
+}
+// remember pid of a retired child process
+void addretired(int pid){
+  if(nretiredpids==maxretiredpids){
+    maxretiredpids=maxretiredpids?2*maxretiredpids:16;
+    int*pids=emalloc(maxretiredpids*sizeof(int));
+    if(nretiredpids)memcpy(pids,retiredpids,nretiredpids*sizeof(int));
+    free(retiredpids);
+    retiredpids=pids;
+  }
+  retiredpids[nretiredpids++]=pid;
+}
+// forget pid of a retired child process - returns true if pid was retired
+int removeretired(int pid){
+  for(size_t i=0;i<nretiredpids;++i){
+    if(retiredpids[i]!=pid)continue;
+    retiredpids[i]=retiredpids[--nretiredpids];
+    return 1;
+  }
+  return 0;
+}
+// reconnect a service connection that was closed by the service
+// (if a line was in flight on the connection it is resent on the new connection)
+// (a service we cannot reconnect to right away leaves the connection disconnected with the line queued - see 'svcretry()')
+// (when using a zygote the connection was closed because the child process exited - the zygote forks a new child process)
+void svcreconnect(struct combuf*cb,size_t ind,char const*svcaddr,struct zygote_t*zygote,struct buf_t*sent,size_t*nretries,struct priq*qtmo,fd_set*rdall_set,fd_set*wrall_set,FILE***fd2fpmap,int*fd2fpmap_size,struct stats_t*stats){
+  int inflight=combuf_state(cb)==CBREAD||!combuf_empty(cb);// line sent (or being sent) on connection
+  int lineno=combuf_lineno(cb);                             // line number of line in flight
+  int oldfd=combuf_fd(cb);                                  // close old connection
+  FD_CLR(oldfd,rdall_set);                                  // ...
+  FD_CLR(oldfd,wrall_set);                                  // ...
+  (*fd2fpmap)[oldfd]=NULL;                                  // ...
+  efpclose(combuf_fp(cb));                                  // ...
+  struct tmo_t*tmo=combuf_tmo(cb);                          // remove timer if we were waiting for a response
+  if(tmo){                                                  // ...
+    tmoq_remove(qtmo,tmo);                                  // ...
+    tmo_dtor(tmo);                                          // ...
+  }
+  combuf_clear4wr(cb);                                      // connection is disconnected - line in flight stays queued in combuf
+  combuf_init(cb,NULL,lineno,CBWRITE);                      // ...
+  if(inflight)buf_copy(combuf_buf(cb),sent);                // ...
+  if(!zygote){                                              // reconnect to service
+    app_message(WARNING,"service connection: %lu to: %s closed, reconnecting ...",ind,svcaddr);
+    *nretries=0;                                            // ...
+    svcretry(cb,ind,svcaddr,nretries,qtmo,wrall_set,fd2fpmap,fd2fpmap_size,stats);
+    return;
+  }
+  app_message(WARNING,"child process: %lu with pid: %d exited, forking a new one from zygote ...",ind,combuf_pid(cb));
+  if(inflight&&lineno==zygote->exitlineno_){                // give up on a line that keeps killing child processes
+    if(++zygote->nexits_>=ZYGOTE_MAXEXITS)app_message(FATAL,"line: %d killed %d child processes in a row ... terminating",lineno,ZYGOTE_MAXEXITS);
+  }else if(inflight){                                       // ...
+    zygote->exitlineno_=lineno;                             // ...
+    zygote->nexits_=1;                                      // ...
+  }
+  struct intpair p=zygote_fork(zygote);                     // fork a new child process from zygote
+  combuf_setpid(cb,p.first);                                // ...
+  setfdnonblock(p.second);                                  // setup new connection
+  FILE*fp=efdopen(p.second,"rwb");                          // ...
+  fd2fpmap_set(fd2fpmap,fd2fpmap_size,p.second,fp);         // ...
+  combuf_init(cb,fp,lineno,CBWRITE);                        // ...
+  if(inflight){                                             // resend line that was in flight
+    FD_SET(p.second,wrall_set);                             // ...
+    app_message(WARNING,"resending line: %d on child process: %lu",lineno,ind);
+  }
+  ++stats->nreconnects_;
+}
+// try to reconnect a disconnected service connection
+// (on failure a RECONNECT timer keyed by the connection retries in 'SVC_RETRYSEC' seconds - we never block the loop waiting for a service)
+// (a line queued in the combuf while disconnected is resent on the new connection)
+void svcretry(struct combuf*cb,size_t ind,char const*svcaddr,size_t*nretries,struct priq*qtmo,fd_set*wrall_set,FILE***fd2fpmap,int*fd2fpmap_size,struct stats_t*stats){
+  int fd=connectaddr(svcaddr);                              // reconnect
+  if(fd<0){                                                 // retry later
+    if(++*nretries>=SVC_MAXRETRY)app_message(FATAL,"failed reconnecting to service: %s after %d attempts, errno: %d, errstr: %s",svcaddr,SVC_MAXRETRY,errno,strerror(errno));
+    app_message(WARNING,"failed reconnecting service connection: %lu to: %s, retrying in %d sec ...",ind,svcaddr,SVC_RETRYSEC);
+    struct tmo_t*tmo=tmo_ctor(RECONNECT,SVC_RETRYSEC,ind);  // ...
+    combuf_settmo(cb,tmo);                                  // ...
+    tmoq_push(qtmo,tmo);                                    // ...
+    return;
+  }
+  setfdnonblock(fd);                                        // setup new connection
+  FILE*fp=efdopen(fd,"rwb");                                // ...
+  fd2fpmap_set(fd2fpmap,fd2fpmap_size,fd,fp);               // ...
+  combuf_init(cb,fp,combuf_lineno(cb),CBWRITE);             // ...
+  if(!combuf_empty(cb)){                                    // resend line that was in flight
+    FD_SET(fd,wrall_set);                                   // ...
+    app_message(WARNING,"resending line: %d on service connection: %lu",combuf_lineno(cb),ind);
+  }
+  ++stats->nreconnects_;
+}
+// true if a line is queued on a disconnected service connection
+int svcqueued(struct combuftab*cbtab){
+  for(size_t i=0;i<combuftab_size(cbtab);++i){
+    struct combuf*cb=combuftab_at(cbtab,i);
+    if(!combuf_fp(cb)&&!combuf_empty(cb))return 1;
+  }
+  return 0;
+}
+// register fd --> FILE* in map (extend map if needed)
+void fd2fpmap_set(FILE***fd2fpmap,int*fd2fpmap_size,int fd,FILE*fp){
+  if(fd>=*fd2fpmap_size){                                   // extend map
+    FILE**newmap=emalloc((fd+1)*sizeof(FILE*));             // ...
+    memcpy(newmap,*fd2fpmap,*fd2fpmap_size*sizeof(FILE*));  // ...
+    free(*fd2fpmap);                                        // ...
+    *fd2fpmap=newmap;                                       // ...
+    *fd2fpmap_size=fd+1;                                    // ...
+  }
+  (*fd2fpmap)[fd]=fp;
+}
 // commit transaction
 static void handle_txn(size_t txncommitnlines,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,int forcecommit,struct txn_t*txn){
   if(!txn)return;                                                                 // check if txn is enabled
@@ -402,3 +1047,256 @@ static void handle_txn(size_t txncommitnlines,struct txnlog_t*lasttxnlog,struct
     txnlog_setoutfilepos(lasttxnlog,txnlog_outfilepos(nexttxnlog));               // ...
   }
 }
+// hand lines from input queue to shards
+// (each line goes to the shard with the fewest lines in flight)
+static void inq2shards(struct inq_t*qin,struct shard_t**shards,size_t nshards){
+  char sent[nshards];                                       // shards we handed lines to
+  memset(sent,0,nshards);                                   // ...
+  while(inq_dataready(qin)){                                // while we have complete lines
+    size_t best=nshards;                                    // find least loaded shard that can take a line
+    for(size_t k=0;k<nshards;++k){                          // ...
+      struct shard_t*shard=shards[k];                       // ...
+      if(shard_ninflight(shard)>=shard->maxinflight_)continue;
+      if(best==nshards||shard_ninflight(shard)<shard_ninflight(shards[best]))best=k;
+    }
+    if(best==nshards)break;                                 // all shards are busy
+    struct combuf*cb=inq_front(qin);                        // hand line to shard
+    inq_pop(qin);                                           // (unlink before handing it over - shard owns it once it is sent)
+    shard_send(shards[best],cb);                            // ...
+    sent[best]=1;                                           // ...
+  }
+  for(size_t k=0;k<nshards;++k){                            // wake up shards we handed lines to
+    if(sent[k])shard_wake(shards[k]);                       // ...
+  }
+}
+// move lines processed by shards to output queue
+// (a processed line comes back in the combuf that carried it to the shard)
+static void shards2outq(struct shard_t**shards,size_t nshards,struct outq_t*qout,FILE*fpout){
+  for(size_t k=0;k<nshards;++k){
+    struct combuf*cb;
+    while((cb=shard_recv(shards[k]))!=NULL){
+      combuf_init(cb,fpout,combuf_lineno(cb),CBWRITE);      // combuf now belongs to output
+      outq_push(qout,cb);                                   // ...
+    }
+  }
+}
+// #of lines handed to shards not yet returned
+static size_t shards_ninflight(struct shard_t**shards,size_t nshards){
+  size_t ret=0;
+  for(size_t k=0;k<nshards;++k)ret+=shard_ninflight(shards[k]);
+  return ret;
+}
+// move lines from reader thread to input queue
+// (keeps reader supplied with free combufs, returns true once all input has been received)
+static int reader2inq(struct reader_t*reader,struct inq_t*qin,size_t maxlines,struct combufpool*cbpool,FILE*fpin,struct rec_t*rec){
+  struct combuf*cb;
+  while(inq_size(qin)<maxlines&&(cb=reader_recv(reader))!=NULL){ // move complete lines to input queue
+    inq_push(qin,cb);                                           // ...
+  }
+  while(reader_wantfree(reader)){                               // replace combufs we got from reader
+    struct combuf*cb=combufpool_get(cbpool,fpin,CBREAD);        // ...
+    combuf_setrec(cb,rec);                                      // ...
+    reader_putfree(reader,cb);                                  // ...
+  }
+  reader_kick(reader);                                          // ...
+  return reader_done(reader);
+}
+// move ready lines from output queue to writer thread
+// (combufs already written by writer are put back in pool)
+static void outq2writer(struct outq_t*qout,struct writer_t*writer,struct combufpool*cbpool,struct linetrace_t*lt){
+  struct combuf*cb;
+  while((cb=writer_recv(writer))!=NULL){                        // put written combufs back in pool
+    combufpool_putback(cbpool,cb);                              // ...
+  }
+  int sent=0;                                                   // hand lines in line number order to writer
+  while(writer_cansend(writer)&&outq_fillwr(qout,1)>0){        // ...
+    struct combuf*cb=outq_wrfront(qout);                        // ...
+    outq_wrpop(qout);                                           // (unlink before handing it over - writer owns it once it is sent)
+    if(lt)linetrace_output(lt,combuf_lineno(cb));               // (traced lines end when handed to writer)
+    writer_send(writer,cb);                                     // ...
+    sent=1;                                                     // ...
+  }
+  if(sent)writer_kick(writer);
+}
+// flush output queue through gzip compression
+// (output fd is blocking - only called from the writer thread)
+// (a gzip member ends at each commit point so the committed output position is at a member boundary)
+static int flushoutqgz(struct outq_t*qout,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats){
+  size_t startpos=gzout_pos(gzout);                          // track #of compressed bytes written
+  while(outq_fillwr(qout,MAXIOV)>0){                         // as long as we have lines in right line number order ...
+    while(outq_wrsize(qout)>0){                              // compress lines in write list
+      struct combuf*cbout=outq_wrfront(qout);                // ...
+      struct buf_t*buf=combuf_buf(cbout);                    // ...
+      gzout_write(gzout,buf_bufwr(buf),buf_nconsume(buf));   // ...
+      outq_wrpop(qout);                                      // ...
+      PARA_PROBE1(line__flush,combuf_lineno(cbout));         // ...
+      ++stats->nlinesout_;                                   // ...
+      ++nexttxnlog->nlines_;                                 // increment #of full lines written
+      combufpool_putback(cbpool,cbout);                      // ...
+      if(txn&&nexttxnlog->nlines_%txncommitnlines==0){       // end member at commit point and commit compressed position
+        nexttxnlog->outfilepos_=gzout_endmember(gzout);      // ...
+      }
+      handle_txn(txncommitnlines,lasttxnlog,nexttxnlog,0,txn); // check if we need to commit transaction
+    }
+  }
+  if(gzout_pos(gzout)>startpos)++stats->noutwrites_;         // ...
+  stats->noutbytes_+=gzout_pos(gzout)-startpos;              // ...
+  return 0;
+}
+// move lines from input queue to a batch
+// (the first line in the batch has already been moved to the child process combuf, 'nbytes' is its size)
+// (lines not selected and lines with a cached response go directly to the output queue, duplicates of lines in flight wait for their response)
+static void inq2batch(struct inq_t*qin,struct batch_t*batch,size_t nlines,size_t nbytes,struct sel_t*sel,struct inflight_t*inf,struct cache_t*cache,struct proj_t*proj,size_t slot,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout){
+  struct linekey_t key={0,0,0};                               // ...
+  for(size_t n=1;n<nlines&&(sel||inf?inq2outq(qin,sel,inf,cache,qout,cbpool,fpout,&key):inq_dataready(qin));++n){
+    struct combuf*cb=inq_front(qin);                          // ...
+    nbytes+=buf_size(combuf_buf(cb));                         // stop when batch would be too large
+    if(nbytes>BATCH_MAXBYTES)break;                           // ...
+    if(inf)inflight_add(inf,slot,key,buf_buf(combuf_buf(cb)),buf_size(combuf_buf(cb))); // ...
+    inq_pop(qin);                                             // ...
+    if(proj)proj_project(proj,slot,combuf_buf(cb));           // ...
+    batch_pend(batch,cb);                                     // ...
+  }
+}
+// write lines in a batch to child process
+// (lines are swapped into the child process combuf one by one, returns true once the whole batch was written)
+static int cbtabwritebatch(struct combuf*cb,struct batch_t*batch,fd_set*rdall_set,fd_set*wrall_set,fd_set*wrset,struct combufpool*cbpool){
+  int fd=combuf_fd(cb);                                       // get fd to child process
+  if(!FD_ISSET(fd,wrset))return 0;                            // if we cannot write then nothing to do
+  while(1){                                                   // write as many lines as possible
+    combuf_write(cb,1);                                       // ...
+    if(!combuf_wrcomplete(cb))return 0;                       // we did not write complete line - will continue next time around
+    batch_sent(batch,combuf_lineno(cb));                      // line is waiting for response
+    PARA_PROBE2(line__dispatch,combuf_pid(cb),combuf_lineno(cb)); // ...
+    struct combuf*next=batch_nextpend(batch);                 // move next line into child process combuf
+    if(!next)break;                                           // ...
+    combuf_swaprd4wr(next,cb);                                // ...
+    combufpool_putback(cbpool,next);                          // ...
+  }
+  combuf_clearwr2rd(cb);                                      // whole batch written, switch combuf to read mode
+  FD_SET(fd,rdall_set);                                       // ...
+  FD_CLR(fd,wrall_set);                                       // ...
+  return 1;
+}
+// read responses for a batch into output queue
+// (we keep reading until no more data is available since complete lines may already be buffered in the FILE*)
+// (returns true once the response for the last line in the batch was read)
+static int cbtabreadbatch(struct outq_t*qout,struct combuf*cb,struct batch_t*batch,fd_set*rdall_set,fd_set*rdset,struct combufpool*cbpool,FILE*fpout,struct inflight_t*inf,struct cache_t*cache,struct proj_t*proj,size_t slot){
+  int fd=combuf_fd(cb);                                       // get fd to child process
+  if(!FD_ISSET(fd,rdset))return 0;                            // if we cannot read then nothing to do here
+  struct tmo_t*tmo=combuf_tmo(cb);                            // timer covers the whole batch (clearing combuf resets it)
+  while(!combuf_eof(cb)){                                     // read as many responses as possible
+    combuf_read(cb,1);                                        // ...
+    if(!combuf_rdcomplete(cb))return 0;                       // no complete line
+    combuf_setlineno(cb,batch_received(batch));               // response belongs to oldest line waiting for a response
+    PARA_PROBE2(line__reply,combuf_pid(cb),combuf_lineno(cb)); // ...
+    if(proj)proj_splice(proj,slot,combuf_buf(cb));            // splice response into original line
+    if(inf)inflight2outq(inf,cache,slot,cb,qout,cbpool,fpout); // add response to cache and copy it to waiting lines
+    cbtab2outq(qout,cb,NULL,cbpool,fpout);                    // move response to output queue (combuf is now an empty CBWRITE combuf)
+    if(batch_nwait(batch)==0)break;                           // ...
+    combuf_clearwr2rd(cb);                                    // more responses to read
+    combuf_settmo(cb,tmo);                                    // ...
+  }
+  combuf_settmo(cb,tmo);                                      // ...
+  if(batch_nwait(batch)>0)return 0;                           // ...
+  FD_CLR(fd,rdall_set);                                       // whole batch read, turn off read flag
+  return 1;
+}
+// log current batch sizes
+static void logbatches(struct batch_t**batches,size_t nslots){
+  char line[1024];
+  int n=0;
+  for(size_t i=0;i<nslots&&n<(int)sizeof(line)-16;++i){
+    n+=snprintf(line+n,sizeof(line)-n,"%s%lu",i?" ":"",batch_size(batches[i]));
+  }
+  app_message(INFO,"batch sizes: %s",line);
+}
+// move lines not needing a child process from input queue to output queue
+// (lines not selected go unchanged - or empty if dropped - to the output queue so output stays aligned with input)
+// (lines with a cached response go to the output queue, duplicates of a line in flight are dropped and wait for its response)
+// (returns true if there is a line ready to be handed to a child process - 'key' is set to its key)
+static int inq2outq(struct inq_t*qin,struct sel_t*sel,struct inflight_t*inf,struct cache_t*cache,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout,struct linekey_t*key){
+  while(inq_dataready(qin)){
+    struct combuf*cb=inq_front(qin);                          // line at front of input queue
+    struct buf_t*buf=combuf_buf(cb);                          // ...
+    if(sel&&!sel_selected(sel,combuf_lineno(cb),buf_buf(buf),buf_size(buf))){
+      if(sel->drop_)buf_reset(buf,RDBUF);                     // nothing is written for a dropped line
+      struct combuf*cbout=combufpool_get(cbpool,fpout,CBWRITE); // move line to output queue
+      combuf_swaprd4wr(cb,cbout);                             // ...
+      inq_pop(qin);                                           // ...
+      combufpool_putback(cbpool,cb);                          // ...
+      outq_push(qout,cbout);                                  // ...
+      continue;                                               // ...
+    }
+    if(!inf)return 1;                                         // line goes to a child process
+    *key=inflight_key(inf,combuf_lineno(cb),buf_buf(buf),buf_size(buf));
+    if(inflight_wait(inf,*key,combuf_lineno(cb),buf_buf(buf),buf_size(buf))){           // duplicate of a line in flight - wait for its response
+      inq_pop(qin);                                           // ...
+      combufpool_putback(cbpool,cb);                          // ...
+      continue;                                               // ...
+    }
+    struct cacheent_t*ent=cache?cache_lookup(cache,combuf_lineno(cb),*key):NULL;
+    if(!ent||ent->outlen_>buf_maxbuf(buf))return 1;           // not cached - line goes to a child process
+    buf_reset(buf,RDBUF);                                     // replace line by cached response
+    memcpy(buf_bufrd(buf),ent->out_,ent->outlen_);            // ...
+    buf_add(buf,ent->outlen_);                                // ...
+    struct combuf*cbout=combufpool_get(cbpool,fpout,CBWRITE); // move response to output queue
+    combuf_swaprd4wr(cb,cbout);                               // ...
+    inq_pop(qin);                                             // ...
+    combufpool_putback(cbpool,cb);                            // ...
+    outq_push(qout,cbout);                                    // ...
+  }
+  return 0;
+}
+// hand lines to child processes owning their keys
+// (lines move from the input queue to the queue of the child process owning their key - a full queue stops the input queue)
+static void inq2affinity(struct inq_t*qin,struct sel_t*sel,struct affinity_t*aff,struct proj_t*proj,struct combuftab*cbtab,fd_set*wrall_set,struct buf_t**svcsent,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout){
+  struct linekey_t key;                                       // (not used)
+  while(sel?inq2outq(qin,sel,NULL,NULL,qout,cbpool,fpout,&key):inq_dataready(qin)){
+    struct combuf*cb=inq_front(qin);                          // queue line for child process owning its key
+    struct buf_t*buf=combuf_buf(cb);                          // ...
+    if(!affinity_push(aff,affinity_slot(aff,buf_buf(buf),buf_size(buf)),cb))break;
+    inq_pop(qin);                                             // ...
+  }
+  for(size_t i=0;i<combuftab_size(cbtab);++i){                // hand queued lines to idle child processes
+    struct combuf*cb=combuftab_at(cbtab,i);                   // ...
+    if(combuf_state(cb)!=CBWRITE||!combuf_empty(cb))continue; // child process is busy
+    if(!combuf_fp(cb))continue;                               // service connection is being reestablished
+    struct combuf*cbin=affinity_pop(aff,i);                   // ...
+    if(!cbin)continue;                                        // no lines for child process
+    if(proj)proj_project(proj,i,combuf_buf(cbin));            // send only projected field
+    combuf_swaprd4wr(cbin,cb);                                // swap internal input/output buffers
+    combufpool_putback(cbpool,cbin);                          // ...
+    FD_SET(combuf_fd(cb),wrall_set);                          // trigger on write next time around
+    if(svcsent)buf_copy(svcsent[i],combuf_buf(cb));           // keep a copy of line in case service connection fails
+  }
+}
+// response was read from child process - add it to cache and copy it to lines waiting for it
+// (must be called before the response is moved out of the child process combuf)
+static void inflight2outq(struct inflight_t*inf,struct cache_t*cache,size_t slot,struct combuf*cb,struct outq_t*qout,struct combufpool*cbpool,FILE*fpout){
+  struct linekey_t key;                                       // key of line the response belongs to
+  struct inflightent_t*ent=inflight_done(inf,slot,&key);      // ...
+  struct buf_t*buf=combuf_buf(cb);                            // ...
+  if(cache)cache_completed(cache,key,buf_buf(buf),buf_size(buf));
+  if(!ent)return;                                             // ...
+  for(size_t k=0;k<ent->nwaiters_;++k){                       // copy response to each waiting line
+    struct combuf*cbout=combufpool_get(cbpool,fpout,CBWRITE); // ...
+    buf_copy(combuf_buf(cbout),buf);                          // ...
+    buf_rd2wr(combuf_buf(cbout));                             // ...
+    combuf_setlineno(cbout,ent->waiters_[k]);                 // ...
+    outq_push(qout,cbout);                                    // ...
+  }
+  inflight_release(inf,ent);                                  // ...
+}
+// command line as a single string
+static char*cmdline2str(char const*cfile,char**cargv){
+  size_t len=strlen(cfile)+1;
+  for(char**p=cargv;*p;++p)len+=strlen(*p)+1;
+  char*ret=emalloc(len);
+  strcpy(ret,cfile);
+  for(char**p=cargv;*p;++p){
+    strcat(ret," ");
+    strcat(ret,*p);
+  }
+  return ret;
+}
@@ -1,10 +1,96 @@
 // (C) Copyright Hans Ewetz 2019. All rights reserved.
 #pragma once
+#include "dispatch.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/select.h>
+
+// forward decl
+struct inq_t;
+struct outq_t;
+struct combuf;
+struct combufpool;
+struct txn_t;
+struct txnlog_t;
+struct gzout_t;
+struct rec_t;
+struct sel_t;
+struct replay_t;
+struct stats_t;
+struct linetrace_t;
+struct cpuplace_t;
+struct zygote_t;
+
+// parameters controlling the main loop
+struct paraopt_t{
+  char const*cfile_;                    // command to execute in child processes
+  char**cargv_;                         // command line arguments for child processes
+  char const*svcaddr_;                  // if not NULL, connect to service at this network address instead of spawning child processes
+  size_t nsubprocesses_;                // #of child processes (or service connections)
+  size_t client_tmo_sec_;               // timeout in seconds waiting for response from a child process
+  size_t heart_sec_;                    // heartbeat in seconds
+  size_t maxoutq_;                      // max size of output queue
+  size_t outqinc_;                      // increment when extending output queue
+  size_t maxbuf_;                       // max length of a line in bytes
+  int startlineno_;                     // line number for first line
+  int fdin_;                            // input fd
+  int fdout_;                           // output fd
+  size_t txncommitnlines_;              // commit every 'txncommitnlines' - if 0, no commits are executed
+  char const*txnlogfile_;               // name of transaction log
+  int recoveryenabled_;                 // recovery mode enabled
+  int outIsPositionable_;               // true if we can position in output
+  int outIsSyncable_;                   // true if we can sync output to disk
+  int printstats_;                      // print statistics at end of processing
+  size_t nthreads_;                     // #of event loop threads driving child processes (1: everything runs in a single thread)
+  int iothreads_;                       // read input and write output on dedicated threads
+  int gzinput_;                         // decompress input on a separate thread (gzip compressed regular files are detected automatically)
+  int gzoutlevel_;                      // if > 0, gzip compress output using this compression level (requires writer thread)
+  enum dispatchpolicy_t dispatchpolicy_;// policy choosing which idle child process gets the next line
+  size_t maxbatch_;                     // max #of lines handed to a child process in one dispatch (0 or 1: no batching)
+  double batchtarget_;                  // target response time in seconds for a batch (0: fixed batch size 'maxbatch_')
+  size_t cachebudget_;                  // max #of bytes used by cache of responses for repeated input lines (0: no cache)
+  char const*cachefile_;                // if not NULL, cached responses are loaded from and appended to this file
+  int coalesce_;                        // if true, duplicates of a line in flight wait for its response instead of going to a child process
+  struct rec_t*recin_;                  // record framing of input (NULL: LF terminated lines)
+  struct rec_t*recchild_;               // record framing of responses from child processes (NULL: LF terminated lines)
+  struct sel_t*sel_;                    // selection of lines to process (NULL: all lines)
+  size_t keyfield_;                     // if > 0, route lines to child processes by key in this field (1: first field)
+  char keydelim_;                       // field delimiter for 'keyfield_'
+  char const*keyregex_;                 // if not NULL, route lines to child processes by key matching this regular expression
+  size_t keyqueue_;                     // max #of lines queued per child process when routing by key
+  size_t projfield_;                    // if > 0, send only this field to child processes and splice responses back into lines (1: first field)
+  char projdelim_;                      // field delimiter for 'projfield_'
+  char const*recordfile_;               // if not NULL, record responses from child processes and their timing in this trace file
+  struct replay_t*replay_;              // if not NULL, child processes are replaced by simulated child processes answering from a trace file
+  char const*linetracefile_;            // if not NULL, write life cycle of sampled lines to this trace file (Chrome trace event format)
+  int linetracesample_;                 // trace every 'linetracesample_' line
+  int profile_;                         // account time spent in each phase of the main loop, log it on heartbeats and print it at exit
+  int cpuloop_;                         // if >= 0, pin main loop to this CPU
+  struct cpuplace_t*cpuplace_;          // if not NULL, pin child processes to CPUs
+  int zygote_;                          // spawn 'cfile_' once as a zygote and let it fork child processes
+  int lazy_;                            // spawn child processes on demand instead of at startup
+  size_t idleretire_;                   // if > 0, retire child processes idle for this many seconds (implies 'lazy_')
+};
 
 // get recovery info
 void recoveryinfo(char const*txnlogfile,size_t*skipnfirstlines,size_t*skipoutputpos);
 
 // main loop in para
 // (loops around a 'pseleect()' system call)
-void paraloop(char const*cfile,char*cargv[],size_t nsubprocesses,size_t client_tmo_sec,size_t heart_sec,size_t maxoutq,size_t incoutq,size_t maxbuf,int startlineno,int fdin,int fdout,size_t txncommitnlines,char const*txnlog,int recoveryenabled,int outIsPositionable,int outIsSyncabl);
+void paraloop(struct paraopt_t const*opt);
+
+// helper methods implementing the steps in the main loop
+// (also used by the server loop)
+int readinq(struct inq_t*qin,FILE*fpin,size_t maxlines,struct combufpool*cbpool,struct rec_t*rec);       // read lines from input
+int flushoutq(struct outq_t*qout,int fdout,int outIsSock,struct combufpool*cbpool,size_t txncommitnlines,struct txn_t*txn,struct txnlog_t*lasttxnlog,struct txnlog_t*nexttxnlog,struct gzout_t*gzout,struct stats_t*stats,struct linetrace_t*lt);// flush output queue
+int inq2cbtab(struct inq_t*qin,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool);              // transfer data from inq to child process write buffer
+int cbtabread(struct combuf*cb,fd_set*rdall_set,fd_set*fdrd);                                            // read data into sub process buffer
+int cbtabwrite(struct combuf*cb,fd_set*rdall_set,fd_set*wrall_set,fd_set*wrset,struct combufpool*cbpool);// write data in sub process buffer
+void cbtab2outq(struct outq_t*qout,struct combuf*cb,fd_set*wrall_set,struct combufpool*cbpool,FILE*fpout);// copy sub process buffer to output queue
+void startchild(struct combuf*cb,size_t ind,char const*cfile,char**cargv,struct zygote_t*zygote,struct replay_t*replay,struct cpuplace_t*cpuplace,FILE***fd2fpmap,int*fd2fpmap_size); // start a child process in an empty slot
+void retirechild(struct combuf*cb,int zygoted,fd_set*rdall_set,fd_set*wrall_set,FILE**fd2fpmap);         // stop a child process and leave its slot empty (the child is reaped without being treated as an error)
+
+// handle SIGCHLD signal
+// (sets 'childExited' to true if a child process terminated)
+extern int childExited;
+void sigchldHandler(int signo);
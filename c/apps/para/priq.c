@@ -18,9 +18,8 @@ static size_t hparent(size_t c){return (c-1)/2;}
 static size_t hchild1(size_t p){return (p+1)*2-1;}
 static size_t hchild2(size_t p){return (p+1)*2;}
 
-// sink top element to its correct place
-static void sinkel(struct priq*q){
-  size_t p=0;
+// sink element at index 'p' to its correct place
+static void sinkel(struct priq*q,size_t p){
   while(1){
     if(p>=q->nel_)break;
     size_t c1=hchild1(p);
@@ -100,7 +99,7 @@ void priq_pop(struct priq*q){
   if(q->nel_==0)app_message(FATAL,"attempt to pop top element of empty priq in priq_pop()");
   swap(&q->vel_[0],&q->vel_[q->nel_-1]);
   --q->nel_;
-  sinkel(q);
+  sinkel(q,0);
 }
 // get #of elements in queue
 size_t priq_size(struct priq*q){
@@ -123,7 +122,9 @@ void priq_remove(struct priq*q,void*el){
     if(q->vel_[i]==el)ind=i;                         // ...
   }                                                  // ...
   if(ind==-1)app_message(FATAL,"attempt to remove element from priority queue not part of queue");
-  swap(&q->vel_[ind],&q->vel_[q->nel_-1]);           // put last element in heap in deleted place
-  floatel(q,ind);                                    // float it to correct place
   --q->nel_;                                         // last element no longer part of heap
+  if(ind==q->nel_)return;                            // removed last element - nothing to restore
+  swap(&q->vel_[ind],&q->vel_[q->nel_]);             // put last element in heap in deleted place
+  floatel(q,ind);                                    // float or sink it to correct place
+  sinkel(q,ind);                                     // ...
 }
@@ -0,0 +1,27 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+
+// --- USDT (user level statically defined tracing) probes ---
+// (probes are compiled in when <sys/sdt.h> is available (PARA_HAVE_SDT), otherwise they expand to nothing)
+// (a probe that is not attached is a single 'nop' instruction - arguments are only evaluated into registers)
+// (probes can be listed with 'bpftrace -l "usdt:/path/to/para:*"' and attached with bpftrace, SystemTap or perf)
+//
+// provider 'para', probes and arguments:
+//   line__read      lineno                 line was added to input queue
+//   line__dispatch  pid, lineno            line was completely written to child process (pid is -1 for service connections)
+//   line__reply     pid, lineno            response was read from child process
+//   line__flush     lineno                 line was completely written to output
+//   commit__start   nlines                 transaction commit starts (#of lines committed)
+//   commit__end     nlines                 transaction commit ended
+//   timer__fired    type, key              timer popped in main loop (type: 0 heartbeat, 1 child process timeout, 2 idle child process, 3 service reconnect, key: child process slot)
+//   child__spawn    pid                    child process was spawned
+//   child__exit     pid, status            child process was reaped (status as returned by waitpid())
+
+#ifdef PARA_HAVE_SDT
+#include <sys/sdt.h>
+#define PARA_PROBE1(name,a1)           DTRACE_PROBE1(para,name,a1)
+#define PARA_PROBE2(name,a1,a2)        DTRACE_PROBE2(para,name,a1,a2)
+#else
+#define PARA_PROBE1(name,a1)           do{}while(0)
+#define PARA_PROBE2(name,a1,a2)        do{}while(0)
+#endif
@@ -0,0 +1,81 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "prof.h"
+#include "error.h"
+#include "sys.h"
+#include "util.h"
+#include <string.h>
+
+// names of phases
+static char const*phasenames[PROF_NPHASES]={"select","read","dispatch","write","readchild","tooutq","flush","other"};
+
+// forward decl
+static void profstat_clear(struct profstat_t*stat,double now);
+
+// constructor
+struct prof_t*prof_ctor(){
+  struct prof_t*ret=emalloc(sizeof(struct prof_t));
+  ret->last_=nowusec();
+  profstat_clear(&ret->tot_,ret->last_);
+  profstat_clear(&ret->ival_,ret->last_);
+  return ret;
+}
+// destructor
+void prof_dtor(struct prof_t*prof){
+  free(prof);
+}
+// charge time since last phase to 'phase'
+void prof_phase(struct prof_t*prof,enum profphase_t phase,size_t nitems){
+  double now=nowusec();
+  double usec=now-prof->last_;
+  prof->last_=now;
+  prof->tot_.usec_[phase]+=usec;
+  prof->ival_.usec_[phase]+=usec;
+  if(nitems==0)return;
+  prof->tot_.nitems_[phase]+=nitems;
+  prof->ival_.nitems_[phase]+=nitems;
+  ++prof->tot_.nactive_[phase];
+  ++prof->ival_.nactive_[phase];
+}
+// count a loop iteration
+void prof_iteration(struct prof_t*prof){
+  ++prof->tot_.niters_;
+  ++prof->ival_.niters_;
+}
+// log a summary of the interval since last heartbeat
+// (busy is the fraction of time not spent waiting in pselect(), followed by the busiest phase)
+void prof_heartbeat(struct prof_t*prof){
+  struct profstat_t*ival=&prof->ival_;
+  double wall=prof->last_-ival->start_;
+  if(wall<=0)wall=1;
+  int busiest=PROF_READ;
+  for(int i=PROF_READ;i<PROF_NPHASES;++i){
+    if(ival->usec_[i]>ival->usec_[busiest])busiest=i;
+  }
+  app_message(INFO,"profile: %.1f s, iterations: %lu, busy: %.1f%%, busiest phase: %s %.1f%% (%.1f items/iteration)",
+              wall/1e6,ival->niters_,100*(wall-ival->usec_[PROF_SELECT])/wall,phasenames[busiest],100*ival->usec_[busiest]/wall,
+              ival->niters_?(double)ival->nitems_[busiest]/ival->niters_:0.0);
+  profstat_clear(ival,prof->last_);
+}
+// print accounting since start
+void prof_dump(struct prof_t*prof,FILE*fp){
+  struct profstat_t*tot=&prof->tot_;
+  double wall=prof->last_-tot->start_;
+  if(wall<=0)wall=1;
+  size_t niters=tot->niters_?tot->niters_:1;
+  fprintf(fp,"profile: wall: %.3f s, iterations: %lu, busy: %.1f%%, usec/iteration: %.2f\n",
+          wall/1e6,tot->niters_,100*(wall-tot->usec_[PROF_SELECT])/wall,wall/niters);
+  fprintf(fp,"  %-10s %12s %7s %12s %9s %12s %15s %10s\n","phase","usec","%wall","usec/iter","%active","items","items/active","usec/item");
+  for(int i=0;i<PROF_NPHASES;++i){
+    fprintf(fp,"  %-10s %12.0f %7.1f %12.3f %9.1f %12lu %15.2f %10.3f\n",
+            phasenames[i],tot->usec_[i],100*tot->usec_[i]/wall,tot->usec_[i]/niters,100.0*tot->nactive_[i]/niters,tot->nitems_[i],
+            tot->nactive_[i]?(double)tot->nitems_[i]/tot->nactive_[i]:0.0,tot->nitems_[i]?tot->usec_[i]/tot->nitems_[i]:0.0);
+  }
+}
+
+// --- helpers ---
+
+// start a new interval
+static void profstat_clear(struct profstat_t*stat,double now){
+  memset(stat,0,sizeof(struct profstat_t));
+  stat->start_=now;
+}
@@ -0,0 +1,41 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+// --- accounting of time spent in the phases of the main loop ---
+// (each phase is charged the time since the previous phase ended, so the phases add up to the wall clock time of the loop)
+// (time spent in 'pselect()' is the time para is idle - all other phases are busy time)
+// (times are read with 'gettimeofday()' - phases shorter than a micro second are still accounted for correctly on average)
+
+// phases of the main loop
+enum profphase_t{
+  PROF_SELECT=0,                  // waiting in pselect()
+  PROF_READ,                      // (1) reading input into input queue
+  PROF_DISPATCH,                  // (2) handing lines to child processes (or shards)
+  PROF_WRITE,                     // (3) writing lines to child processes
+  PROF_READCHILD,                 // (4) reading responses from child processes
+  PROF_TOOUTQ,                    // (5) moving responses to output queue
+  PROF_FLUSH,                     // (6) writing output
+  PROF_OTHER,                     // timers, wakeups and fd set bookkeeping
+  PROF_NPHASES
+};
+// accounting for an interval
+struct profstat_t{
+  double start_;                  // start of interval (micro seconds)
+  size_t niters_;                 // #of loop iterations
+  double usec_[PROF_NPHASES];     // time spent in each phase
+  size_t nitems_[PROF_NPHASES];   // #of items (lines, responses) processed by each phase
+  size_t nactive_[PROF_NPHASES];  // #of iterations where phase processed at least one item
+};
+struct prof_t{
+  double last_;                   // end of last phase
+  struct profstat_t tot_;         // since start
+  struct profstat_t ival_;        // since last heartbeat
+};
+struct prof_t*prof_ctor();                                                  // constructor
+void prof_dtor(struct prof_t*prof);                                         // destructor
+void prof_phase(struct prof_t*prof,enum profphase_t phase,size_t nitems);  // charge time since last phase to 'phase'
+void prof_iteration(struct prof_t*prof);                                    // count a loop iteration
+void prof_heartbeat(struct prof_t*prof);                                    // log a summary of the interval since last heartbeat and start a new interval
+void prof_dump(struct prof_t*prof,FILE*fp);                                 // print accounting since start
@@ -0,0 +1,75 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "proj.h"
+#include "error.h"
+#include "const.h"
+#include "util.h"
+#include <string.h>
+
+// constructor
+struct proj_t*proj_ctor(size_t field,char delim,size_t nslots,size_t maxperslot){
+  struct proj_t*ret=emalloc(sizeof(struct proj_t));
+  ret->field_=field;
+  ret->delim_=delim;
+  ret->maxperslot_=maxperslot;
+  ret->ents_=emalloc(nslots*maxperslot*sizeof(struct projent_t));
+  ret->front_=emalloc(nslots*sizeof(size_t));
+  ret->nents_=emalloc(nslots*sizeof(size_t));
+  ret->nslots_=nslots;
+  return ret;
+}
+// destructor
+void proj_dtor(struct proj_t*proj){
+  for(size_t i=0;i<proj->nslots_*proj->maxperslot_;++i)free(proj->ents_[i].line_);
+  free(proj->ents_);
+  free(proj->front_);
+  free(proj->nents_);
+  free(proj);
+}
+// line is handed to child process - keep original line and replace it by the field
+// ('buf' is a RDBUF holding a complete line, the field is followed by a line terminator)
+void proj_project(struct proj_t*proj,size_t slot,struct buf_t*buf){
+  if(proj->nents_[slot]==proj->maxperslot_)app_message(FATAL,"too many lines in flight on child process in proj_project()");
+  size_t ind=(proj->front_[slot]+proj->nents_[slot])%proj->maxperslot_;
+  struct projent_t*ent=&proj->ents_[slot*proj->maxperslot_+ind];
+  ++proj->nents_[slot];
+  size_t len=buf_size(buf);                                  // keep original line
+  if(ent->maxlen_<len){                                      // ...
+    free(ent->line_);                                        // ...
+    ent->maxlen_=len;                                        // ...
+    ent->line_=emalloc(len);                                 // ...
+  }
+  memcpy(ent->line_,buf_buf(buf),len);                       // ...
+  ent->len_=len;                                             // ...
+  size_t n=len>0&&ent->line_[len-1]==LF?len-1:len;           // field never includes the line terminator
+  ent->hasfield_=findfield(ent->line_,n,proj->field_,proj->delim_,&ent->start_,&ent->end_);
+  if(!ent->hasfield_)++proj->nmissing_;                      // (child process gets an empty line)
+  buf_reset(buf,RDBUF);                                      // replace line by field
+  memcpy(buf_bufrd(buf),ent->line_+ent->start_,ent->end_-ent->start_);
+  buf_add(buf,ent->end_-ent->start_);                        // ...
+  *buf_bufrd(buf)=LF;                                        // ...
+  buf_add(buf,1);                                            // ...
+  proj->nlinebytes_+=len;                                    // ...
+  proj->nfieldbytes_+=buf_size(buf);                         // ...
+}
+// response for oldest line in flight on child process was read - splice it into the original line
+// ('buf' is a RDBUF holding a complete response, on return it holds the original line with the field replaced by the response)
+void proj_splice(struct proj_t*proj,size_t slot,struct buf_t*buf){
+  if(proj->nents_[slot]==0)app_message(FATAL,"response from child process without a line in flight in proj_splice()");
+  struct projent_t*ent=&proj->ents_[slot*proj->maxperslot_+proj->front_[slot]];
+  proj->front_[slot]=(proj->front_[slot]+1)%proj->maxperslot_;
+  --proj->nents_[slot];
+  size_t n=buf_size(buf);                                    // response without line terminator
+  if(n>0&&buf_buf(buf)[n-1]==LF)--n;                         // ...
+  size_t len=ent->hasfield_?ent->len_-(ent->end_-ent->start_)+n:ent->len_; // length of spliced line (line without field is written unchanged)
+  if(len>buf_maxbuf(buf))app_message(FATAL,"line with response from child process spliced in is longer than max length of a line (%lu bytes)",buf_maxbuf(buf));
+  char*p=buf_buf(buf);                                       // splice: prefix + response + suffix
+  if(!ent->hasfield_){                                       // ...
+    memcpy(p,ent->line_,ent->len_);                          // ...
+  }else{                                                     // ...
+    memmove(p+ent->start_,p,n);                              // ...
+    memcpy(p,ent->line_,ent->start_);                        // ...
+    memcpy(p+ent->start_+n,ent->line_+ent->end_,ent->len_-ent->end_);
+  }
+  buf_reset(buf,RDBUF);                                      // ...
+  buf_add(buf,len);                                          // ...
+}
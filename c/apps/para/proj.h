@@ -0,0 +1,34 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include "buf.h"
+
+// --- projection of a single field of a line ---
+// (only the field is sent to a child process, the response is spliced back into the original line in place of the field)
+// (original lines are kept per child process in the order lines were handed to it so a response can be associated with its input line)
+
+// original line handed to a child process
+struct projent_t{
+  char*line_;                     // original line (including line terminator)
+  size_t len_;                    // length of line
+  size_t maxlen_;                 // allocated size of 'line_'
+  size_t start_;                  // start of field in line
+  size_t end_;                    // end of field in line (one past last character)
+  int hasfield_;                  // false if line has too few fields (response is discarded and line is written unchanged)
+};
+struct proj_t{
+  size_t field_;                  // field to send to child processes (1: first field)
+  char delim_;                    // field delimiter
+  size_t nslots_;                 // #of child processes
+  size_t maxperslot_;             // max #of lines in flight per child process
+  struct projent_t*ents_;         // original lines in flight (ring buffer for each child process)
+  size_t*front_;                  // front of ring buffer for each child process
+  size_t*nents_;                  // #of lines in flight for each child process
+  size_t nmissing_;               // #of lines with too few fields
+  size_t nlinebytes_;             // #of bytes in original lines
+  size_t nfieldbytes_;            // #of bytes sent to child processes
+};
+struct proj_t*proj_ctor(size_t field,char delim,size_t nslots,size_t maxperslot); // constructor
+void proj_dtor(struct proj_t*proj);                                              // destructor
+void proj_project(struct proj_t*proj,size_t slot,struct buf_t*buf);             // line is handed to child process - keep original line and replace it by the field
+void proj_splice(struct proj_t*proj,size_t slot,struct buf_t*buf);              // response for oldest line in flight on child process was read - splice it into the original line
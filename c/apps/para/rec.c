@@ -0,0 +1,199 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "rec.h"
+#include "buf.h"
+#include "error.h"
+#include "const.h"
+#include "util.h"
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+// forward decl
+static size_t readbytes(FILE*fp,struct buf_t*buf,size_t n,int delim);
+static int readline(struct rec_t*rec,FILE*fp);
+static size_t len32(struct buf_t*buf);
+static size_t addbyte(struct buf_t*buf,char c);
+
+// constructor
+// (returns NULL if format is invalid)
+struct rec_t*rec_ctor(char const*fmt,size_t maxbuf){
+  struct rec_t*ret=emalloc(sizeof(struct rec_t));
+  if(!strcmp(fmt,"lf")){
+    ret->type_=REC_BYTE;
+    ret->delim_=LF;
+  }else
+  if(!strcmp(fmt,"nul")){
+    ret->type_=REC_BYTE;
+    ret->delim_='\0';
+  }else
+  if(!strncmp(fmt,"byte:",5)&&strlen(fmt+5)==1){
+    ret->type_=REC_BYTE;
+    ret->delim_=fmt[5];
+  }else
+  if(!strncmp(fmt,"byte:0x",7)&&strlen(fmt+7)>=1&&strlen(fmt+7)<=2&&strspn(fmt+7,"0123456789abcdefABCDEF")==strlen(fmt+7)){
+    ret->type_=REC_BYTE;
+    ret->delim_=(char)strtol(fmt+7,NULL,16);
+  }else
+  if(!strcmp(fmt,"len32")){
+    ret->type_=REC_LEN32;
+  }else
+  if(!strncmp(fmt,"re:",3)&&fmt[3]!='\0'){
+    ret->type_=REC_REGEX;
+    if(regcomp(&ret->re_,fmt+3,REG_EXTENDED|REG_NOSUB|REG_NEWLINE)){
+      free(ret);
+      return NULL;
+    }
+    ret->maxline_=maxbuf;
+    ret->line_=emalloc(maxbuf+1);
+    ret->term_=LF;
+  }else
+  if(!strncmp(fmt,"eor:",4)){
+    ret->type_=REC_EOR;
+    ret->markerlen_=strlen(fmt+4)+1;
+    ret->marker_=emalloc(ret->markerlen_+1);
+    strcpy(ret->marker_,fmt+4);
+    ret->marker_[ret->markerlen_-1]=LF;
+  }else{
+    free(ret);
+    return NULL;
+  }
+  return ret;
+}
+// destructor
+void rec_dtor(struct rec_t*rec){
+  if(rec->type_==REC_REGEX){
+    regfree(&rec->re_);
+    free(rec->line_);
+  }
+  free(rec->marker_);
+  free(rec);
+}
+// set terminator appended to multi-line records
+void rec_setterm(struct rec_t*rec,char term){
+  rec->term_=term;
+}
+// read at most one record into buffer
+// (fp may be non-blocking - a partially read record is completed by later calls)
+// (for REC_REGEX 'done' is set when the line starting the next record was read - the line is kept for the next record)
+// (for REC_EOR 'done' is set when the marker line was read - the marker is removed from the buffer)
+size_t rec_read(struct rec_t*rec,FILE*fp,struct buf_t*buf,int*done){
+  if(rec->type_==REC_BYTE){
+    return readbytes(fp,buf,buf_nfree(buf),(unsigned char)rec->delim_);
+  }
+  if(rec->type_==REC_LEN32){
+    size_t ret=0;
+    while(!rec_complete(rec,buf,0)){                     // read length prefix, then payload
+      size_t need=buf_nbuf(buf)<4?4-buf_nbuf(buf):4+len32(buf)-buf_nbuf(buf);
+      if(buf_nbuf(buf)>=4&&need>buf_nfree(buf))app_message(FATAL,"length prefixed record of %lu bytes does not fit in buffer of %lu bytes",len32(buf),buf_maxbuf(buf));
+      size_t n=readbytes(fp,buf,need,-1);                // ...
+      ret+=n;                                            // ...
+      if(n<need)break;                                   // no more data right now (or eof)
+    }
+    return ret;
+  }
+  if(rec->type_==REC_EOR){
+    size_t ret=0;
+    while(!*done){                                       // read lines until the marker line
+      size_t n=readbytes(fp,buf,buf_nfree(buf),LF);      // ...
+      ret+=n;                                            // ...
+      if(n==0||buf_lastchar(buf)!=LF)return ret;         // no complete line available (errno tells if eof)
+      size_t start=buf_nbuf(buf)-1;                      // find start of last line
+      while(start>0&&buf_buf(buf)[start-1]!=LF)--start;  // ...
+      if(buf_nbuf(buf)-start==rec->markerlen_&&!memcmp(buf_buf(buf)+start,rec->marker_,rec->markerlen_)){
+        buf_drop(buf,rec->markerlen_);                   // response is complete
+        *done=1;                                         // ...
+      }
+    }
+    errno=0;                                             // a complete response is not 'no data'
+    return ret;
+  }
+  size_t ret=0;                                          // REC_REGEX: read lines until a line starts the next record
+  while(!*done){
+    if(!rec->linedone_&&!readline(rec,fp))return ret;    // no complete line available (errno tells if eof)
+    if(buf_nbuf(buf)>0){                                 // does line start the next record?
+      rec->line_[rec->linelen_]='\0';                    // ...
+      if(!regexec(&rec->re_,rec->line_,0,NULL,0)){       // ...
+        ret+=addbyte(buf,rec->term_);                    // record is complete
+        *done=1;                                         // ...
+        break;                                           // ...
+      }
+    }
+    if(rec->linelen_>=buf_nfree(buf))app_message(FATAL,"multi-line record does not fit in buffer of %lu bytes",buf_maxbuf(buf));
+    memcpy(buf_bufrd(buf),rec->line_,rec->linelen_);     // append line to record
+    buf_add(buf,rec->linelen_);                          // ...
+    ret+=rec->linelen_;                                  // ...
+    rec->linelen_=0;                                     // ...
+    rec->linedone_=0;                                    // ...
+  }
+  errno=0;                                               // a complete record is not 'no data'
+  return ret;
+}
+// complete record in buffer at eof if possible
+// (a missing delimiter is added, a truncated length prefixed record or a response without marker stays incomplete)
+size_t rec_eof(struct rec_t*rec,struct buf_t*buf,int*done){
+  if(rec->type_==REC_LEN32||rec->type_==REC_EOR||buf_nbuf(buf)==0)return 0;
+  if(rec->type_==REC_BYTE)return buf_lastchar(buf)==rec->delim_?0:addbyte(buf,rec->delim_);
+  if(*done)return 0;                                     // REC_REGEX: terminate last line and record
+  size_t ret=buf_lastchar(buf)==LF?0:addbyte(buf,LF);
+  *done=1;
+  return ret+addbyte(buf,rec->term_);
+}
+// true if buffer holds a complete record
+int rec_complete(struct rec_t*rec,struct buf_t*buf,int done){
+  if(rec->type_==REC_BYTE)return buf_nbuf(buf)>0&&buf_lastchar(buf)==rec->delim_;
+  if(rec->type_==REC_LEN32)return buf_nbuf(buf)>=4&&buf_nbuf(buf)==4+len32(buf);
+  return done;
+}
+
+// --- helpers ---
+
+// read at most 'n' bytes into buffer, stop after reading 'delim' (if delim >= 0)
+// (returns #of bytes read - if fewer than requested errno is EAGAIN if no more data is available right now)
+static size_t readbytes(FILE*fp,struct buf_t*buf,size_t n,int delim){
+  char*p=buf_bufrd(buf);
+  size_t ret=0;
+  errno=0;                                               // errno may be stale from an earlier call
+  while(ret<n){
+    int c=getc(fp);
+    if(c==EOF){
+      if(ferror(fp)&&errno==EAGAIN)clearerr(fp);         // no data right now - try again later
+      break;
+    }
+    p[ret++]=c;
+    if(c==delim)break;
+  }
+  if(ret>0)buf_add(buf,ret);
+  return ret;
+}
+// read (rest of) a line into 'line_'
+// (returns true if a complete line was read, a line without LF at eof is complete)
+static int readline(struct rec_t*rec,FILE*fp){
+  errno=0;                                               // errno may be stale from an earlier call
+  while(rec->linelen_<rec->maxline_){
+    int c=getc(fp);
+    if(c==EOF){
+      if(ferror(fp)&&errno==EAGAIN){                     // no data right now - try again later
+        clearerr(fp);                                    // ...
+        return 0;                                        // ...
+      }
+      if(rec->linelen_==0)return 0;                      // eof
+      return rec->linedone_=1;                           // last line without LF
+    }
+    rec->line_[rec->linelen_++]=c;
+    if(c==LF)return rec->linedone_=1;
+  }
+  app_message(FATAL,"line in multi-line record does not fit in buffer of %lu bytes",rec->maxline_);
+  return 0;
+}
+// append a character to buffer
+static size_t addbyte(struct buf_t*buf,char c){
+  if(buf_nfree(buf)==0)app_message(FATAL,"cannot append record delimiter to buffer - not enough room in buffer");
+  *buf_bufrd(buf)=c;
+  buf_add(buf,1);
+  return 1;
+}
+// length of length prefixed record in buffer (buffer must hold at least the prefix)
+static size_t len32(struct buf_t*buf){
+  unsigned char*p=(unsigned char*)buf_buf(buf);
+  return ((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|(uint32_t)p[3];
+}
@@ -0,0 +1,38 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <regex.h>
+
+// --- record framing ---
+// (by default records are LF terminated lines - a framing describes other ways records are delimited)
+// (records are always passed verbatim - including delimiters and length prefixes - to child processes and to output)
+// (formats: 'lf', 'nul', 'byte:C' (C is a character or a hex value '0xHH'), 'len32' (4 byte big endian length prefix), 're:REGEX' (multi-line record starting at line matching REGEX))
+// (a multi-line record gets a terminator appended so a child process can tell where the record ends - by default LF, i.e. an empty line)
+// (responses from child processes may also use 'eor:MARKER' - zero or more lines followed by a line equal to MARKER which is removed from the response)
+
+struct buf_t;
+
+// type of framing
+enum rectype_t{REC_BYTE=0,REC_LEN32=1,REC_REGEX=2,REC_EOR=3};
+
+// record framing
+// (a REGEX framing carries state between records - the line starting the next record - and must only be used by one reader)
+struct rec_t{
+  enum rectype_t type_;           // type of framing
+  char delim_;                    // record delimiter (REC_BYTE)
+  regex_t re_;                    // regular expression matching first line of a record (REC_REGEX)
+  char*line_;                     // line being read (REC_REGEX)
+  size_t linelen_;                // #of characters in 'line_'
+  size_t maxline_;                // max #of characters in a line
+  int linedone_;                  // true if 'line_' holds a complete line
+  char term_;                     // terminator appended to a record (REC_REGEX)
+  char*marker_;                   // end of response marker line including LF (REC_EOR)
+  size_t markerlen_;              // length of 'marker_'
+};
+struct rec_t*rec_ctor(char const*fmt,size_t maxbuf);                          // constructor (returns NULL if 'fmt' is invalid)
+void rec_dtor(struct rec_t*rec);                                              // destructor
+void rec_setterm(struct rec_t*rec,char term);                                 // set terminator appended to multi-line records
+size_t rec_read(struct rec_t*rec,FILE*fp,struct buf_t*buf,int*done);         // read at most one record into buffer (returns #of characters read, 0 and errno==EAGAIN if no data is available, else 0 at eof)
+size_t rec_eof(struct rec_t*rec,struct buf_t*buf,int*done);                   // complete record in buffer at eof if possible (returns #of characters added)
+int rec_complete(struct rec_t*rec,struct buf_t*buf,int done);                 // true if buffer holds a complete record
@@ -0,0 +1,220 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "replay.h"
+#include "buf.h"
+#include "sys.h"
+#include "error.h"
+#include "util.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+// forward decl
+static struct replaykey_t*findkey(struct replay_t*replay,uint64_t hash);
+static void*replaychild_run(void*arg);
+
+// --- recorder ---
+
+// constructor
+struct replayrec_t*replayrec_ctor(char const*file,size_t nslots){
+  struct replayrec_t*ret=emalloc(sizeof(struct replayrec_t));
+  ret->fp_=fopen(file,"wb");
+  if(!ret->fp_)app_message(FATAL,"failed opening trace file: %s for writing, errno: %d, err: %s",file,errno,strerror(errno));
+  setfdcloexec(fileno(ret->fp_));
+  ret->hashes_=emalloc(nslots*sizeof(uint64_t));
+  ret->hashed_=emalloc(nslots*sizeof(int));
+  ret->wrusec_=emalloc(nslots*sizeof(double));
+  return ret;
+}
+// destructor
+void replayrec_dtor(struct replayrec_t*rrec){
+  efpclose(rrec->fp_);
+  free(rrec->hashes_);
+  free(rrec->hashed_);
+  free(rrec->wrusec_);
+  free(rrec);
+}
+// line is being written to child process
+// (the buffer still holds the whole line the first time it is written)
+void replayrec_sending(struct replayrec_t*rrec,size_t slot,struct buf_t*buf){
+  if(rrec->hashed_[slot])return;
+  rrec->hashes_[slot]=fnv1a(FNV1A_OFFSET,buf_buf(buf),buf_size(buf));
+  rrec->hashed_[slot]=1;
+}
+// line was completely written to child process
+void replayrec_written(struct replayrec_t*rrec,size_t slot){
+  rrec->wrusec_[slot]=nowusec();
+}
+// response was read from child process
+void replayrec_response(struct replayrec_t*rrec,size_t slot,struct buf_t*buf){
+  double usec=nowusec()-rrec->wrusec_[slot];
+  fprintf(rrec->fp_,"%016llx %lu %lu\n",(unsigned long long)rrec->hashes_[slot],(size_t)(usec>0?usec:0),buf_size(buf));
+  if(fwrite(buf_buf(buf),1,buf_size(buf),rrec->fp_)!=buf_size(buf)){
+    app_message(FATAL,"failed writing to trace file, errno: %d, err: %s",errno,strerror(errno));
+  }
+  rrec->hashed_[slot]=0;
+  ++rrec->nrecorded_;
+}
+
+// --- replay ---
+
+// constructor
+// (returns NULL if trace file cannot be read)
+struct replay_t*replay_ctor(char const*file,double scale){
+  FILE*fp=fopen(file,"rb");
+  if(!fp)return NULL;
+  struct replay_t*ret=emalloc(sizeof(struct replay_t));
+  ret->file_=file;
+  ret->scale_=scale;
+  ret->nbuckets_=1024;
+  ret->buckets_=emalloc(ret->nbuckets_*sizeof(struct replaykey_t*));
+  pthread_mutex_init(&ret->mtx_,NULL);
+  unsigned long long hash;
+  size_t usec,len;
+  int stat;
+  while((stat=fscanf(fp,"%llx %lu %lu",&hash,&usec,&len))==3&&fgetc(fp)=='\n'){
+    struct replayent_t*ent=emalloc(sizeof(struct replayent_t));
+    ent->hash_=hash;
+    ent->usec_=usec;
+    ent->len_=len;
+    ent->resp_=emalloc(len>0?len:1);
+    if(fread(ent->resp_,1,len,fp)!=len){
+      free(ent->resp_);
+      free(ent);
+      stat=0;
+      break;
+    }
+    if(2*ret->nents_>=ret->nbuckets_){                          // rehash if load factor > 0.5
+      size_t nbuckets=2*ret->nbuckets_;                          // ...
+      struct replaykey_t**buckets=emalloc(nbuckets*sizeof(struct replaykey_t*));
+      for(size_t i=0;i<ret->nbuckets_;++i){                      // ...
+        for(struct replaykey_t*key=ret->buckets_[i],*next;key;key=next){
+          next=key->next_;                                       // ...
+          key->next_=buckets[key->hash_&(nbuckets-1)];           // ...
+          buckets[key->hash_&(nbuckets-1)]=key;                  // ...
+        }
+      }
+      free(ret->buckets_);                                       // ...
+      ret->buckets_=buckets;                                     // ...
+      ret->nbuckets_=nbuckets;                                   // ...
+    }
+    struct replaykey_t*key=findkey(ret,hash);                    // append response to responses recorded for hash
+    if(!key){                                                    // ...
+      key=emalloc(sizeof(struct replaykey_t));                   // ...
+      key->hash_=hash;                                           // ...
+      key->next_=ret->buckets_[hash&(ret->nbuckets_-1)];         // ...
+      ret->buckets_[hash&(ret->nbuckets_-1)]=key;                // ...
+    }
+    if(key->last_)key->last_->next_=ent;                         // ...
+    else key->first_=key->cur_=ent;                              // ...
+    key->last_=ent;                                              // ...
+    ++ret->nents_;
+  }
+  int ok=stat==EOF&&!ferror(fp);                                 // stop at a malformed entry
+  fclose(fp);
+  if(!ok){
+    replay_dtor(ret);
+    return NULL;
+  }
+  return ret;
+}
+// destructor
+void replay_dtor(struct replay_t*replay){
+  for(size_t i=0;i<replay->nchildren_;++i){
+    struct replaychild_t*child=replay->children_[i];
+    int stat=pthread_join(child->thread_,NULL);
+    if(stat)app_message(FATAL,"failed joining simulated child process thread, err: %s",strerror(stat));
+    free(child);
+  }
+  free(replay->children_);
+  for(size_t i=0;i<replay->nbuckets_;++i){
+    for(struct replaykey_t*key=replay->buckets_[i],*next;key;key=next){
+      next=key->next_;
+      for(struct replayent_t*ent=key->first_,*nextent;ent;ent=nextent){
+        nextent=ent->next_;
+        free(ent->resp_);
+        free(ent);
+      }
+      free(key);
+    }
+  }
+  free(replay->buckets_);
+  pthread_mutex_destroy(&replay->mtx_);
+  free(replay);
+}
+// start a simulated child process
+// (return value [-1, fd] where fd is the non-blocking para side of a socket pair)
+struct intpair replay_spawn(struct replay_t*replay){
+  int fds[2];
+  if(socketpair(AF_LOCAL,SOCK_STREAM,0,fds)<0)app_message(FATAL,"socketpair failed, errno: %d, errstr: %s in replay_spawn()",errno,strerror(errno));
+  setfdnonblock(fds[0]);
+  setfdcloexec(fds[0]);
+  setfdcloexec(fds[1]);
+  if(replay->nchildren_==replay->maxchildren_){
+    replay->maxchildren_=replay->maxchildren_?2*replay->maxchildren_:8;
+    struct replaychild_t**children=emalloc(replay->maxchildren_*sizeof(struct replaychild_t*));
+    if(replay->nchildren_)memcpy(children,replay->children_,replay->nchildren_*sizeof(struct replaychild_t*));
+    free(replay->children_);
+    replay->children_=children;
+  }
+  struct replaychild_t*child=emalloc(sizeof(struct replaychild_t));
+  child->fd_=fds[1];
+  child->replay_=replay;
+  replay->children_[replay->nchildren_++]=child;
+  int stat=createthread(&child->thread_,replaychild_run,child);
+  if(stat)app_message(FATAL,"failed creating simulated child process thread, err: %s",strerror(stat));
+  struct intpair ret={-1,fds[0]};
+  return ret;
+}
+
+// --- helpers ---
+
+// find recorded responses for a hash (NULL if none)
+static struct replaykey_t*findkey(struct replay_t*replay,uint64_t hash){
+  for(struct replaykey_t*key=replay->buckets_[hash&(replay->nbuckets_-1)];key;key=key->next_){
+    if(key->hash_==hash)return key;
+  }
+  return NULL;
+}
+// simulated child process
+// (answers each line with the next response recorded for it, lines not in the trace are echoed back)
+// (exits when para closes its side of the connection)
+static void*replaychild_run(void*arg){
+  struct replaychild_t*child=arg;
+  struct replay_t*replay=child->replay_;
+  FILE*fp=efdopen(child->fd_,"rb");
+  char*line=NULL;
+  size_t maxline=0;
+  ssize_t len;
+  while((len=getline(&line,&maxline,fp))>0){
+    char const*resp=line;                                        // response and time to wait
+    size_t resplen=len;                                          // ...
+    size_t usec=0;                                               // ...
+    pthread_mutex_lock(&replay->mtx_);                           // ...
+    struct replaykey_t*key=findkey(replay,fnv1a(FNV1A_OFFSET,line,len));
+    if(key){                                                     // next recorded response
+      resp=key->cur_->resp_;                                     // ...
+      resplen=key->cur_->len_;                                   // ...
+      usec=key->cur_->usec_*replay->scale_;                      // ...
+      key->cur_=key->cur_->next_?key->cur_->next_:key->first_;   // ...
+    }else{                                                       // ...
+      ++replay->nmisses_;                                        // ...
+    }
+    pthread_mutex_unlock(&replay->mtx_);                         // ...
+    if(usec>0){                                                  // act as the child process did
+      struct timeval tv;                                         // ...
+      tv.tv_sec=usec/1000000;                                    // ...
+      tv.tv_usec=usec%1000000;                                   // ...
+      select(0,NULL,NULL,NULL,&tv);                              // ...
+    }
+    for(size_t n=0;n<resplen;){                                  // write response (para may have closed connection)
+      ssize_t stat=send(child->fd_,resp+n,resplen-n,MSG_NOSIGNAL);
+      if(stat<0&&errno==EINTR)continue;                          // ...
+      if(stat<0)break;                                           // ...
+      n+=stat;                                                   // ...
+    }
+  }
+  free(line);
+  fclose(fp);
+  return NULL;
+}
@@ -0,0 +1,72 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "util.h"
+
+// --- recording and replaying responses from child processes ---
+// (while recording, each response is written to a trace file together with the hash of the line it answers and the time the child process took)
+// (when replaying, child processes are replaced by threads in para answering each line from the trace, optionally sleeping for the recorded time)
+// (lines are matched on their hash so the replay does not depend on which child process got which line - duplicate lines get their responses in recorded order)
+//
+// trace file: one entry per response: '<hash in hex> <micro seconds> <#of bytes>\n' followed by the response bytes
+
+// forward decl
+struct buf_t;
+
+// --- recorder ---
+
+struct replayrec_t{
+  FILE*fp_;                       // trace file
+  uint64_t*hashes_;               // hash of line in flight on each child process
+  int*hashed_;                    // true if 'hashes_' is set for child process
+  double*wrusec_;                 // time line was completely written to each child process
+  size_t nrecorded_;              // #of responses recorded
+};
+struct replayrec_t*replayrec_ctor(char const*file,size_t nslots);            // constructor
+void replayrec_dtor(struct replayrec_t*rrec);                                  // destructor (closes trace file)
+void replayrec_sending(struct replayrec_t*rrec,size_t slot,struct buf_t*buf); // line is being written to child process (only the first call for a line counts)
+void replayrec_written(struct replayrec_t*rrec,size_t slot);                  // line was completely written to child process
+void replayrec_response(struct replayrec_t*rrec,size_t slot,struct buf_t*buf);// response was read from child process
+
+// --- replay ---
+
+// recorded response
+struct replayent_t{
+  uint64_t hash_;                 // hash of line
+  size_t usec_;                   // time child process took
+  size_t len_;                    // length of response
+  char*resp_;                     // response
+  struct replayent_t*next_;       // next recorded response for same hash
+};
+// recorded responses for a hash
+struct replaykey_t{
+  uint64_t hash_;                 // hash of line
+  struct replayent_t*first_;      // responses in recorded order
+  struct replayent_t*last_;       // ...
+  struct replayent_t*cur_;        // next response to replay (wraps around)
+  struct replaykey_t*next_;       // next key in bucket
+};
+// simulated child process
+struct replaychild_t{
+  pthread_t thread_;              // thread answering lines
+  int fd_;                        // thread side of socket pair
+  struct replay_t*replay_;        // ...
+};
+struct replay_t{
+  char const*file_;               // trace file
+  double scale_;                  // recorded times are multiplied by this factor (0: respond immediately)
+  struct replaykey_t**buckets_;   // recorded responses indexed by hash
+  size_t nbuckets_;               // #of buckets (power of 2)
+  size_t nents_;                  // #of recorded responses
+  pthread_mutex_t mtx_;           // protects replay state shared by simulated child processes
+  struct replaychild_t**children_;// simulated child processes
+  size_t nchildren_;              // ...
+  size_t maxchildren_;            // ...
+  size_t nmisses_;                // #of lines not in trace (echoed back)
+};
+struct replay_t*replay_ctor(char const*file,double scale);                    // constructor (returns NULL if trace file cannot be read)
+void replay_dtor(struct replay_t*replay);                                      // destructor (waits for simulated child processes - their connections must be closed)
+struct intpair replay_spawn(struct replay_t*replay);                           // start a simulated child process - return value [-1, fd] where fd is connected to the simulated child process
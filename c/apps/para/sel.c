@@ -0,0 +1,60 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "sel.h"
+#include "util.h"
+#include <stdio.h>
+
+// constructor
+// (returns NULL if a regular expression is invalid)
+struct sel_t*sel_ctor(int startlineno,size_t first,size_t count,size_t every,char const*re,char const*linenore,int drop){
+  struct sel_t*ret=emalloc(sizeof(struct sel_t));
+  ret->startlineno_=startlineno;
+  ret->first_=first>0?first:1;
+  ret->count_=count;
+  ret->every_=every>0?every:1;
+  ret->drop_=drop;
+  if(re){
+    if(regcomp(&ret->re_,re,REG_EXTENDED|REG_NOSUB|REG_NEWLINE)){
+      free(ret);
+      return NULL;
+    }
+    ret->hasre_=1;
+  }
+  if(linenore){
+    if(regcomp(&ret->linenore_,linenore,REG_EXTENDED|REG_NOSUB)){
+      sel_dtor(ret);
+      return NULL;
+    }
+    ret->haslinenore_=1;
+  }
+  return ret;
+}
+// destructor
+void sel_dtor(struct sel_t*sel){
+  if(sel->hasre_)regfree(&sel->re_);
+  if(sel->haslinenore_)regfree(&sel->linenore_);
+  free(sel);
+}
+// true if line should be processed by a child process
+// (cheap predicates on the line number are checked before regular expressions)
+int sel_selected(struct sel_t*sel,int lineno,char*line,size_t len){
+  if(sel->hasmemo_&&sel->memolineno_==lineno)return sel->memoselected_;
+  size_t n=lineno-sel->startlineno_+1;                   // line number counting from 1
+  int ret=n>=sel->first_&&                               // ...
+          (sel->count_==0||n-sel->first_<sel->count_)&&  // ...
+          (n-sel->first_)%sel->every_==0;                // ...
+  if(ret&&sel->haslinenore_){                            // line number matches regular expression
+    char buf[32];                                        // ...
+    snprintf(buf,sizeof(buf),"%lu",n);                   // ...
+    ret=!regexec(&sel->linenore_,buf,0,NULL,0);          // ...
+  }
+  if(ret&&sel->hasre_){                                  // content matches regular expression
+    char c=line[len];                                    // ...
+    line[len]='\0';                                      // ...
+    ret=!regexec(&sel->re_,line,0,NULL,0);               // ...
+    line[len]=c;                                         // ...
+  }
+  if(!ret)++sel->nunselected_;
+  sel->hasmemo_=1;
+  sel->memolineno_=lineno;
+  return sel->memoselected_=ret;
+}
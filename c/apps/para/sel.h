@@ -0,0 +1,27 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include <regex.h>
+
+// --- selection of lines to process ---
+// (a line is processed by a child process only if it satisfies all predicates - other lines are passed unchanged to output or dropped)
+// (line numbers count input lines starting at 1 - predicates only depend on the line so selection is the same when recovering)
+
+struct sel_t{
+  int startlineno_;               // internal line number of first input line
+  size_t first_;                  // first line number to process (1: first line)
+  size_t count_;                  // #of lines, starting at 'first_', to process (0: all)
+  size_t every_;                  // process only every Nth line, counting from 'first_' (1: every line)
+  int hasre_;                     // true if 're_' is set
+  regex_t re_;                    // process only lines matching regular expression
+  int haslinenore_;               // true if 'linenore_' is set
+  regex_t linenore_;              // process only line numbers matching regular expression
+  int drop_;                      // drop lines not processed instead of writing them unchanged to output
+  int hasmemo_;                   // true if 'memolineno_' and 'memoselected_' are valid
+  int memolineno_;                // line number of last line checked (a line waiting for a child process is checked only once)
+  int memoselected_;              // result for last line checked
+  size_t nunselected_;            // #of lines not processed
+};
+struct sel_t*sel_ctor(int startlineno,size_t first,size_t count,size_t every,char const*re,char const*linenore,int drop); // constructor (returns NULL if a regular expression is invalid)
+void sel_dtor(struct sel_t*sel);                                                         // destructor
+int sel_selected(struct sel_t*sel,int lineno,char*line,size_t len);                     // true if line should be processed by a child process ('line' must have room for a terminating NUL)
@@ -0,0 +1,453 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "server.h"
+#include "paraloop.h"
+#include "error.h"
+#include "priq.h"
+#include "tmo.h"
+#include "buf.h"
+#include "combuf.h"
+#include "outq.h"
+#include "inq.h"
+#include "sys.h"
+#include "txn.h"
+#include "stats.h"
+#include "util.h"
+#include "cpuaff.h"
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// size of buffers used by client when shuffling data to/from server
+#define CLIENT_BUFSIZE 65536
+
+// end-of-job record sent by server after the output of a job
+// (magic followed by a NUL terminated error message - an empty message means the job succeeded)
+// (a client that sees EOF without an end-of-job record knows that the job did not complete)
+#define JOB_EOJMAGIC "\0paraEOJ"
+#define JOB_EOJMAGICLEN 8
+#define JOB_EOJLEN 256
+
+// --- job submitted by a client ---
+
+struct job_t{
+  int id_;                        // job id (used in log messages)
+  int fd_;                        // connection to client - lines are read from and output is written back to this fd
+  FILE*fp_;                       // FILE* used when reading lines from client
+  int inputeof_;                  // did we reach eof on input from client
+  int broken_;                    // client closed connection before all output was written (or job failed)
+  char eoj_[JOB_EOJLEN];          // end-of-job record sent to client after all output
+  size_t neoj_;                   // #of bytes of end-of-job record written to client
+  size_t ninflight_;              // #of lines from job currently being processed by child processes
+  struct inq_t*qin_;              // input queue for job
+  struct outq_t*qout_;            // output queue for job (orders output lines for job)
+  size_t maxoutq_;                // max #of lines in output queue before we stop reading input from job
+  struct txnlog_t*txnlog_;        // tracks #of lines and bytes written to client (no commits are done)
+  struct job_t*next_;             // jobs are kept in a linked list
+};
+// constructor
+static struct job_t*job_ctor(int id,int fd,size_t maxoutq,size_t outqinc){
+  struct job_t*ret=emalloc(sizeof(struct job_t));
+  ret->id_=id;
+  ret->fd_=fd;
+  ret->fp_=efdopen(fd,"rb");
+  ret->inputeof_=0;
+  ret->broken_=0;
+  memcpy(ret->eoj_,JOB_EOJMAGIC,JOB_EOJMAGICLEN);  // (no error message - the job succeeds unless it fails)
+  ret->ninflight_=0;
+  ret->qin_=inq_ctor(0);
+  ret->qout_=outq_ctor(maxoutq,outqinc,0);
+  ret->maxoutq_=maxoutq;
+  ret->txnlog_=txnlog_ctor(0,0);
+  ret->next_=NULL;
+  return ret;
+}
+// destructor (closes connection to client)
+static void job_dtor(struct job_t*job){
+  efpclose(job->fp_);
+  inq_dtor(job->qin_);
+  outq_dtor(job->qout_);
+  txnlog_dtor(job->txnlog_);
+  free(job);
+}
+// true if all output for job has been written
+static int job_done(struct job_t*job){
+  return job->inputeof_&&inq_empty(job->qin_)&&job->ninflight_==0&&outq_size(job->qout_)==0;
+}
+// true if job holds as many output lines as the output queue is sized for
+// (the client is not reading its output - we stop reading its input until it catches up)
+static int job_stalled(struct job_t*job){
+  return job->maxoutq_>0&&outq_size(job->qout_)>=job->maxoutq_;
+}
+// write as much as possible of end-of-job record to client - returns 1 if client closed connection, else 0
+static int job_sendeoj(struct job_t*job){
+  ssize_t n=ewrite(job->fd_,job->eoj_+job->neoj_,JOB_EOJLEN-job->neoj_,0,1);
+  if(n<0)return 1;
+  job->neoj_+=n;
+  return 0;
+}
+// fail job because a child process failed on one of its lines
+// (output not yet written is dropped, the client gets an end-of-job record with the reason - if it has room for it - and the connection is shut down)
+// (the job is removed once its other lines in flight are done)
+static void job_fail(struct job_t*job,char const*reason){
+  if(job->broken_)return;
+  app_message(WARNING,"job: %d failed: %s",job->id_,reason);
+  job->broken_=1;
+  snprintf(job->eoj_+JOB_EOJMAGICLEN,JOB_EOJLEN-JOB_EOJMAGICLEN,"%s",reason);
+  job_sendeoj(job);
+  shutdown(job->fd_,SHUT_RDWR);
+}
+
+// --- job list ---
+// (jobs are rotated to the back of the list when a line from the job is handed to a child process)
+// (this way jobs take turns and share child processes fairly)
+
+struct joblist_t{
+  size_t njobs_;                  // #of jobs in list
+  struct job_t*front_;            // front of list
+  struct job_t*back_;             // back of list
+};
+// append job to back of list
+static void joblist_push(struct joblist_t*jl,struct job_t*job){
+  job->next_=NULL;
+  if(jl->back_)jl->back_->next_=job;
+  else jl->front_=job;
+  jl->back_=job;
+  ++jl->njobs_;
+}
+// unlink job from list ('prev' is the job before 'job' in the list or NULL if job is at front)
+static void joblist_unlink(struct joblist_t*jl,struct job_t*prev,struct job_t*job){
+  if(prev)prev->next_=job->next_;
+  else jl->front_=job->next_;
+  if(jl->back_==job)jl->back_=prev;
+  job->next_=NULL;
+  --jl->njobs_;
+}
+// get first job in list with a line ready to be processed and move it to the back of the list (returns NULL if no job has a line ready)
+// (a job whose client is not reading its output does not get more child process time until it catches up)
+static struct job_t*joblist_next(struct joblist_t*jl){
+  struct job_t*prev=NULL;
+  for(struct job_t*job=jl->front_;job;prev=job,job=job->next_){
+    if(job->broken_||job_stalled(job)||!inq_dataready(job->qin_))continue;
+    joblist_unlink(jl,prev,job);
+    joblist_push(jl,job);
+    return job;
+  }
+  return NULL;
+}
+
+// --- server ---
+
+// replace child process in slot 'ind' with a new one
+// (the job owning the line in flight on the slot fails - other jobs keep running)
+// (a child process that did not exit - it timed out - is killed, the SIGCHLD handler reaps it without treating the exit as an error)
+static void restartchild(struct paraopt_t const*opt,struct combuftab*cbtab,size_t ind,int exited,struct job_t**slotjob,fd_set*rdall_set,fd_set*wrall_set){
+  struct combuf*cb=combuftab_at(cbtab,ind);
+  int pid=combuf_pid(cb);
+  struct job_t*job=slotjob[ind];
+  if(job){                                                     // fail job owning line in flight
+    char reason[JOB_EOJLEN];                                   // ...
+    snprintf(reason,sizeof reason,"child process %s at input line: %d",exited?"exited":"timed out",combuf_lineno(cb));
+    job_fail(job,reason);                                      // ...
+    slotjob[ind]=NULL;                                         // ...
+    --job->ninflight_;                                         // ...
+  }
+  app_message(WARNING,"restarting child process: %lu with pid: %d (%s)",ind,pid,exited?"exited":"timed out");
+  if(exited)combuf_setpid(cb,-1);                              // (already reaped - must not be killed)
+  retirechild(cb,0,rdall_set,wrall_set,NULL);                  // close connection to child process
+  if(!exited)kill(pid,SIGKILL);                                // ...
+  combuf_clear4wr(cb);                                         // drop line in flight
+  startchild(cb,ind,opt->cfile_,opt->cargv_,NULL,NULL,opt->cpuplace_,NULL,NULL);
+}
+// true if an idle child process has exited
+// (an idle child process has nothing to send - EOF on its connection is the only thing we can read)
+static int childgone(struct combuf*cb){
+  char c;
+  return recv(combuf_fd(cb),&c,1,MSG_PEEK|MSG_DONTWAIT)==0;
+}
+
+// run server
+// (never returns - the server is terminated with a signal)
+void paraserve(struct paraopt_t const*opt,char const*sockpath){
+  size_t nsubprocesses=opt->nsubprocesses_;         // grab parameters
+  size_t maxbuf=opt->maxbuf_;                       // ...
+  struct stats_t*stats=stats_ctor();                // statistics
+
+  // listen for clients
+  int fdlisten=elistenunix(sockpath);
+  app_message(INFO,"listening for jobs on: %s",sockpath);
+
+  // setup fd sets for select()
+  fd_set rdall_set,wrall_set;                       // read and write sets
+  FD_ZERO(&rdall_set);                              // ...
+  FD_ZERO(&wrall_set);                              // ...
+  FD_SET(fdlisten,&rdall_set);                      // we are always ready to accept new jobs
+
+  // setup timer queue
+  struct priq*qtmo=tmoq_ctor(1+nsubprocesses);      // heartbeat timer + one timer for each child process
+  tmoq_push(qtmo,tmo_ctor(HEARTBEAT,opt->heart_sec_,-1));
+
+  // setup a pool of free combuf objects
+  struct combufpool*cbpool=combufpool_ctor(1+opt->maxoutq_+2*nsubprocesses,CBWRITE,maxbuf);
+
+  // setup signal handler for SIGCHLD
+  struct sigaction sigact;                                            // setup signal handler for SIGCHLD
+  memset(&sigact,0,sizeof sigact);                                    // ...
+  sigact.sa_handler=sigchldHandler;                                   // ...
+  if(sigaction(SIGCHLD,&sigact,0)<0){                                 // ...
+    app_message(FATAL,"failed in sigaction(): %s",strerror(errno));   // bail out
+  }
+  sigset_t mask,orig_mask;                                            // block SIGCHLD outside select()
+  sigemptyset(&mask);                                                 // ...
+  sigaddset(&mask,SIGCHLD);                                           // ...
+  if(sigprocmask(SIG_BLOCK,&mask,&orig_mask)<0){                      // ...
+    app_message(FATAL,"failed in sigprocmask(): %s",strerror(errno)); // bail out
+  }
+  // spawn child processes - they are kept running (warm) for the lifetime of the server
+  struct combuftab*cbtab=combuftab_ctor(nsubprocesses);
+  for(size_t i=0;i<nsubprocesses;++i){
+    struct intpair p=spawn(opt->cfile_,opt->cargv_);
+    if(opt->cpuplace_)cpuplace_pin(opt->cpuplace_,i,p.first);     // spread child processes over CPUs
+    FILE*fp=efdopen(p.second,"rwb");
+    struct combuf*cb=combufpool_get(cbpool,fp,CBWRITE);
+    combuf_setpid(cb,p.first);
+    combuftab_add(cbtab,cb);
+  }
+  struct job_t**slotjob=emalloc(nsubprocesses*sizeof(struct job_t*)); // job owning line being processed by each child process
+  struct joblist_t jobs={0,NULL,NULL};                                // active jobs
+  int nextjobid=0;                                                    // id of next job
+  if(opt->cpuloop_>=0)cpu_pinthread(opt->cpuloop_);                   // pin server loop to a CPU
+
+  // loop forever ...
+  while(1){
+    fd_set rdset=rdall_set;                                      // grab current fd masks (read and write)
+    fd_set wrset=wrall_set;                                      // ...
+    int maxfd=maxinfdsets(&rdset,&wrset);                        // get max fd
+    struct timespec tspec;                                       // get timeout
+    sigset_t emptyset;                                           // signal mask to pass to pselect()
+    sigemptyset(&emptyset);                                      // ...
+    struct timespec*ptspec=tmoq_select_timeout(qtmo,&tspec);     // ...
+    int sstat=pselect(maxfd+1,&rdset,&wrset,0,ptspec,&emptyset); // do pselect() call ...
+    if(sstat<0&&errno!=EINTR)app_message(FATAL,"pselect() failed in server, errno: %d, errstr: %s",errno,strerror(errno));
+    if(childExited){                                             // replace idle child processes that exited
+      childExited=0;                                             // (child processes with a line in flight are replaced when we see EOF on their connection)
+      for(size_t i=0;i<nsubprocesses;++i){                       // ...
+        struct combuf*cb=combuftab_at(cbtab,i);                  // ...
+        if(combuf_state(cb)==CBWRITE&&combuf_empty(cb)&&childgone(cb))restartchild(opt,cbtab,i,1,slotjob,&rdall_set,&wrall_set);
+      }
+    }
+    if(sstat<0)continue;                                         // (SIGCHLD interrupted pselect())
+
+    // select() timeout
+    if(sstat==0){
+      struct tmo_t*tmo=tmoq_front(qtmo);                       // get popped timer and remove it from timer queue
+      if(tmo==NULL)app_message(FATAL,"timer popped but no timer on tmo queue in server");
+      app_message(INFO,"timer popped, type: %s",tmo_type2str(tmo));
+      tmoq_pop(qtmo);                                          // remove timer from queue
+      if(tmo_type(tmo)==HEARTBEAT){                            // did we get a heartbeat or a child timeout tmo?
+        app_message(DEBUG,"#jobs: %lu",jobs.njobs_);           // ...
+        tmoq_push(qtmo,tmo_reactivate(tmo));                   // reactivate heartbeat timer
+      }else{                                                   // a child timed out - fail the job owning the line and replace the child process
+        struct combuf*cb=combuftab_at(cbtab,tmo_key(tmo));     // ...
+        app_message(WARNING,"child process timeout for pid: %d at input line: %d",combuf_pid(cb),combuf_lineno(cb));
+        combuf_settmo(cb,NULL);                                // ...
+        restartchild(opt,cbtab,tmo_key(tmo),0,slotjob,&rdall_set,&wrall_set);
+        tmo_dtor(tmo);                                         // ...
+      }
+    }
+    // (1) accept new jobs
+    if(FD_ISSET(fdlisten,&rdset)){
+      int fd;
+      while((fd=accept(fdlisten,NULL,NULL))>=0){
+        setfdnonblock(fd);                                     // ...
+        setfdcloexec(fd);                                      // (child processes spawned later must not keep the job connection open)
+        struct job_t*job=job_ctor(nextjobid++,fd,opt->maxoutq_,opt->outqinc_);
+        joblist_push(&jobs,job);                               // ...
+        FD_SET(fd,&rdall_set);                                 // start reading lines from job
+        app_message(INFO,"job: %d connected (#jobs: %lu)",job->id_,jobs.njobs_);
+      }
+      if(errno!=EAGAIN&&errno!=EWOULDBLOCK&&errno!=EINTR&&errno!=ECONNABORTED){
+        app_message(FATAL,"accept() failed in server, errno: %d, errstr: %s",errno,strerror(errno));
+      }
+    }
+    // (2) read lines from jobs into job input queues
+    for(struct job_t*job=jobs.front_;job;job=job->next_){
+      if(job->broken_||job->inputeof_||!FD_ISSET(job->fd_,&rdset))continue;
+      job->inputeof_=readinq(job->qin_,job->fp_,nsubprocesses,cbpool,NULL);
+    }
+    // (3) copy lines from job input queues into idle child processes (jobs take turns)
+    for(size_t i=0;i<nsubprocesses;++i){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process and check if it is idle
+      if(combuf_state(cb)!=CBWRITE||!combuf_empty(cb))continue;  // ...
+      struct job_t*job=joblist_next(&jobs);                      // get next job in line
+      if(!job)break;                                             // no job has data
+      inq2cbtab(job->qin_,cb,&wrall_set,cbpool);                 // transfer line to child process
+      slotjob[i]=job;                                            // remember which job the line belongs to
+      ++job->ninflight_;                                         // ...
+    }
+    // (4) write data stored in child process buffer + set timer for child process if needed
+    for(size_t i=0;i<nsubprocesses;++i){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process
+      if(combuf_state(cb)!=CBWRITE)continue;                     // not a WRITE buffer
+      int complete=cbtabwrite(cb,&rdall_set,&wrall_set,&wrset,cbpool);
+      if(combuf_eof(cb)){                                        // child process exited
+        restartchild(opt,cbtab,i,1,slotjob,&rdall_set,&wrall_set);
+        continue;                                                // ...
+      }
+      if(complete){                                              // if we wrote a complete buffer, then set child timer
+        struct tmo_t*client_tmo=tmo_ctor(CLIENT,opt->client_tmo_sec_,i);
+        combuf_settmo(cb,client_tmo);                            // ...
+        tmoq_push(qtmo,client_tmo);                              // ...
+      }
+    }
+    // (5) read data into child process buffer + remove timer from child process if needed
+    for(size_t i=0;i<nsubprocesses;++i){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process
+      if(combuf_state(cb)!=CBREAD)continue;                      // not a READ buffer
+      int complete=cbtabread(cb,&rdall_set,&rdset);
+      if(complete||combuf_eof(cb)){                              // if we read a complete buffer (or child exited) then remove child timer
+        struct tmo_t*client_tmo=combuf_tmo(cb);                  // ...
+        tmoq_remove(qtmo,client_tmo);                            // ...
+        tmo_dtor(client_tmo);                                    // ...
+        combuf_settmo(cb,NULL);                                  // ...
+      }
+      if(combuf_eof(cb))restartchild(opt,cbtab,i,1,slotjob,&rdall_set,&wrall_set); // child process exited (possibly in the middle of a response)
+    }
+    // (6) copy data from child process buffer to output queue of job owning the line
+    for(size_t i=0;i<nsubprocesses;++i){
+      struct combuf*cb=combuftab_at(cbtab,i);                    // get combuf for sub-process
+      if(combuf_state(cb)!=CBREAD||!combuf_rdcomplete(cb))continue;
+      struct job_t*job=slotjob[i];                               // job owning line
+      slotjob[i]=NULL;                                           // ...
+      --job->ninflight_;                                         // ...
+      if(job->broken_)combuf_clear4wr(cb);                       // client is gone - drop line
+      else cbtab2outq(job->qout_,cb,&wrall_set,cbpool,NULL);     // ...
+    }
+    // (7) flush job output queues
+    for(struct job_t*job=jobs.front_;job;job=job->next_){
+      if(job->broken_||!FD_ISSET(job->fd_,&wrset))continue;
+      int closed=flushoutq(job->qout_,job->fd_,1,cbpool,0,NULL,job->txnlog_,job->txnlog_,NULL,stats,NULL);
+      if(!closed&&job_done(job))closed=job_sendeoj(job);        // all output written - tell client the job succeeded
+      if(closed){
+        app_message(WARNING,"job: %d closed connection before all output was written",job->id_);
+        job->broken_=1;                                          // we'll remove the job once its lines in flight are done
+      }
+    }
+    // (8) update select() triggers for jobs and retire jobs that are done
+    struct job_t*prev=NULL;
+    for(struct job_t*job=jobs.front_;job;){
+      struct job_t*next=job->next_;
+      int done=!job->broken_&&job_done(job)&&job->neoj_==JOB_EOJLEN;
+      if(done||job->broken_){                                    // job is done or client is gone
+        FD_CLR(job->fd_,&rdall_set);                             // ...
+        FD_CLR(job->fd_,&wrall_set);                             // ...
+        if(done||job->ninflight_==0){                            // remove job (a broken job waits for lines in flight)
+          if(done)app_message(INFO,"job: %d done, #lines: %lu",job->id_,txnlog_nlines(job->txnlog_));
+          joblist_unlink(&jobs,prev,job);                        // ...
+          job_dtor(job);                                         // ...
+          job=next;                                              // ...
+          continue;                                              // ...
+        }
+      }else{
+        if(!job->inputeof_&&!job_stalled(job)&&(inq_partialrd(job->qin_)||inq_size(job->qin_)<nsubprocesses))FD_SET(job->fd_,&rdall_set);
+        else FD_CLR(job->fd_,&rdall_set);
+        if(outq_ready(job->qout_)||job_done(job))FD_SET(job->fd_,&wrall_set);
+        else FD_CLR(job->fd_,&wrall_set);
+      }
+      prev=job;
+      job=next;
+    }
+  }
+}
+
+// --- client ---
+
+// write all of 'buf' to output (waits if output would block)
+static void writeout(int fdout,char const*buf,size_t n){
+  for(size_t i=0;i<n;){
+    ssize_t w=ewrite(fdout,buf+i,n-i,0,0);
+    if(w<=0){                                                    // output would block - wait for it
+      fd_set owrset;                                             // ...
+      FD_ZERO(&owrset);                                          // ...
+      FD_SET(fdout,&owrset);                                     // ...
+      select(fdout+1,NULL,&owrset,NULL,NULL);                    // ...
+      continue;                                                  // ...
+    }
+    i+=w;
+  }
+}
+// submit a job to server reading input from 'fdin' and writing output to 'fdout'
+// (returns when server has written all output and an end-of-job record telling us the job succeeded)
+// (the last JOB_EOJLEN bytes received are held back until we know if they are the end-of-job record)
+void paraclient(char const*sockpath,int fdin,int fdout){
+  char addr[FILENAME_MAX+1];                                     // connect to server
+  snprintf(addr,sizeof addr,"unix:%s",sockpath);                 // ...
+  int fd=econnect(addr);                                         // ...
+  setfdnonblock(fd);                                             // ...
+  char*inbuf=emalloc(CLIENT_BUFSIZE);                            // data read from 'fdin' not yet sent to server
+  char*outbuf=emalloc(CLIENT_BUFSIZE);                           // data received from server
+  size_t nin=0;                                                  // #of bytes in 'inbuf'
+  size_t inind=0;                                                // index of next byte to send in 'inbuf'
+  int inputeof=0;                                                // reached eof on 'fdin'
+  int shutdownsent=0;                                            // told server there is no more input
+  int inputlost=0;                                               // server closed connection before all input was sent
+  char eoj[JOB_EOJLEN];                                          // last bytes received from server (end-of-job record when server is done)
+  size_t neoj=0;                                                 // #of bytes in 'eoj'
+  while(1){
+    fd_set rdset,wrset;                                          // setup fd sets
+    FD_ZERO(&rdset);                                             // ...
+    FD_ZERO(&wrset);                                             // ...
+    if(!inputeof&&!inputlost&&inind==nin)FD_SET(fdin,&rdset);   // read more input only when everything is sent
+    if(!inputlost&&inind<nin)FD_SET(fd,&wrset);                  // ...
+    FD_SET(fd,&rdset);                                           // always read output from server
+    int sstat=select(maxint(fdin,fd)+1,&rdset,&wrset,NULL,NULL); // ...
+    if(sstat<0&&errno==EINTR)continue;                           // ...
+    if(sstat<0)app_message(FATAL,"select() failed in client, errno: %d, errstr: %s",errno,strerror(errno));
+    if(FD_ISSET(fdin,&rdset)){                                   // read input
+      ssize_t n=read(fdin,inbuf,CLIENT_BUFSIZE);                 // ...
+      if(n<0&&errno!=EINTR&&errno!=EAGAIN)app_message(FATAL,"failed reading input in client, errno: %d, errstr: %s",errno,strerror(errno));
+      if(n==0)inputeof=1;                                        // ...
+      if(n>0){                                                   // ...
+        nin=n;                                                   // ...
+        inind=0;                                                 // ...
+      }
+    }
+    if(FD_ISSET(fd,&wrset)){                                     // send input to server
+      struct iovec iov={inbuf+inind,nin-inind};                  // ...
+      ssize_t n=ewritev(fd,&iov,1,1);                            // ...
+      if(n<0)inputlost=1;                                        // server failed the job - read why
+      else inind+=n;                                             // ...
+    }
+    if(inputeof&&inind==nin&&!inputlost&&!shutdownsent){                     // no more input - tell server
+      if(shutdown(fd,SHUT_WR)<0)app_message(FATAL,"shutdown() failed in client, errno: %d, errstr: %s",errno,strerror(errno));
+      shutdownsent=1;                                            // ...
+    }
+    if(FD_ISSET(fd,&rdset)){                                     // receive output from server
+      ssize_t n=read(fd,outbuf,CLIENT_BUFSIZE);                  // ...
+      if(n<0&&errno==ECONNRESET)break;                           // server closed connection without reading all our input
+      if(n<0&&errno!=EINTR&&errno!=EAGAIN)app_message(FATAL,"failed reading from server, errno: %d, errstr: %s",errno,strerror(errno));
+      if(n==0)break;                                             // server is done
+      if(n<0)continue;                                           // ...
+      size_t nout=neoj+n>JOB_EOJLEN?neoj+n-JOB_EOJLEN:0;         // write output except the last JOB_EOJLEN bytes received
+      size_t nouteoj=nout<neoj?nout:neoj;                        // ...
+      writeout(fdout,eoj,nouteoj);                               // ...
+      writeout(fdout,outbuf,nout-nouteoj);                       // ...
+      memmove(eoj,eoj+nouteoj,neoj-nouteoj);                     // keep the last JOB_EOJLEN bytes
+      memcpy(eoj+neoj-nouteoj,outbuf+nout-nouteoj,n-(nout-nouteoj));
+      neoj+=n-nout;                                              // ...
+    }
+  }
+  if(neoj<JOB_EOJLEN||memcmp(eoj,JOB_EOJMAGIC,JOB_EOJMAGICLEN)){ // no end-of-job record - job did not complete
+    writeout(fdout,eoj,neoj);                                    // ...
+    app_message(FATAL,"server closed connection before job completed");
+  }
+  eoj[JOB_EOJLEN-1]='\0';                                        // ...
+  if(eoj[JOB_EOJMAGICLEN])app_message(FATAL,"job failed in server: %s",eoj+JOB_EOJMAGICLEN);
+  if(inputlost||!inputeof||inind<nin)app_message(FATAL,"server closed connection before all input was sent");
+  eclose(fd);
+  free(inbuf);
+  free(outbuf);
+}
@@ -0,0 +1,13 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+
+// forward decl
+struct paraopt_t;
+
+// --- para as a server ---
+// (the server keeps 'nsubprocesses' child processes running and accepts jobs from clients over a unix domain socket)
+// (a job is a connection from a client: lines are read from the connection and output is written back in the same order)
+// (lines from concurrent jobs share the child processes - jobs take turns when lines are handed to child processes)
+
+void paraserve(struct paraopt_t const*opt,char const*sockpath);   // run server (never returns)
+void paraclient(char const*sockpath,int fdin,int fdout);          // submit a job reading from 'fdin' and writing output to 'fdout'
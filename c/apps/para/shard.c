@@ -0,0 +1,178 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "shard.h"
+#include "paraloop.h"
+#include "error.h"
+#include "priq.h"
+#include "tmo.h"
+#include "combuf.h"
+#include "spscq.h"
+#include "sys.h"
+#include "util.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/select.h>
+
+// helper methods
+static void*shard_run(void*arg);  // event loop for shard
+
+// constructor
+struct shard_t*shard_ctor(size_t id,size_t maxchildren,size_t maxbuf,size_t client_tmo_sec,int mainwakefd){
+  struct shard_t*ret=emalloc(sizeof(struct shard_t));
+  ret->id_=id;
+  ret->client_tmo_sec_=client_tmo_sec;
+  ret->cbpool_=combufpool_ctor(maxchildren,CBWRITE,maxbuf);
+  ret->cbtab_=combuftab_ctor(maxchildren);
+  ret->slotline_=emalloc(maxchildren*sizeof(struct combuf*));
+  ret->qin_=spscq_ctor(2*maxchildren);
+  ret->qout_=spscq_ctor(2*maxchildren);
+  ret->maxinflight_=0;
+  ret->ninflight_=0;
+  ewakepipe(ret->wakefds_);
+  ret->mainwakefd_=mainwakefd;
+  ret->done_=0;
+  return ret;
+}
+// destructor
+void shard_dtor(struct shard_t*shard){
+  for(size_t i=0;i<combuftab_size(shard->cbtab_);++i){        // wait for child processes to terminate
+    ewaitpid(combuf_pid(combuftab_at(shard->cbtab_,i)));       // ...
+  }
+  eclose(shard->wakefds_[0]);
+  eclose(shard->wakefds_[1]);
+  spscq_dtor(shard->qin_);
+  spscq_dtor(shard->qout_);
+  free(shard->slotline_);
+  combuftab_dtor(shard->cbtab_);
+  combufpool_dtor(shard->cbpool_);
+  free(shard);
+}
+// hand child process to shard
+void shard_addchild(struct shard_t*shard,int pid,int fd){
+  FILE*fp=efdopen(fd,"rwb");
+  struct combuf*cb=combufpool_get(shard->cbpool_,fp,CBWRITE);
+  combuf_setpid(cb,pid);
+  shard->slotline_[combuftab_size(shard->cbtab_)]=NULL;
+  combuftab_add(shard->cbtab_,cb);
+  shard->maxinflight_+=2;
+}
+// start thread running shard event loop
+void shard_start(struct shard_t*shard){
+  int stat=createthread(&shard->thread_,shard_run,shard);
+  if(stat!=0)app_message(FATAL,"failed creating thread for shard: %lu, errstr: %s",shard->id_,strerror(stat));
+}
+// stop shard and join thread
+// (all lines handed to shard must have been returned)
+void shard_stop(struct shard_t*shard){
+  __atomic_store_n(&shard->done_,1,__ATOMIC_RELEASE);
+  ewakeup(shard->wakefds_[1]);
+  int stat=pthread_join(shard->thread_,NULL);
+  if(stat!=0)app_message(FATAL,"failed joining thread for shard: %lu, errstr: %s",shard->id_,strerror(stat));
+}
+// hand a complete line to shard
+void shard_send(struct shard_t*shard,struct combuf*cb){
+  if(shard->ninflight_>=shard->maxinflight_||!spscq_push(shard->qin_,cb))app_message(FATAL,"attempt to hand line to full shard: %lu",shard->id_);
+  ++shard->ninflight_;
+}
+// get a processed line
+struct combuf*shard_recv(struct shard_t*shard){
+  struct combuf*ret=spscq_pop(shard->qout_);
+  if(ret)--shard->ninflight_;
+  return ret;
+}
+// wake up shard
+void shard_wake(struct shard_t*shard){
+  ewakeup(shard->wakefds_[1]);
+}
+// #of lines handed to shard not yet returned
+size_t shard_ninflight(struct shard_t*shard){
+  return shard->ninflight_;
+}
+// event loop for shard
+// (same steps as in 'paraloop()' but lines come from and go back to the main thread)
+static void*shard_run(void*arg){
+  struct shard_t*shard=arg;
+  size_t nslots=combuftab_size(shard->cbtab_);
+  size_t nbusy=0;                                                // #of child processes working on a line
+  fd_set rdall_set,wrall_set;                                    // read and write sets
+  FD_ZERO(&rdall_set);                                           // ...
+  FD_ZERO(&wrall_set);                                           // ...
+  FD_SET(shard->wakefds_[0],&rdall_set);                         // main thread wakes us up when it hands us lines
+  struct priq*qtmo=tmoq_ctor(nslots);                            // one timer for each child process
+  while(1){
+    // (1) take lines handed to us by main thread and give them to idle child processes
+    for(size_t i=0;i<nslots&&nbusy<nslots;++i){
+      if(shard->slotline_[i])continue;                           // child is busy
+      struct combuf*cbline=spscq_pop(shard->qin_);               // get next line
+      if(!cbline)break;                                          // ...
+      struct combuf*cb=combuftab_at(shard->cbtab_,i);            // swap line into child process buffer
+      combuf_swaprd4wr(cbline,cb);                               // ...
+      shard->slotline_[i]=cbline;                                // keep combuf so we can send response back in it
+      FD_SET(combuf_fd(cb),&wrall_set);                          // trigger on write next time around
+      ++nbusy;                                                   // ...
+    }
+    // done? (main thread will not send more lines and all lines have been returned)
+    if(nbusy==0&&__atomic_load_n(&shard->done_,__ATOMIC_ACQUIRE))break;
+
+    fd_set rdset=rdall_set;                                      // grab current fd masks (read and write)
+    fd_set wrset=wrall_set;                                      // ...
+    int maxfd=maxinfdsets(&rdset,&wrset);                        // get max fd
+    struct timespec tspec;                                       // get timeout
+    struct timespec*ptspec=tmoq_select_timeout(qtmo,&tspec);     // ...
+    int sstat=pselect(maxfd+1,&rdset,&wrset,0,ptspec,NULL);      // do pselect() call ...
+    if(sstat<0&&errno==EINTR)continue;                           // ...
+    if(sstat<0)app_message(FATAL,"pselect() failed in shard: %lu, errno: %d, errstr: %s",shard->id_,errno,strerror(errno));
+
+    // select() timeout - a child timed out ... we'll terminate since no point continuing
+    if(sstat==0){
+      struct tmo_t*tmo=tmoq_front(qtmo);
+      if(tmo==NULL)app_message(FATAL,"timer popped but no timer on tmo queue in shard: %lu",shard->id_);
+      struct combuf*cb=combuftab_at(shard->cbtab_,tmo_key(tmo));
+      app_message(FATAL,"child process timeout for pid: %d at input line: %d ... terminating",combuf_pid(cb),combuf_lineno(cb));
+    }
+    // drain wakeups from main thread
+    if(FD_ISSET(shard->wakefds_[0],&rdset))edrain(shard->wakefds_[0]);
+
+    // (2) write data stored in child process buffer + set timer for child process if needed
+    for(size_t i=0;i<nslots;++i){
+      struct combuf*cb=combuftab_at(shard->cbtab_,i);
+      if(!shard->slotline_[i]||combuf_state(cb)!=CBWRITE)continue;
+      if(cbtabwrite(cb,&rdall_set,&wrall_set,&wrset,shard->cbpool_)){
+        struct tmo_t*client_tmo=tmo_ctor(CLIENT,shard->client_tmo_sec_,i);
+        combuf_settmo(cb,client_tmo);
+        tmoq_push(qtmo,client_tmo);
+      }
+    }
+    // (3) read data into child process buffer + remove timer from child process if needed
+    for(size_t i=0;i<nslots;++i){
+      struct combuf*cb=combuftab_at(shard->cbtab_,i);
+      if(combuf_state(cb)!=CBREAD)continue;
+      if(cbtabread(cb,&rdall_set,&rdset)){
+        struct tmo_t*client_tmo=combuf_tmo(cb);
+        tmoq_remove(qtmo,client_tmo);
+        tmo_dtor(client_tmo);
+      }
+    }
+    // (4) send responses back to main thread in the combufs that carried the lines
+    int nreturned=0;
+    for(size_t i=0;i<nslots;++i){
+      struct combuf*cb=combuftab_at(shard->cbtab_,i);
+      if(combuf_state(cb)!=CBREAD||!combuf_rdcomplete(cb))continue;
+      struct combuf*cbline=shard->slotline_[i];                  // combuf that carried line
+      combuf_clear4wr(cbline);                                   // swap response into it
+      combuf_swaprd4wr(cb,cbline);                               // ...
+      combuf_clear4wr(cb);                                       // child process is ready for next line
+      if(!spscq_push(shard->qout_,cbline))app_message(FATAL,"output queue full in shard: %lu",shard->id_);
+      shard->slotline_[i]=NULL;                                  // ...
+      --nbusy;                                                   // ...
+      ++nreturned;                                               // ...
+    }
+    if(nreturned)ewakeup(shard->mainwakefd_);
+  }
+  // close connections to child processes so they see eof
+  for(size_t i=0;i<nslots;++i){
+    efpclose(combuf_fp(combuftab_at(shard->cbtab_,i)));
+  }
+  tmoq_dtor(qtmo);
+  return NULL;
+}
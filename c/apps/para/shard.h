@@ -0,0 +1,41 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include <pthread.h>
+
+// --- shard of child processes driven by a separate event loop thread ---
+// (the main thread hands complete input lines to a shard and gets processed lines back through lock free queues)
+// (a line travels in a single combuf: main thread --> shard (carrying line) --> main thread (carrying response))
+// (since lines carry their line number, the main thread orders output exactly as in single threaded mode)
+
+// forward decl
+struct combuf;
+struct combufpool;
+struct combuftab;
+struct spscq;
+
+struct shard_t{
+  size_t id_;                           // shard id (used in log messages)
+  pthread_t thread_;                    // thread running event loop for shard
+  size_t client_tmo_sec_;               // timeout in seconds waiting for response from a child process
+  struct combufpool*cbpool_;            // pool owned by shard - used for combufs tracking child processes
+  struct combuftab*cbtab_;              // child processes owned by shard
+  struct combuf**slotline_;             // combuf carrying line being processed by each child process (NULL if child is idle)
+  struct spscq*qin_;                    // lines from main thread
+  struct spscq*qout_;                   // processed lines to main thread
+  size_t maxinflight_;                  // max #of lines handed to shard (two lines per child keeps children busy)
+  size_t ninflight_;                    // #of lines handed to shard not yet returned (main thread only)
+  int wakefds_[2];                      // pipe used by main thread to wake up shard
+  int mainwakefd_;                      // write end of pipe used by shard to wake up main thread
+  int done_;                            // set by main thread when no more lines will be handed to shard
+};
+// basic methods (main thread only)
+struct shard_t*shard_ctor(size_t id,size_t maxchildren,size_t maxbuf,size_t client_tmo_sec,int mainwakefd); // constructor
+void shard_dtor(struct shard_t*shard);                                  // destructor (waits for child processes to terminate)
+void shard_addchild(struct shard_t*shard,int pid,int fd);               // hand child process to shard (before shard is started)
+void shard_start(struct shard_t*shard);                                 // start thread running shard event loop
+void shard_stop(struct shard_t*shard);                                  // stop shard (closes connections to child processes) and join thread
+void shard_send(struct shard_t*shard,struct combuf*cb);                 // hand a complete line to shard (caller checks that shard can take more lines)
+struct combuf*shard_recv(struct shard_t*shard);                         // get a processed line (NULL if none available)
+void shard_wake(struct shard_t*shard);                                  // wake up shard after handing it lines
+size_t shard_ninflight(struct shard_t*shard);                           // #of lines handed to shard not yet returned
@@ -0,0 +1,51 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "spscq.h"
+#include "util.h"
+
+// constructor
+struct spscq*spscq_ctor(size_t nel){
+  size_t cap=2;                                               // round up capacity to a power of 2
+  while(cap<nel)cap<<=1;                                      // ...
+  struct spscq*ret=emalloc(sizeof(struct spscq));
+  ret->mask_=cap-1;
+  ret->tab_=emalloc(cap*sizeof(void*));
+  ret->head_=0;
+  ret->tailcache_=0;
+  ret->tail_=0;
+  ret->headcache_=0;
+  return ret;
+}
+// destructor
+void spscq_dtor(struct spscq*q){
+  free(q->tab_);
+  free(q);
+}
+// push element (producer only)
+// (the release store of 'tail_' publishes the element - and everything the element points to - to the consumer)
+int spscq_push(struct spscq*q,void*el){
+  size_t tail=q->tail_;                                       // only producer writes 'tail_'
+  if(tail-q->headcache_>q->mask_){                            // queue looks full - refresh our view of 'head_'
+    q->headcache_=__atomic_load_n(&q->head_,__ATOMIC_ACQUIRE);// ...
+    if(tail-q->headcache_>q->mask_)return 0;                  // queue is full
+  }
+  q->tab_[tail&q->mask_]=el;                                  // store element
+  __atomic_store_n(&q->tail_,tail+1,__ATOMIC_RELEASE);        // publish element
+  return 1;
+}
+// pop element (consumer only)
+void*spscq_pop(struct spscq*q){
+  size_t head=q->head_;                                       // only consumer writes 'head_'
+  if(head==q->tailcache_){                                    // queue looks empty - refresh our view of 'tail_'
+    q->tailcache_=__atomic_load_n(&q->tail_,__ATOMIC_ACQUIRE);// ...
+    if(head==q->tailcache_)return NULL;                       // queue is empty
+  }
+  void*ret=q->tab_[head&q->mask_];                            // get element
+  __atomic_store_n(&q->head_,head+1,__ATOMIC_RELEASE);        // release slot to producer
+  return ret;
+}
+// true if queue is empty (consumer only)
+int spscq_empty(struct spscq*q){
+  if(q->head_!=q->tailcache_)return 0;                        // cached view says we have elements
+  q->tailcache_=__atomic_load_n(&q->tail_,__ATOMIC_ACQUIRE);  // refresh our view of 'tail_'
+  return q->head_==q->tailcache_;
+}
@@ -0,0 +1,26 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+
+// --- single producer/single consumer queue ---
+// (lock free ring buffer of pointers - one thread pushes and one thread pops)
+// (head and tail are kept on separate cache lines so producer and consumer do not share cache lines)
+
+#define SPSCQ_CACHELINE 64
+
+struct spscq{
+  size_t mask_;                                   // capacity-1 (capacity is a power of 2)
+  void**tab_;                                     // elements
+  char pad0_[SPSCQ_CACHELINE];                    // padding
+  size_t head_;                                   // next position to pop (written by consumer only)
+  size_t tailcache_;                              // consumers cached value of 'tail_'
+  char pad1_[SPSCQ_CACHELINE];                    // padding
+  size_t tail_;                                   // next position to push (written by producer only)
+  size_t headcache_;                              // producers cached value of 'head_'
+  char pad2_[SPSCQ_CACHELINE];                    // padding
+};
+struct spscq*spscq_ctor(size_t nel);              // constructor (capacity is rounded up to a power of 2)
+void spscq_dtor(struct spscq*q);                  // destructor (does not touch elements in queue)
+int spscq_push(struct spscq*q,void*el);           // push element (producer only), returns 0 if queue is full
+void*spscq_pop(struct spscq*q);                   // pop element (consumer only), returns NULL if queue is empty
+int spscq_empty(struct spscq*q);                  // true if queue is empty (consumer only)
@@ -0,0 +1,18 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "stats.h"
+#include "util.h"
+
+// constructor
+struct stats_t*stats_ctor(){
+  return emalloc(sizeof(struct stats_t));
+}
+// destructor
+void stats_dtor(struct stats_t*stats){
+  free(stats);
+}
+// print statistics
+void stats_dump(struct stats_t*stats,FILE*fp,int nl){
+  fprintf(fp,"lines-out: %lu, out-bytes: %lu, out-writes: %lu, out-stalls: %lu, reconnects: %lu",
+          stats->nlinesout_,stats->noutbytes_,stats->noutwrites_,stats->noutstalls_,stats->nreconnects_);
+  if(nl)fprintf(fp,"\n");
+}
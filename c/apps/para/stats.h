@@ -0,0 +1,18 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdio.h>
+
+// --- statistics collected while processing ---
+
+// stats struct
+struct stats_t{
+  size_t nlinesout_;                                    // #of lines written to output
+  size_t noutbytes_;                                    // #of bytes written to output
+  size_t noutwrites_;                                   // #of write calls on output
+  size_t noutstalls_;                                   // #of times output could not accept all data we wanted to write (sink stalled)
+  size_t nreconnects_;                                  // #of times we reconnected to a service
+};
+// basic methods
+struct stats_t*stats_ctor();                            // constructor
+void stats_dtor(struct stats_t*stats);                  // destructor
+void stats_dump(struct stats_t*stats,FILE*fp,int nl);   // print statistics
@@ -1,6 +1,8 @@
 // (C) Copyright Hans Ewetz 2019. All rights reserved.
+#define _GNU_SOURCE                   // (vfork() is not part of POSIX 2008)
 #include "error.h"
 #include "sys.h"
+#include "probe.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +14,11 @@
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <sys/prctl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
 
 // wrapper around close() system call
 void eclose(int fd){
@@ -20,7 +27,7 @@ void eclose(int fd){
   if(stat<0)app_message(FATAL,"eclose: close failed: %s",strerror(errno));
 }
 // write to fd with error checking
-ssize_t ewrite(int fd,void const*buf,size_t count,int mustwrite){
+ssize_t ewrite(int fd,void const*buf,size_t count,int mustwrite,int issock){
   int wstat;
   // 'fd' is set to non-blocking mode and we will call this function in two cases:
   //   - 'select()' indicates that it is possible to write to 'fd' or that 'fd' closed, in this case 'mustwrite' is set
@@ -35,10 +42,13 @@ ssize_t ewrite(int fd,void const*buf,size_t count,int mustwrite){
   // This is because select() should not trigger unless we can write
   // The problem is that when writing to a slow device such as a terminal (or more precisely a pseudo terminal) we do get the error EAGAIN.
   // The solution here is to try to write again when errno == EAGAIN - i.e., effectivly doing a blocking write
-  while((wstat=write(fd,buf,count))<0){
+  // Sockets are written with MSG_NOSIGNAL so that a peer that closed shows up as EPIPE - not as a SIGPIPE killing us
+  while((wstat=issock?send(fd,buf,count,MSG_NOSIGNAL):write(fd,buf,count))<0){
     if(errno==EINTR)continue;                  // interupted by signal - try again
     if(errno==EAGAIN&&!mustwrite)return 0;     // we would block, but we don't have to write anything
     if(errno==EAGAIN)break;                    // we would block, but since 'mustwrite' is set we should be able to write (i.e., it should never happen)
+    if(errno==EPIPE||errno==ECONNRESET)return -1;// peer closed (we only get here if fd is a socket or SIGPIPE is ignored)
+    break;
   }
   if(wstat<0)app_message(FATAL,"error writing in ewrite(): %s, errno: %d, nbytes: %lu, buf: %s",strerror(errno),errno,count,buf);
   return wstat;
@@ -50,6 +60,14 @@ void setfdnonblock(int fd){
     app_message(FATAL,"setFdNonblock: failed setting fd in non-blocking mode: %s",strerror(errno));
   }
 }
+// set close-on-exec flag on fd
+// (child processes only inherit stdin, stdout and stderr)
+void setfdcloexec(int fd){
+  int flags=fcntl(fd,F_GETFD,0);
+  if(fcntl(fd,F_SETFD,flags|FD_CLOEXEC)<0){
+    app_message(FATAL,"setfdcloexec: failed setting close-on-exec flag on fd: %s",strerror(errno));
+  }
+}
 // dup with error checking
 int edup(int fd){
   int dstat;
@@ -70,8 +88,9 @@ int ereadline(FILE*fp,char*buf,int bufmax,int mustread){
     if(!fp)app_message(FATAL,"failed opening fd: %d using fdopen(), errno: %d, err: ",fd,errno,strerror(errno));
   }
 */
+  errno=0;                                     // errno may be stale from an earlier call
   char*ret=fgets(buf,bufmax,fp);
-  if(errno==EAGAIN&&!mustread)return 0;
+  if(ret==0&&errno==EAGAIN&&!mustread)return 0;
   if(ret==0){
     if(errno<0)app_message(FATAL,"failed reading line, errno: %d, errstr: ",errno,strerror(errno));
     return 0;
@@ -80,48 +99,64 @@ int ereadline(FILE*fp,char*buf,int bufmax,int mustread){
 }
 // spawn a child - return value [pid, fd] where pid is child pid, fd is fd to stdin/stdout for child
 // (arguments are the same as for execvp())
+// (we use vfork() so the cost of spawning does not grow with the size of this process - the child borrows our memory until it calls exec)
+// (all fds are close-on-exec so the child only inherits its end of the socket pair as stdin/stdout - and stderr)
+// (signals are blocked while the child borrows our memory, the child restores our signal mask without SIGCHLD before calling exec)
 struct intpair spawn(char const*file,char*argv[]){
   int ppid=getpid();                 // get pid of future parent (this process)
   int fds[2];
   int stat=socketpair(AF_LOCAL,SOCK_STREAM,0,fds);
   if(stat<0)app_message(FATAL,"socketpair failed, errno: %d, errstr: %s in spawn()",errno,strerror(errno));
-  int pid=fork();
-  if(pid<0)app_message(FATAL,"fork failed, errno: %d, errstr: %s in spawn()",errno,strerror(errno));
-  if(pid>0){                         // parent - use fds[0]
-    eclose(fds[1]);                  // close child side - we don't need it
-    setfdnonblock(fds[0]);           // make sure fd is non-blocking on parent side
-    struct intpair pret={pid,fds[0]};// parent side of full duplex pipe
-    return pret;
-  }else{                             // child - use fds[1]
+  setfdcloexec(fds[0]);              // other child processes must not inherit our side
+  setfdcloexec(fds[1]);              // (dup2() clears the flag on the child's stdin/stdout)
+  sigset_t allmask,origmask,childmask;// no signal handler may run in the child while it shares our memory
+  sigfillset(&allmask);              // ...
+  pthread_sigmask(SIG_SETMASK,&allmask,&origmask);
+  childmask=origmask;                // child gets our signal mask without SIGCHLD (SIGCHLD is blocked by para's main loop)
+  sigdelset(&childmask,SIGCHLD);     // (computed here since the child must not modify our memory)
+  struct sigaction sigdfl;           // parent's SIGCHLD handler must not run in child
+  memset(&sigdfl,0,sizeof sigdfl);   // ...
+  sigdfl.sa_handler=SIG_DFL;         // ...
+  volatile int childerr=0;           // set by child if it fails before or in exec (shared memory)
+  int pid=vfork();
+  if(pid==0){                        // child - only system calls from here until exec (our memory belongs to the parent)
+    sigaction(SIGCHLD,&sigdfl,NULL); // ...
     if(prctl(PR_SET_PDEATHSIG,SIGTERM)<0){ // make sure we die when parent dies
-      app_message(FATAL,"failed prctl call,errno: %d, errstr: %s  in spawn()",errno,strerror(errno));
+      childerr=errno;                // ...
+      _exit(127);                    // ...
     }
-    if(ppid!=getppid()){             // make sure parent pid has not changed - i.e., parent died
-      app_message(FATAL,"child detected that parent process died ... shutting down child");
-    }
-    eclose(fds[0]);                  // close parent side of full duplex pipe
-    eclose(0);                       // dup stdin and stdout --> full duplex pipe
-    eclose(1);                       // ...
-    edup(fds[1]);                    // ...
-    edup(fds[1]);                    // ...
-    eclose(fds[1]);                  // ...
-
-    // execute child process
-    if(execvp(file,argv)<0){
-      app_message(FATAL,"child failed executing execvp, errno: %d, errstr: %s in spawn()",errno,strerror(errno));
-    }else{
-      // should never get here
-      app_message(FATAL,"child failed executing execvp, errno: %d, errstr: %s in spawn",errno,strerror(errno));
+    if(getppid()!=ppid){             // make sure parent pid has not changed - i.e., parent died
+      childerr=ESRCH;                // ...
+      _exit(127);                    // ...
     }
+    if(fds[1]!=0)dup2(fds[1],0);     // stdin and stdout --> full duplex pipe
+    else fcntl(0,F_SETFD,0);         // ...
+    if(fds[1]!=1)dup2(fds[1],1);     // ...
+    else fcntl(1,F_SETFD,0);         // ...
+    pthread_sigmask(SIG_SETMASK,&childmask,NULL);
+    execvp(file,argv);               // execute child process
+    childerr=errno;                  // ...
+    _exit(127);                      // ...
   }
-  // we'll never get here
-  __builtin_unreachable();
+  pthread_sigmask(SIG_SETMASK,&origmask,NULL);
+  if(pid<0)app_message(FATAL,"vfork failed, errno: %d, errstr: %s in spawn()",errno,strerror(errno));
+  eclose(fds[1]);                    // close child side - we don't need it
+  if(childerr){                      // child failed - reap it and bail out
+    int err=childerr;                // ...
+    while(waitpid(pid,NULL,0)<0&&errno==EINTR);
+    app_message(FATAL,"child failed executing: %s, errno: %d, errstr: %s in spawn()",file,err,strerror(err));
+  }
+  setfdnonblock(fds[0]);             // make sure fd is non-blocking on parent side
+  PARA_PROBE1(child__spawn,pid);     // ...
+  struct intpair pret={pid,fds[0]};  // parent side of full duplex pipe
+  return pret;
 }
 // wait for a child process and handle errors
 void ewaitpid(int pid){
   int stat;
   int pret;
   while((pret=waitpid(pid,&stat,0))<0&&errno==EINTR);
+  if(pret==pid)PARA_PROBE2(child__exit,pid,stat);
   if(pret==pid){
     // check how child process terminated
     if(WIFEXITED(stat)){
@@ -154,7 +189,7 @@ void ewaitpid(int pid){
 }
 // open a file, if error log and exit
 int eopen(char const*path,int oflag,mode_t mode){
-  int stat=open(path,oflag,mode);
+  int stat=open(path,oflag|O_CLOEXEC,mode);         // (child processes never inherit files we open)
   if(stat<0)app_message(FATAL,",failed opening file: %s, errno: %d, errstr: %s",path,errno,strerror(errno));
   return stat;
 }
@@ -174,3 +209,163 @@ void eunlink(const char *path){
   int stat=unlink(path);
   if(stat<0)app_message(FATAL,"failed unlink, errno: %d, errstr: %s",errno,strerror(errno));
 }
+// check if 'addr' is a network address ('tcp://host:port' or 'unix:/path')
+int isnetaddr(char const*addr){
+  if(!addr)return 0;
+  return strncmp(addr,"tcp://",6)==0||strncmp(addr,"unix:",5)==0;
+}
+// connect to a network address ('tcp://host:port' or 'unix:/path') and return fd
+// (the returned fd is in blocking mode)
+int econnect(char const*addr){
+  int fd=connectaddr(addr);
+  if(fd<0)app_message(FATAL,"failed connecting to: %s, errno: %d, errstr: %s in econnect()",addr,errno,strerror(errno));
+  return fd;
+}
+// connect to a network address ('tcp://host:port' or 'unix:/path') and return fd
+// (returns -1 if we cannot connect, a malformed address is a fatal error)
+int connectaddr(char const*addr){
+  if(strncmp(addr,"unix:",5)==0){                       // unix domain socket
+    char const*path=addr+5;                             // path to socket
+    struct sockaddr_un sa;                              // ...
+    memset(&sa,0,sizeof sa);                            // ...
+    if(strlen(path)==0||strlen(path)>=sizeof(sa.sun_path))app_message(FATAL,"invalid unix socket path in address: %s in connectaddr()",addr);
+    sa.sun_family=AF_UNIX;                              // ...
+    strcpy(sa.sun_path,path);                           // ...
+    int fd=socket(AF_UNIX,SOCK_STREAM,0);               // create socket and connect
+    if(fd<0)app_message(FATAL,"socket failed, errno: %d, errstr: %s in connectaddr()",errno,strerror(errno));
+    setfdcloexec(fd);                                   // ...
+    int stat;
+    while((stat=connect(fd,(struct sockaddr*)&sa,sizeof sa))<0&&errno==EINTR);
+    if(stat<0){
+      int err=errno;                                    // keep errno from connect()
+      eclose(fd);                                       // ...
+      errno=err;                                        // ...
+      return -1;
+    }
+    return fd;
+  }
+  if(strncmp(addr,"tcp://",6)==0){                      // tcp socket
+    char host[FILENAME_MAX+1];                          // split 'host:port'
+    char const*hostport=addr+6;                         // ...
+    char const*colon=strrchr(hostport,':');             // ...
+    if(!colon||colon==hostport||!colon[1]||colon-hostport>FILENAME_MAX){
+      app_message(FATAL,"invalid tcp address: %s, expected 'tcp://host:port' in connectaddr()",addr);
+    }
+    memcpy(host,hostport,colon-hostport);               // ...
+    host[colon-hostport]='\0';                          // ...
+    struct addrinfo hints;                              // resolve host and port
+    memset(&hints,0,sizeof hints);                      // ...
+    hints.ai_family=AF_UNSPEC;                          // ...
+    hints.ai_socktype=SOCK_STREAM;                      // ...
+    struct addrinfo*res=NULL;                           // ...
+    int gstat=getaddrinfo(host,colon+1,&hints,&res);    // ...
+    if(gstat!=0)app_message(FATAL,"failed resolving address: %s, err: %s in connectaddr()",addr,gai_strerror(gstat));
+    int fd=-1;                                          // try addresses until we can connect
+    for(struct addrinfo*ai=res;ai&&fd<0;ai=ai->ai_next){
+      if((fd=socket(ai->ai_family,ai->ai_socktype,ai->ai_protocol))<0)continue;
+      setfdcloexec(fd);
+      int stat;
+      while((stat=connect(fd,ai->ai_addr,ai->ai_addrlen))<0&&errno==EINTR);
+      if(stat==0)break;
+      int err=errno;
+      eclose(fd);
+      errno=err;
+      fd=-1;
+    }
+    freeaddrinfo(res);
+    return fd;
+  }
+  app_message(FATAL,"invalid network address: %s, expected 'tcp://host:port' or 'unix:/path' in connectaddr()",addr);
+  __builtin_unreachable();
+}
+// true if fd is a socket, else false
+int fdissock(int fd){
+  struct stat st;
+  if(fstat(fd,&st)<0)app_message(FATAL,"failed fstat on fd: %d, errno: %d, errstr: %s in fdissock()",fd,errno,strerror(errno));
+  return S_ISSOCK(st.st_mode);
+}
+// write a vector of buffers to fd
+// (fd is non-blocking - returns #of bytes written which can be less than requested, 0 if write would block, -1 if socket closed by peer)
+// (if fd is a socket we use sendmsg() so that a closed peer gives us an error instead of a SIGPIPE)
+ssize_t ewritev(int fd,struct iovec*iov,int iovcnt,int issock){
+  ssize_t wstat;
+  while(1){
+    if(issock){
+      struct msghdr msg;
+      memset(&msg,0,sizeof msg);
+      msg.msg_iov=iov;
+      msg.msg_iovlen=iovcnt;
+      wstat=sendmsg(fd,&msg,MSG_NOSIGNAL);
+    }else{
+      wstat=writev(fd,iov,iovcnt);
+    }
+    if(wstat>=0)return wstat;
+    if(errno==EINTR)continue;                  // interupted by signal - try again
+    if(errno==EAGAIN)return 0;                 // we would block - caller will wait for select() and try again
+    if(issock&&(errno==EPIPE||errno==ECONNRESET))return -1;// peer closed connection
+    break;
+  }
+  app_message(FATAL,"error writing in ewritev(): %s, errno: %d, iovcnt: %d",strerror(errno),errno,iovcnt);
+  __builtin_unreachable();
+}
+// create a non-blocking unix domain socket listening on 'path'
+// (if 'path' exists and is a socket it is removed first)
+int elistenunix(char const*path){
+  struct sockaddr_un sa;                                // setup address
+  memset(&sa,0,sizeof sa);                              // ...
+  if(strlen(path)==0||strlen(path)>=sizeof(sa.sun_path))app_message(FATAL,"invalid unix socket path: %s in elistenunix()",path);
+  sa.sun_family=AF_UNIX;                                // ...
+  strcpy(sa.sun_path,path);                             // ...
+  struct stat st;                                       // remove stale socket
+  if(stat(path,&st)==0){                                // ...
+    if(!S_ISSOCK(st.st_mode))app_message(FATAL,"file: %s exists and is not a socket in elistenunix()",path);
+    eunlink(path);                                      // ...
+  }
+  int fd=socket(AF_UNIX,SOCK_STREAM,0);                 // create socket, bind and listen
+  if(fd<0)app_message(FATAL,"socket failed, errno: %d, errstr: %s in elistenunix()",errno,strerror(errno));
+  setfdcloexec(fd);                                     // ...
+  if(bind(fd,(struct sockaddr*)&sa,sizeof sa)<0)app_message(FATAL,"bind to: %s failed, errno: %d, errstr: %s in elistenunix()",path,errno,strerror(errno));
+  if(listen(fd,SOMAXCONN)<0)app_message(FATAL,"listen on: %s failed, errno: %d, errstr: %s in elistenunix()",path,errno,strerror(errno));
+  setfdnonblock(fd);                                    // ...
+  return fd;
+}
+// create a non-blocking pipe used for waking up a thread blocked in select()
+void ewakepipe(int fds[2]){
+  if(pipe(fds)<0)app_message(FATAL,"pipe failed, errno: %d, errstr: %s in ewakepipe()",errno,strerror(errno));
+  setfdcloexec(fds[0]);                                 // child processes have no use for the pipe
+  setfdcloexec(fds[1]);                                 // ...
+  setfdnonblock(fds[0]);
+  setfdnonblock(fds[1]);
+}
+// wake up thread waiting on read end of wakeup pipe
+// (if the pipe is full a wakeup is already pending)
+void ewakeup(int fd){
+  char c=0;
+  while(write(fd,&c,1)<0){
+    if(errno==EINTR)continue;
+    if(errno==EAGAIN||errno==EWOULDBLOCK)break;
+    app_message(FATAL,"write to wakeup pipe failed, errno: %d, errstr: %s in ewakeup()",errno,strerror(errno));
+  }
+}
+// drain all wakeups from read end of wakeup pipe
+void edrain(int fd){
+  char buf[256];
+  while(1){
+    ssize_t n=read(fd,buf,sizeof buf);
+    if(n>0)continue;
+    if(n<0&&errno==EINTR)continue;
+    if(n<0&&errno!=EAGAIN&&errno!=EWOULDBLOCK)app_message(FATAL,"read from wakeup pipe failed, errno: %d, errstr: %s in edrain()",errno,strerror(errno));
+    break;
+  }
+}
+// create a thread with all signals blocked
+// (signal handlers - e.g., the SIGCHLD handler maintaining the list of retired child processes - must only run on the main thread)
+// (the new thread inherits our signal mask, so we block all signals around pthread_create() and then restore our mask)
+int createthread(pthread_t*thread,void*(*fn)(void*),void*arg){
+  sigset_t allmask,origmask;
+  sigfillset(&allmask);
+  pthread_sigmask(SIG_SETMASK,&allmask,&origmask);
+  int stat=pthread_create(thread,NULL,fn,arg);
+  pthread_sigmask(SIG_SETMASK,&origmask,NULL);
+  return stat;
+}
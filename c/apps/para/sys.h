@@ -3,13 +3,16 @@
 #include "util.h"
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <pthread.h>
 
 // --- wrapper functions for system calls that should not fail ---
 // (if a call fails the program is terminated with an error message)
 
 void eclose(int fd);                                              // wrapper around close() system call
-ssize_t ewrite(int fd,void const*buf,size_t count,int mustwrite); // write to fd with error checking
+ssize_t ewrite(int fd,void const*buf,size_t count,int mustwrite,int issock); // write to fd with error checking (returns -1 if peer closed and fd is a socket or SIGPIPE is ignored)
 void setfdnonblock(int fd);                                       // set fd to non blocking mode
+void setfdcloexec(int fd);                                        // set close-on-exec flag on fd
 int edup(int fd);                                                 // dup with error checking
 int ereadline(FILE*dp,char*buf,int bufmax,int mustread);          // read a line including NL or, until we reach EOF (return #of characters read - can be 0)
 struct intpair spawn(char const*file,char*argv[]);                // spawn a child - return value [pid, fd] where pid is child pid, fd is fd to stdin/stdout for child
@@ -18,3 +21,13 @@ int eopen(char const*path,int oflag,mode_t mode_t);               // open a file
 void efsync(int fd);                                              // sync fd to disk
 size_t elseek(int fd,size_t offset,int whence);                   // seek in file
 void eunlink(const char *path);                                   // unlink a file
+int isnetaddr(char const*addr);                                   // check if 'addr' is a network address ('tcp://host:port' or 'unix:/path')
+int econnect(char const*addr);                                    // connect to a network address ('tcp://host:port' or 'unix:/path') and return fd
+int connectaddr(char const*addr);                                 // same as econnect() but returns -1 if server cannot be reached
+int fdissock(int fd);                                             // true if fd is a socket, else false
+int elistenunix(char const*path);                                 // create a non-blocking unix domain socket listening on 'path' (stale socket file is removed)
+ssize_t ewritev(int fd,struct iovec*iov,int iovcnt,int issock);   // write a vector of buffers to fd (return 0 if write would block, -1 if peer closed socket)
+void ewakepipe(int fds[2]);                                       // create a non-blocking pipe used for waking up a thread blocked in select()
+void ewakeup(int fd);                                             // wake up thread waiting on read end of wakeup pipe (write end is 'fd')
+void edrain(int fd);                                              // drain all wakeups from read end of wakeup pipe
+int createthread(pthread_t*thread,void*(*fn)(void*),void*arg);    // create a thread with all signals blocked (returns error number from pthread_create())
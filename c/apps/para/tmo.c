@@ -10,7 +10,7 @@
 // constructor
 struct tmo_t*tmo_ctor(enum tmo_typ typ,size_t sec,size_t key){
   struct tmo_t*ret=emalloc(sizeof(struct tmo_t));
-  ret->typ_=typ;                // type of timer - we support HEARTBEAT and CLIENT timers
+  ret->typ_=typ;                // type of timer - we support HEARTBEAT, CLIENT, IDLE and RECONNECT timers
   ret->sec_=sec;                // timer value is in seconds
   ret->key_=key;                // a user defined key - typically an index into some table
   return tmo_reactivate(ret);   // activate timer
@@ -51,16 +51,17 @@ struct tmo_t*tmo_reactivate(struct tmo_t*tmo){
 }
 // get tmo type as a string
 char const*const tmo_type2str(struct tmo_t*tmo){
-  return tmo_type(tmo)==HEARTBEAT?"HEARTBEAT":"CLIENT";
+  return tmo_type(tmo)==HEARTBEAT?"HEARTBEAT":tmo_type(tmo)==CLIENT?"CLIENT":tmo_type(tmo)==IDLE?"IDLE":"RECONNECT";
 }
 
 // --- timer queue ---
 
 // timeout comparator
+// (timers are ordered on when they pop - timers of different length are mixed in the queue)
 static int tmocmp(void*t1,void*t2){
   struct tmo_t*tt1=t1;
   struct tmo_t*tt2=t2;
-  return tmo_sec(tt1)<=tmo_sec(tt2);
+  return tmo_sec2tmo(tt1)<=tmo_sec2tmo(tt2);
 }
 // (implemented as a priority queue)
 struct priq*tmoq_ctor(size_t maxel){
@@ -8,11 +8,11 @@
 // (timer queue is based on a heap based priority queue)
 
 // enum for timeout types
-enum tmo_typ{HEARTBEAT=0,CLIENT=1};
+enum tmo_typ{HEARTBEAT=0,CLIENT=1,IDLE=2,RECONNECT=3};
 
 // timeout class
 struct tmo_t{
-  enum tmo_typ typ_;      // type of timeout (child process or heartbeat)
+  enum tmo_typ typ_;      // type of timeout (child process, heartbeat, idle child process or service reconnect)
   size_t sec_;            // timeout in seconds
   size_t key_;            // key which can be used by client code to correlate the timeout with something
   size_t sec2tmo_;        // seconds from epoch until timer pops
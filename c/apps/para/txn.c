@@ -2,6 +2,7 @@
 #include "txn.h"
 #include "sys.h"
 #include "error.h"
+#include "probe.h"
 #include <errno.h>
 #include <string.h>
 #include <libgen.h>
@@ -72,6 +73,7 @@ void txn_setKeeplog(struct txn_t*txn,int keeplog){
 }
 // commit transaction
 void txn_commit(struct txn_t*txn,struct txnlog_t*txnlog){
+  PARA_PROBE1(commit__start,txnlog->nlines_);
   if(txn->cansyncoutfd_)efsync(txn->fdout_);                                 // sync output file to disk
   int fdtmplog=eopen(txn->tmptxnlogfile_,O_WRONLY|O_CREAT|O_TRUNC,0777);     // open file for temporary transaction log
 
@@ -88,6 +90,7 @@ void txn_commit(struct txn_t*txn,struct txnlog_t*txnlog){
   efsync(txn->fdtxnlogdir_);                           // sync directory cotaining transaction log
   int stat2=rename(txn->tmptxnlogfile_,txn->txnlogfile_); // ATOMICALLY rename temporary transaction log to the real transaction log
   if(stat2<0)app_message(FATAL,"rename of temporary transcation log failed, errno: %d, errstr: %s",errno,strerror(errno));
+  PARA_PROBE1(commit__end,txnlog->nlines_);
 }
 // recover transaction
 // (returns #of lines committed, if txn log does not exist return value is 0)
@@ -112,6 +115,6 @@ struct txnlog_t*txn_recover(struct txn_t*txn){
 }
 // dump information about transaction on a file
 void txn_dump(struct txn_t*txn,FILE*fp,int nl){
-  fprintf(fp,"tmptxnlogfile: %s, tmptxnlog: %s, keeplog: %s",txn->txnlogfile_,txn->tmptxnlogfile_,txn->txnlogfile_?"true":"false");
+  fprintf(fp,"tmptxnlogfile: %s, tmptxnlog: %s, keeplog: %s",txn->txnlogfile_,txn->tmptxnlogfile_,txn->keeplog_?"true":"false");
   if(nl)fprintf(fp,"\n");
 }
@@ -62,3 +62,43 @@ void efpclose(FILE*fp){
   if(stat==0)return;
   app_message(FATAL,"error while closeing file pointer, errno: %d, error: %s",errno,strerror(errno));
 }
+// FNV-1a hash of 's' continuing from hash 'h'
+uint64_t fnv1a(uint64_t h,char const*s,size_t len){
+  for(size_t i=0;i<len;++i){
+    h^=(unsigned char)s[i];
+    h*=1099511628211ULL;
+  }
+  return h;
+}
+// hash of 's' independent of 'fnv1a()' continuing from hash 'h'
+// (multiply by the 64 bit golden ratio and fold high bits down - used to verify that two lines with the same FNV-1a hash are the same line)
+uint64_t mixhash(uint64_t h,char const*s,size_t len){
+  for(size_t i=0;i<len;++i){
+    h=(h^(unsigned char)s[i])*0x9e3779b97f4a7c15ULL;
+    h^=h>>29;
+  }
+  return h;
+}
+// find field 'field' (1: first field) in 'line'
+// ('start' and 'end' are set to the range of the field, returns false if line has too few fields)
+int findfield(char const*line,size_t len,size_t field,char delim,size_t*start,size_t*end){
+  size_t nfield=1;
+  *start=0;
+  for(size_t i=0;i<=len;++i){
+    if(i<len&&line[i]!=delim)continue;
+    if(nfield==field){
+      *end=i;
+      return 1;
+    }
+    ++nfield;
+    *start=i+1;
+  }
+  *start=*end=0;
+  return 0;
+}
+// current time in micro seconds
+double nowusec(){
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1e6+tv.tv_usec;
+}
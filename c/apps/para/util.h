@@ -2,10 +2,17 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 // --- a few basic utility functions ---
 
+// start value for 'fnv1a()'
+#define FNV1A_OFFSET 14695981039346656037ULL
+
+// start value for 'mixhash()'
+#define MIXHASH_OFFSET 2870177450012600261ULL
+
 // pair struct
 struct intpair{
   int first;
@@ -20,3 +27,7 @@ char const*const bool2str(int v);                        // return 'true' or \fa
 int isposnumber(char const*s);                           // check if 's' is a positive number
 FILE*efdopen(int fd,char const* mode);                   // open a FILE using an fd with error checking
 void efpclose(FILE*fp);                                  // close an FILE*
+uint64_t fnv1a(uint64_t h,char const*s,size_t len);     // FNV-1a hash of 's' continuing from hash 'h'
+uint64_t mixhash(uint64_t h,char const*s,size_t len);   // hash of 's' independent of 'fnv1a()' continuing from hash 'h'
+double nowusec();                                        // current time in micro seconds
+int findfield(char const*line,size_t len,size_t field,char delim,size_t*start,size_t*end); // find field 'field' (1: first field) in 'line' (returns false if too few fields)
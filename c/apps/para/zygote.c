@@ -0,0 +1,109 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#include "zygote.h"
+#include "sys.h"
+#include "error.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// max length of a reply from zygote
+#define ZYGOTE_MAXREPLY 64
+
+// forward decl
+static void readreply(struct zygote_t*zyg,char*buf,size_t len);
+
+// spawn zygote and wait until it is ready
+// (the zygote may take a long time to initialize - we block until it tells us it is ready)
+struct zygote_t*zygote_ctor(char const*file,char*argv[]){
+  struct zygote_t*ret=emalloc(sizeof(struct zygote_t));
+  struct intpair p=spawn(file,argv);
+  ret->pid_=p.first;
+  ret->fd_=p.second;
+  ret->exitlineno_=-1;
+  int flags=fcntl(ret->fd_,F_GETFL,0);                        // control connection is blocking
+  if(fcntl(ret->fd_,F_SETFL,flags&~O_NONBLOCK)<0){            // ...
+    app_message(FATAL,"zygote: failed setting control connection in blocking mode: %s",strerror(errno));
+  }
+  app_message(INFO,"zygote: waiting for zygote with pid: %d to initialize ...",ret->pid_);
+  char reply[ZYGOTE_MAXREPLY];
+  readreply(ret,reply,sizeof reply);
+  if(strcmp(reply,"ready")){
+    app_message(FATAL,"zygote: expected 'ready' from zygote with pid: %d, got: '%s'",ret->pid_,reply);
+  }
+  app_message(INFO,"zygote: zygote with pid: %d is ready",ret->pid_);
+  return ret;
+}
+// destructor
+// (child processes forked by the zygote must already have seen EOF on their sockets - the zygote reaps them)
+void zygote_dtor(struct zygote_t*zyg){
+  eclose(zyg->fd_);
+  ewaitpid(zyg->pid_);
+  free(zyg);
+}
+// fork a child process
+struct intpair zygote_fork(struct zygote_t*zyg){
+  int fds[2];
+  if(socketpair(AF_LOCAL,SOCK_STREAM,0,fds)<0)app_message(FATAL,"socketpair failed, errno: %d, errstr: %s in zygote_fork()",errno,strerror(errno));
+  setfdcloexec(fds[0]);                                       // (other child processes must not inherit the sockets)
+  setfdcloexec(fds[1]);                                       // ...
+
+  // send 'fork' request with child side of socket pair
+  char req[]="fork\n";
+  struct iovec iov={req,sizeof req-1};
+  union{                                                      // (aligned buffer for ancillary data)
+    char buf[CMSG_SPACE(sizeof(int))];                        // ...
+    struct cmsghdr align;                                     // ...
+  }ctl;
+  memset(&ctl,0,sizeof ctl);
+  struct msghdr msg;
+  memset(&msg,0,sizeof msg);
+  msg.msg_iov=&iov;
+  msg.msg_iovlen=1;
+  msg.msg_control=ctl.buf;
+  msg.msg_controllen=sizeof ctl.buf;
+  struct cmsghdr*cmsg=CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level=SOL_SOCKET;
+  cmsg->cmsg_type=SCM_RIGHTS;
+  cmsg->cmsg_len=CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg),&fds[1],sizeof(int));
+  ssize_t stat;
+  while((stat=sendmsg(zyg->fd_,&msg,MSG_NOSIGNAL))<0&&errno==EINTR);
+  if(stat!=(ssize_t)iov.iov_len){
+    app_message(FATAL,"zygote: failed sending fork request to zygote with pid: %d, errno: %d, errstr: %s",zyg->pid_,errno,strerror(errno));
+  }
+  eclose(fds[1]);                                             // zygote has its own copy now
+
+  // wait for pid of new child process
+  char reply[ZYGOTE_MAXREPLY];
+  readreply(zyg,reply,sizeof reply);
+  char*end;
+  long pid=strtol(reply,&end,10);
+  if(*reply=='\0'||*end!='\0'||pid<=0){
+    app_message(FATAL,"zygote: expected pid of forked child process from zygote with pid: %d, got: '%s'",zyg->pid_,reply);
+  }
+  ++zyg->nforks_;
+  setfdnonblock(fds[0]);
+  struct intpair ret={pid,fds[0]};
+  return ret;
+}
+
+// --- helpers ---
+
+// read a reply line from zygote (without NL)
+// (replies are short - reading one byte at a time makes sure we never read past the end of a reply)
+static void readreply(struct zygote_t*zyg,char*buf,size_t len){
+  size_t n=0;
+  while(1){
+    char c;
+    ssize_t stat=read(zyg->fd_,&c,1);
+    if(stat<0&&errno==EINTR)continue;
+    if(stat<0)app_message(FATAL,"zygote: failed reading from zygote with pid: %d, errno: %d, errstr: %s",zyg->pid_,errno,strerror(errno));
+    if(stat==0)app_message(FATAL,"zygote: zygote with pid: %d closed control connection",zyg->pid_);
+    if(c=='\n')break;
+    if(n+1==len)app_message(FATAL,"zygote: reply from zygote with pid: %d too long",zyg->pid_);
+    buf[n++]=c;
+  }
+  buf[n]='\0';
+}
@@ -0,0 +1,26 @@
+// (C) Copyright Hans Ewetz 2019. All rights reserved.
+#pragma once
+#include <stdlib.h>
+#include "util.h"
+
+// --- zygote: a single child process that forks the child processes para talks to ---
+// (the zygote does its expensive initialization once, child processes forked from it share the initialized state copy-on-write)
+// (the zygote is spawned like any child process - its stdin/stdout is the control connection described below)
+// (child processes forked by the zygote are children of the zygote, not of para - para sees a child process exit as EOF on its socket)
+//
+// protocol on the control connection:
+//   zygote --> para:  'ready\n'                    zygote has initialized and is ready to fork child processes
+//   para --> zygote:  'fork\n' + one fd            fd (sent as SCM_RIGHTS ancillary data) becomes stdin and stdout of the new child process
+//   zygote --> para:  '<pid>\n'                    pid of the new child process
+// (the zygote exits when it reads EOF on the control connection)
+
+struct zygote_t{
+  int pid_;                       // pid of zygote
+  int fd_;                        // control connection (blocking)
+  size_t nforks_;                 // #of child processes forked
+  int exitlineno_;                // line in flight when a forked child process last exited (-1: none)
+  size_t nexits_;                 // #of child processes in a row that exited with 'exitlineno_' in flight
+};
+struct zygote_t*zygote_ctor(char const*file,char*argv[]);  // spawn zygote and wait until it is ready (arguments are the same as for execvp())
+void zygote_dtor(struct zygote_t*zyg);                     // destructor (closes control connection and waits for zygote to exit)
+struct intpair zygote_fork(struct zygote_t*zyg);           // fork a child process - return value [pid, fd] where fd is the non-blocking para side of a socket pair